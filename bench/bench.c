@@ -0,0 +1,173 @@
+/** @file
+ *  @brief Sampling benchmark for the native_posix variant
+ *
+ *  Runs next to the unmodified application on the emulated board and,
+ *  after BENCH_DAYS of simulated time, prints what the sampling cost:
+ *  I2C transactions per sample, rail on time, wakeups per hour and how
+ *  busy the sampling kept the system workqueue, followed by the battery
+ *  life projection of sim.c. Then it ends the process, so the numbers
+ *  can be compared run to run.
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <zephyr.h>
+#include <device.h>
+#include <misc/printk.h>
+#include <posix_board_if.h>
+
+#include "emul.h"
+#include "i2c_wrap.h"
+#include "../src/probe.h"
+#include "../src/metrics.h"
+#include "sim.h"
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Simulated days before the report, native_posix runs faster than that */
+#ifndef BENCH_DAYS
+#define BENCH_DAYS              1
+#endif
+
+#define BENCH_STACK_SIZE        1024
+#define BENCH_PRIORITY          K_LOWEST_APPLICATION_THREAD_PRIO
+
+#ifndef CONFIG_WALNUT_PROBES
+#error "The benchmark counts samples with the latency probes"
+#endif
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+struct bench_sensor {
+    const char *name;
+    u16_t addr;
+    probe_id_t fetch;
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static const struct bench_sensor _sensors[] = {
+    { "si7020", 0x40, PROBE_SI7020_FETCH },
+    { "tsl4531", 0x29, PROBE_TSL4531_FETCH },
+    { "bmp280", CONFIG_BMP280_I2C_ADDR, PROBE_BMP280_FETCH },
+};
+
+/* Work items the sampling puts on the system workqueue */
+static const probe_id_t _work[] = {
+    PROBE_T_RH_WORK,
+    PROBE_ALS_WORK,
+    PROBE_BP_WORK,
+    PROBE_FG_WORK,
+};
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static void i2c_report(void)
+{
+    i2c_emul_stats_t stats;
+    probe_hist_t hist;
+
+    for (int i = 0; i < ARRAY_SIZE(_sensors); i++) {
+        if (i2c_emul_stats_get(_sensors[i].addr, &stats)) {
+            continue;
+        }
+
+        probe_hist_get(_sensors[i].fetch, &hist);
+
+        printk("bench: %s samples %u i2c %u nack %u bytes %u",
+               _sensors[i].name, hist.count, stats.transfers, stats.nacks,
+               stats.bytes);
+
+        if (hist.count) {
+            printk(" per sample %u.%u",
+                   stats.transfers / hist.count,
+                   stats.transfers * 10 / hist.count % 10);
+        }
+
+        printk("\n");
+    }
+}
+
+static void rail_report(u64_t window_us)
+{
+    struct device *rail = device_get_binding(CONFIG_I2C_WRAP_NAME);
+    u64_t on_us;
+
+    if (rail == NULL) {
+        return;
+    }
+
+    on_us = i2c_wrap_rail_time_get(rail);
+
+    printk("bench: rail on %u ms, %u ppm\n", (u32_t)(on_us / USEC_PER_MSEC),
+           (u32_t)(on_us * 1000000 / window_us));
+}
+
+/*
+ * A work item holds the queue from start to end, sleeps included; the
+ * longest one is how late anything queued behind it can be.
+ */
+static void workq_report(u64_t window_us)
+{
+    probe_hist_t hist;
+    u64_t busy_us = 0;
+    u32_t max_us = 0;
+    u32_t items = 0;
+
+    for (int i = 0; i < ARRAY_SIZE(_work); i++) {
+        probe_hist_get(_work[i], &hist);
+        busy_us += hist.total_us;
+        items += hist.count;
+        max_us = max(max_us, hist.max_us);
+    }
+
+    printk("bench: workqueue items %u busy %u ms, %u ppm, longest %u us\n",
+           items, (u32_t)(busy_us / USEC_PER_MSEC),
+           (u32_t)(busy_us * 1000000 / window_us), max_us);
+}
+
+static void bench_thread(void *p1, void *p2, void *p3)
+{
+    u64_t window_us;
+
+#ifdef REPLAY
+    /* A replay ends with its capture, see replay.c */
+    return;
+#endif
+
+    /* One day at a time, a longer sleep overflows the timeout */
+    for (int i = 0; i < BENCH_DAYS; i++) {
+        k_sleep(K_HOURS(24));
+    }
+
+    window_us = (u64_t)k_uptime_get() * USEC_PER_MSEC;
+
+    printk("bench: window %u s\n", (u32_t)(window_us / USEC_PER_SEC));
+    i2c_report();
+    rail_report(window_us);
+    printk("bench: wakeups per hour %u\n",
+           metrics_get(METRIC_WAKEUPS_PER_HOUR));
+    workq_report(window_us);
+    sim_report();
+
+    posix_exit(0);
+}
+
+K_THREAD_DEFINE(bench_tid, BENCH_STACK_SIZE, bench_thread, NULL, NULL, NULL,
+                BENCH_PRIORITY, 0, K_NO_WAIT);
@@ -0,0 +1,175 @@
+/** @file
+ *  @brief Bluetooth stand-in for the native_posix variant
+ *
+ *  native_posix in this kernel has no controller. The readings are kept
+ *  as ble.c keeps them, so the retained snapshot and the stale read
+ *  refresh behave as on the device. The advertising, connection
+ *  parameter and notification modules and the ESS and battery services
+ *  run as ble.c sets them up, against the host stand-in in bt_stub.c. A
+ *  replay build takes its samples from a capture instead of the emulated
+ *  sensors.
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+
+#include "../src/ble.h"
+#include "../src/readings.h"
+#include "../src/adv.h"
+#include "../src/conn_param.h"
+#include "../src/notify.h"
+#include "../src/nv.h"
+#include "../src/ess.h"
+#include "../src/bas.h"
+#include "../src/ccc_store.h"
+#include "sim.h"
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* A replay stands in for the sensors, see replay.c */
+#ifdef REPLAY
+#define BLE_STUB_LIVE           false
+#else
+#define BLE_STUB_LIVE           true
+#endif
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static void connected(struct bt_conn *conn, u8_t err)
+{
+    if (!err) {
+        conn_param_connected(conn);
+    }
+}
+
+static void disconnected(struct bt_conn *conn, u8_t reason)
+{
+    conn_param_disconnected(conn);
+}
+
+static void le_param_updated(struct bt_conn *conn, u16_t interval,
+                u16_t latency, u16_t timeout)
+{
+    conn_param_updated(conn, interval, latency, timeout);
+}
+
+static struct bt_conn_cb conn_callbacks = {
+    .connected = connected,
+    .disconnected = disconnected,
+    .le_param_updated = le_param_updated,
+};
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+void ble_init(void)
+{
+    adv_init(NV_ADV_MODE_CONNECTABLE);
+    conn_param_init();
+    notify_init();
+
+    bt_conn_cb_register(&conn_callbacks);
+
+    ccc_store_init();
+    ess_init();
+    bas_init();
+
+    adv_start();
+}
+
+/**
+* @brief Publishes a sample as ble.c does
+*
+* Called from the system workqueue, like the sensor callbacks.
+*/
+void ble_stub_sample(readings_ch_t channel, double value)
+{
+    readings_t *readings = readings_begin();
+
+    switch (channel) {
+    case READINGS_CH_TEMPERATURE:
+        readings->temperature = (int16_t)(100 * value);
+        readings_commit(readings, READINGS_TEMPERATURE);
+        ess_temperature_update(readings->temperature);
+        break;
+    case READINGS_CH_HUMIDITY:
+        readings->humidity = (uint16_t)(100 * value);
+        readings_commit(readings, READINGS_HUMIDITY);
+        ess_humidity_update(readings->humidity);
+        break;
+    case READINGS_CH_AMBIENT_LIGHT:
+        readings->ambient_light = readings_als_from_lux(value);
+        readings_commit(readings, READINGS_AMBIENT_LIGHT);
+        ess_als_update(readings->ambient_light);
+        break;
+    case READINGS_CH_BARO_PRESSURE:
+        readings->pressure = (uint32_t)(10000 * value);
+        readings_commit(readings, READINGS_BARO_PRESSURE);
+        ess_baro_press_update(readings->pressure);
+        break;
+    case READINGS_CH_BATTERY:
+        readings->battery = (uint8_t)value;
+        readings_commit(readings, READINGS_BATTERY);
+        adv_battery_update(readings->battery);
+        bas_update(readings->battery);
+        break;
+    default:
+        break;
+    }
+}
+
+void ble_update_temp(double temperature)
+{
+    if (BLE_STUB_LIVE) {
+        ble_stub_sample(READINGS_CH_TEMPERATURE, temperature);
+    }
+}
+
+void ble_update_humidity(double humidity)
+{
+    if (BLE_STUB_LIVE) {
+        ble_stub_sample(READINGS_CH_HUMIDITY, humidity);
+    }
+}
+
+void ble_update_ambient_light(double ambient_light)
+{
+    if (BLE_STUB_LIVE) {
+        ble_stub_sample(READINGS_CH_AMBIENT_LIGHT, ambient_light);
+    }
+}
+
+void ble_update_baro_pressure(double pressure)
+{
+    if (BLE_STUB_LIVE) {
+        ble_stub_sample(READINGS_CH_BARO_PRESSURE, pressure);
+    }
+}
+
+void ble_update_battery(uint8_t battery_capacity)
+{
+    if (BLE_STUB_LIVE) {
+        ble_stub_sample(READINGS_CH_BATTERY, battery_capacity);
+    }
+}
+
+void ble_restore(const readings_t *readings)
+{
+}
@@ -0,0 +1,462 @@
+/** @file
+ *  @brief Bluetooth host stand-in for the native_posix variant
+ *
+ *  native_posix in this kernel has no controller. The host calls of
+ *  adv.c, conn_param.c, notify.c and the ESS and battery services land
+ *  here, so their policies run on the simulated kernel time as they do on
+ *  the device: the advertising state machine backs off, a simulated
+ *  central grants the parameter requests and configures the services
+ *  through their attributes, and the connection callbacks feed the
+ *  energy accounting.
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <zephyr.h>
+#include <misc/byteorder.h>
+#include <net/buf.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "sim.h"
+
+#define SYS_LOG_DOMAIN "bt_stub"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Largest HCI command parameter block */
+#define BT_STUB_CMD_LEN         255
+
+/* Supervision timeout the central opens the link with, 4 s */
+#define BT_STUB_INIT_TIMEOUT    400
+
+/* Services the application registers */
+#define BT_STUB_SERVICES_MAX    4
+
+/* Connection interval unit, us */
+#define BT_STUB_INTERVAL_UNIT   1250
+
+/*
+ * TX buffers free in a connection event; 0 never runs out. The host of
+ * this version waits for a buffer. With a count set, a notification past
+ * it fails with -ENOMEM, as with a host that does not wait, and the
+ * buffers are free again at the next connection event.
+ */
+#ifndef SIM_TX_BUFFERS
+#define SIM_TX_BUFFERS          0
+#endif
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+/* Opaque to the application, like the host's own */
+struct bt_conn {
+    atomic_t ref;
+    bt_addr_le_t dst;
+    u16_t interval;
+    u16_t latency;
+    u16_t timeout;
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+NET_BUF_POOL_DEFINE(_cmd_pool, 1, BT_STUB_CMD_LEN, 0, NULL);
+
+static struct bt_conn_cb *_callbacks;
+
+static bool _adv_connectable;
+static bool _connected;
+
+/* The one simulated central */
+static struct bt_conn _conn = {
+    .dst = {
+        .type = BT_ADDR_LE_RANDOM,
+        .a.val = { 0x01, 0x00, 0x00, 0x00, 0x00, 0xc0 },
+    },
+};
+
+/* Parameters granted, reported to the callbacks from the workqueue */
+static u16_t _granted_interval;
+static u16_t _granted_latency;
+static u16_t _granted_timeout;
+static struct k_work _param_work;
+
+static struct bt_gatt_service *_services[BT_STUB_SERVICES_MAX];
+static size_t _service_count;
+static u16_t _last_handle;
+
+/* Connection event the TX buffers were last taken in */
+static s64_t _tx_event;
+static u32_t _tx_used;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static void param_work_handler(struct k_work *work)
+{
+    struct bt_conn_cb *cb;
+
+    _conn.interval = _granted_interval;
+    _conn.latency = _granted_latency;
+    _conn.timeout = _granted_timeout;
+
+    for (cb = _callbacks; cb != NULL; cb = cb->_next) {
+        if (cb->le_param_updated) {
+            cb->le_param_updated(&_conn, _conn.interval, _conn.latency,
+                                 _conn.timeout);
+        }
+    }
+}
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+int bt_le_adv_start(const struct bt_le_adv_param *param,
+                    const struct bt_data *ad, size_t ad_len,
+                    const struct bt_data *sd, size_t sd_len)
+{
+    _adv_connectable = (param->options & BT_LE_ADV_OPT_CONNECTABLE) != 0;
+
+    return 0;
+}
+
+int bt_le_adv_stop(void)
+{
+    _adv_connectable = false;
+
+    return 0;
+}
+
+struct net_buf *bt_hci_cmd_create(u16_t opcode, u8_t param_len)
+{
+    return net_buf_alloc(&_cmd_pool, K_NO_WAIT);
+}
+
+int bt_hci_cmd_send_sync(u16_t opcode, struct net_buf *buf,
+                         struct net_buf **rsp)
+{
+    net_buf_unref(buf);
+
+    if (rsp != NULL) {
+        *rsp = NULL;
+    }
+
+    return 0;
+}
+
+void bt_conn_cb_register(struct bt_conn_cb *cb)
+{
+    cb->_next = _callbacks;
+    _callbacks = cb;
+}
+
+struct bt_conn *bt_conn_ref(struct bt_conn *conn)
+{
+    atomic_inc(&conn->ref);
+
+    return conn;
+}
+
+void bt_conn_unref(struct bt_conn *conn)
+{
+    atomic_dec(&conn->ref);
+}
+
+const bt_addr_le_t *bt_conn_get_dst(const struct bt_conn *conn)
+{
+    return &conn->dst;
+}
+
+int bt_conn_get_info(const struct bt_conn *conn, struct bt_conn_info *info)
+{
+    memset(info, 0, sizeof(*info));
+
+    info->type = BT_CONN_TYPE_LE;
+    info->role = BT_CONN_ROLE_SLAVE;
+    info->le.dst = &conn->dst;
+    info->le.interval = conn->interval;
+    info->le.latency = conn->latency;
+    info->le.timeout = conn->timeout;
+
+    return 0;
+}
+
+/**
+* @brief Grants a parameter update request
+*
+* The central picks the middle of the requested interval range and
+* reports the new parameters from the workqueue, after the request has
+* returned, as the host does.
+*/
+int bt_conn_le_param_update(struct bt_conn *conn,
+                            const struct bt_le_conn_param *param)
+{
+    _granted_interval = (param->interval_min + param->interval_max) / 2;
+    _granted_latency = param->latency;
+    _granted_timeout = param->timeout;
+    k_work_submit(&_param_work);
+
+    return 0;
+}
+
+/* The services of the application use 16 and 128-bit UUIDs */
+int bt_uuid_cmp(const struct bt_uuid *u1, const struct bt_uuid *u2)
+{
+    if (u1->type != u2->type) {
+        return u1->type - u2->type;
+    }
+
+    if (u1->type == BT_UUID_TYPE_16) {
+        return (int)BT_UUID_16(u1)->val - (int)BT_UUID_16(u2)->val;
+    }
+
+    return memcmp(BT_UUID_128(u1)->val, BT_UUID_128(u2)->val, 16);
+}
+
+/* Handles are assigned in registration order, as the host does */
+int bt_gatt_service_register(struct bt_gatt_service *svc)
+{
+    if (_service_count == ARRAY_SIZE(_services)) {
+        return -ENOMEM;
+    }
+
+    for (int i = 0; i < svc->attr_count; i++) {
+        svc->attrs[i].handle = ++_last_handle;
+    }
+
+    _services[_service_count++] = svc;
+
+    return 0;
+}
+
+void bt_gatt_foreach_attr(u16_t start_handle, u16_t end_handle,
+                          bt_gatt_attr_func_t func, void *user_data)
+{
+    struct bt_gatt_attr *attr;
+
+    for (int i = 0; i < _service_count; i++) {
+        for (int j = 0; j < _services[i]->attr_count; j++) {
+            attr = &_services[i]->attrs[j];
+
+            if (attr->handle < start_handle || attr->handle > end_handle) {
+                continue;
+            }
+
+            if (func(attr, user_data) == BT_GATT_ITER_STOP) {
+                return;
+            }
+        }
+    }
+}
+
+ssize_t bt_gatt_attr_read(struct bt_conn *conn,
+                          const struct bt_gatt_attr *attr,
+                          void *buf, u16_t buf_len, u16_t offset,
+                          const void *value, u16_t value_len)
+{
+    u16_t len;
+
+    if (offset > value_len) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    len = min(buf_len, value_len - offset);
+    memcpy(buf, (const u8_t *)value + offset, len);
+
+    return len;
+}
+
+/* The simulated central does not discover the database */
+ssize_t bt_gatt_attr_read_service(struct bt_conn *conn,
+                                  const struct bt_gatt_attr *attr,
+                                  void *buf, u16_t len, u16_t offset)
+{
+    return BT_GATT_ERR(BT_ATT_ERR_NOT_SUPPORTED);
+}
+
+ssize_t bt_gatt_attr_read_chrc(struct bt_conn *conn,
+                               const struct bt_gatt_attr *attr,
+                               void *buf, u16_t len, u16_t offset)
+{
+    return BT_GATT_ERR(BT_ATT_ERR_NOT_SUPPORTED);
+}
+
+ssize_t bt_gatt_attr_read_cud(struct bt_conn *conn,
+                              const struct bt_gatt_attr *attr,
+                              void *buf, u16_t len, u16_t offset)
+{
+    const char *value = attr->user_data;
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, value,
+                             strlen(value));
+}
+
+ssize_t bt_gatt_attr_read_ccc(struct bt_conn *conn,
+                              const struct bt_gatt_attr *attr,
+                              void *buf, u16_t len, u16_t offset)
+{
+    const struct _bt_gatt_ccc *ccc = attr->user_data;
+    const bt_addr_le_t *dst = bt_conn_get_dst(conn);
+    u16_t value = 0;
+
+    for (int i = 0; i < ccc->cfg_len; i++) {
+        if (!bt_addr_le_cmp(&ccc->cfg[i].peer, dst)) {
+            value = sys_cpu_to_le16(ccc->cfg[i].value);
+            break;
+        }
+    }
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
+                             sizeof(value));
+}
+
+/**
+* @brief Stores the CCC value of a central
+*
+* As in the host, the service is told when the combined value of all
+* centrals changes.
+*/
+ssize_t bt_gatt_attr_write_ccc(struct bt_conn *conn,
+                               const struct bt_gatt_attr *attr,
+                               const void *buf, u16_t len, u16_t offset,
+                               u8_t flags)
+{
+    struct _bt_gatt_ccc *ccc = attr->user_data;
+    const bt_addr_le_t *dst = bt_conn_get_dst(conn);
+    struct bt_gatt_ccc_cfg *cfg = NULL;
+    u16_t value = 0;
+
+    if (offset) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    if (len != sizeof(u16_t)) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    for (int i = 0; i < ccc->cfg_len && cfg == NULL; i++) {
+        if (!bt_addr_le_cmp(&ccc->cfg[i].peer, dst)) {
+            cfg = &ccc->cfg[i];
+        }
+    }
+
+    for (int i = 0; i < ccc->cfg_len && cfg == NULL; i++) {
+        if (!bt_addr_le_cmp(&ccc->cfg[i].peer, BT_ADDR_LE_ANY)) {
+            cfg = &ccc->cfg[i];
+            bt_addr_le_copy(&cfg->peer, dst);
+        }
+    }
+
+    if (cfg == NULL) {
+        return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+    }
+
+    cfg->value = sys_get_le16(buf);
+
+    for (int i = 0; i < ccc->cfg_len; i++) {
+        value = max(value, ccc->cfg[i].value);
+    }
+
+    if (value != ccc->value) {
+        ccc->value = value;
+        if (ccc->cfg_changed) {
+            ccc->cfg_changed(attr, value);
+        }
+    }
+
+    return len;
+}
+
+/**
+* @brief Sends a notification to the simulated central
+*
+* Counted by notify.c, the energy accounting charges the sent ones. With
+* SIM_TX_BUFFERS set, the buffers of a connection event can run out.
+*/
+int bt_gatt_notify(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                   const void *data, u16_t len)
+{
+    s64_t event;
+
+    if (SIM_TX_BUFFERS) {
+        event = k_uptime_get() * USEC_PER_MSEC /
+                (conn->interval * BT_STUB_INTERVAL_UNIT);
+        if (event != _tx_event) {
+            _tx_event = event;
+            _tx_used = 0;
+        }
+
+        if (_tx_used == SIM_TX_BUFFERS) {
+            return -ENOMEM;
+        }
+        _tx_used++;
+    }
+
+    sim_notified(attr, data, len);
+
+    return 0;
+}
+
+/**
+* @brief Connects the simulated central to the connectable advertising
+*
+* The central opens the link with the initial connection parameters of
+* the GAP and leaves the rest to conn_param.c.
+*
+* @return The connection, NULL if the node is not connectable
+*/
+struct bt_conn *bt_stub_connect(void)
+{
+    struct bt_conn_cb *cb;
+
+    if (!_adv_connectable || _connected) {
+        return NULL;
+    }
+
+    k_work_init(&_param_work, param_work_handler);
+    _connected = true;
+
+    /* The controller stops connectable advertising on connection */
+    _adv_connectable = false;
+
+    _conn.interval = (BT_GAP_INIT_CONN_INT_MIN + BT_GAP_INIT_CONN_INT_MAX) / 2;
+    _conn.latency = 0;
+    _conn.timeout = BT_STUB_INIT_TIMEOUT;
+
+    bt_conn_ref(&_conn);
+
+    for (cb = _callbacks; cb != NULL; cb = cb->_next) {
+        if (cb->connected) {
+            cb->connected(&_conn, 0);
+        }
+    }
+
+    SYS_LOG_DBG("Central connected");
+
+    return &_conn;
+}
@@ -0,0 +1,159 @@
+/** @file
+ *  @brief I2C fault injection test for the native_posix variant
+ *
+ *  With FAULT_TEST set, the Si7020 is sampled before the application
+ *  starts, with a NACK injected through the I2C emulator into each of the
+ *  transactions of a sample fetch in turn. Every fault must fail the fetch
+ *  with -EIO, keep the readings of the last good sample and leave the
+ *  ambient light sensor rail off; the fetch after it must recover. The
+ *  process exits with the number of failed checks.
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <errno.h>
+#include <zephyr.h>
+#include <init.h>
+#include <device.h>
+#include <sensor.h>
+#include <misc/printk.h>
+#include <posix_board_if.h>
+
+#include "emul.h"
+
+#ifdef FAULT_TEST
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+#define FAULT_SI7020_ADDR       0x40
+
+/* Ambient light sensor rail, see i2c_wrap.c */
+#define FAULT_RAIL_PIN          20
+
+/* Humidity command, humidity read and temperature read */
+#define FAULT_TRANSACTIONS      3
+
+#define FAULT_CHECK(cond)       fault_check((cond), #cond, __LINE__)
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static u32_t _failed;
+
+/* Far from the default environment, a reading that gets through shows */
+static const emul_env_t _changed = {
+    .temperature = 35000,
+    .humidity = 85000,
+    .light = 1000,
+    .pressure = 101325,
+    .vbat = 3000,
+};
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static void fault_check(bool cond, const char *what, int line)
+{
+    if (!cond) {
+        printk("fault: FAIL line %d: %s\n", line, what);
+        _failed++;
+    }
+}
+
+static void fault_read(struct device *dev, struct sensor_value *val)
+{
+    sensor_channel_get(dev, SENSOR_CHAN_AMBIENT_TEMP, &val[0]);
+    sensor_channel_get(dev, SENSOR_CHAN_HUMIDITY, &val[1]);
+}
+
+static bool fault_equal(const struct sensor_value *a,
+                        const struct sensor_value *b)
+{
+    return a[0].val1 == b[0].val1 && a[0].val2 == b[0].val2 &&
+           a[1].val1 == b[1].val1 && a[1].val2 == b[1].val2;
+}
+
+/* NACKs transaction nth of a fetch and checks what the driver made of it */
+static void fault_fetch(struct device *dev, const emul_env_t *env, u32_t nth)
+{
+    struct sensor_value good[2];
+    struct sensor_value val[2];
+    i2c_emul_stats_t before;
+    i2c_emul_stats_t after;
+    int err;
+
+    fault_read(dev, good);
+
+    emul_env_set(&_changed);
+    i2c_emul_stats_get(FAULT_SI7020_ADDR, &before);
+    i2c_emul_nack_inject(FAULT_SI7020_ADDR, nth);
+
+    err = sensor_sample_fetch(dev);
+
+    i2c_emul_stats_get(FAULT_SI7020_ADDR, &after);
+    fault_read(dev, val);
+
+    printk("fault: si7020 transaction %u err %d\n", nth, err);
+
+    FAULT_CHECK(err == -EIO);
+    FAULT_CHECK(after.nacks == before.nacks + 1);
+    FAULT_CHECK(fault_equal(good, val));
+    FAULT_CHECK(!gpio_emul_pin_get(FAULT_RAIL_PIN));
+
+    // The next fetch gets through and reads the changed environment
+    err = sensor_sample_fetch(dev);
+    fault_read(dev, val);
+
+    FAULT_CHECK(err == 0);
+    FAULT_CHECK(!fault_equal(good, val));
+    FAULT_CHECK(!gpio_emul_pin_get(FAULT_RAIL_PIN));
+
+    // Back to where the next fault starts from
+    emul_env_set(env);
+    FAULT_CHECK(sensor_sample_fetch(dev) == 0);
+}
+
+/*
+ * Runs at the end of the init levels, before main() starts the sampling,
+ * so nothing else is on the bus.
+ */
+static int fault_init(struct device *unused)
+{
+    struct device *dev = device_get_binding(CONFIG_SI7020_NAME);
+    emul_env_t env;
+
+    if (dev == NULL) {
+        printk("fault: FAIL no %s\n", CONFIG_SI7020_NAME);
+        posix_exit(1);
+    }
+
+    // Probes the chip, its transactions are not part of a fetch
+    FAULT_CHECK(sensor_sample_fetch(dev) == 0);
+
+    emul_env_get(&env);
+
+    for (u32_t nth = 0; nth < FAULT_TRANSACTIONS; nth++) {
+        fault_fetch(dev, &env, nth);
+    }
+
+    printk("fault: %s, %u failed\n", _failed ? "FAIL" : "PASS", _failed);
+
+    posix_exit(_failed);
+
+    return 0;
+}
+
+SYS_INIT(fault_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif /* FAULT_TEST */
@@ -0,0 +1,103 @@
+/** @file
+ *  @brief Non-volatile storage stand-in for the native_posix variant
+ *
+ *  native_posix in this kernel has no flash. Records live in RAM for
+ *  the run, so every boot starts from the defaults like a fresh board.
+ *  The CCC values of the services are not stored; a central subscribes
+ *  again after every boot, as an unbonded one does.
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <zephyr.h>
+
+#include "../src/nv.h"
+#include "../src/ccc_store.h"
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static nv_device_data_t _device_data;
+static bool _device_data_valid;
+
+static nv_sensor_data_t _sensor_data[NV_SENSOR_BARO_PRESSURE + 1];
+static bool _sensor_data_valid[NV_SENSOR_BARO_PRESSURE + 1];
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+int nv_init(void)
+{
+    return 0;
+}
+
+int nv_get_device_data(nv_device_data_t *data)
+{
+    if (!_device_data_valid) {
+        return -ENOENT;
+    }
+
+    memcpy(data, &_device_data, sizeof(*data));
+
+    return 0;
+}
+
+int nv_set_device_data(const nv_device_data_t *data)
+{
+    memcpy(&_device_data, data, sizeof(*data));
+    _device_data_valid = true;
+
+    return 0;
+}
+
+int nv_get_sensor_data(nv_types_t sensor, nv_sensor_data_t *data)
+{
+    if (sensor < NV_SENSOR_TEMPERATURE || sensor > NV_SENSOR_BARO_PRESSURE) {
+        return -EINVAL;
+    }
+
+    if (!_sensor_data_valid[sensor]) {
+        return -ENOENT;
+    }
+
+    memcpy(data, &_sensor_data[sensor], sizeof(*data));
+
+    return 0;
+}
+
+int nv_set_sensor_data(nv_types_t sensor, const nv_sensor_data_t *data)
+{
+    if (sensor < NV_SENSOR_TEMPERATURE || sensor > NV_SENSOR_BARO_PRESSURE) {
+        return -EINVAL;
+    }
+
+    memcpy(&_sensor_data[sensor], data, sizeof(*data));
+    _sensor_data_valid[sensor] = true;
+
+    return 0;
+}
+
+void ccc_store_init(void)
+{
+}
+
+int ccc_store_register(const char *name, struct bt_gatt_ccc_cfg *cfg,
+                       size_t count)
+{
+    return 0;
+}
+
+void ccc_store_changed(void)
+{
+}
@@ -0,0 +1,174 @@
+/** @file
+ *  @brief Capture replay for the native_posix variant
+ *
+ *  Feeds a sensor capture (src/capture.h), embedded at build time from
+ *  REPLAY_CAPTURE, to the application in place of the emulated sensors.
+ *  Once the simulated central has connected, the samples are published
+ *  on the system workqueue at their captured times and reach the central
+ *  through the trigger conditions, notify.c and the energy accounting of
+ *  the device. At the end of the capture the simulator report is printed
+ *  and the process ends. scripts/capture_replay.py builds and runs a
+ *  replay for each policy it compares.
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <zephyr.h>
+#include <init.h>
+#include <device.h>
+#include <sensor.h>
+#include <misc/byteorder.h>
+#include <misc/printk.h>
+#include <posix_board_if.h>
+
+#include "../src/capture.h"
+#include "sim.h"
+
+#ifdef REPLAY
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Record on the wire, see capture.c */
+#define REPLAY_RECORD_LEN       16
+
+/* Sample a channel at most every REPLAY_INTERVAL_S seconds; 0 takes all */
+#ifndef REPLAY_INTERVAL_S
+#define REPLAY_INTERVAL_S       0
+#endif
+
+#define REPLAY_CONNECT_POLL     K_SECONDS(1)
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static const u8_t _capture[] = {
+#include "capture.inc"
+};
+
+static struct k_delayed_work _replay_work;
+
+/* Offset of the next record */
+static size_t _pos;
+
+static bool _is_started;
+static s64_t _start;
+
+/* Capture uptime of the last record, and the time since the first one */
+static u32_t _last_ms;
+static s64_t _elapsed_ms;
+
+/* Capture time each channel was last sampled at */
+static s64_t _sampled_ms[READINGS_CH_COUNT];
+static u32_t _samples[READINGS_CH_COUNT];
+static u32_t _dropped;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static void replay_record(const u8_t *record)
+{
+    u8_t channel = record[4];
+    struct sensor_value value = {
+        .val1 = sys_get_le32(&record[8]),
+        .val2 = sys_get_le32(&record[12]),
+    };
+
+    if (channel == CAPTURE_CH_DROPPED) {
+        _dropped += value.val1;
+        return;
+    }
+
+    if (channel >= READINGS_CH_COUNT) {
+        return;
+    }
+
+    if (_samples[channel] &&
+        _elapsed_ms - _sampled_ms[channel] <
+        (s64_t)REPLAY_INTERVAL_S * MSEC_PER_SEC) {
+        return;
+    }
+
+    _sampled_ms[channel] = _elapsed_ms;
+    _samples[channel]++;
+
+    ble_stub_sample(channel, sensor_value_to_double(&value));
+}
+
+static void replay_report(void)
+{
+    for (int i = 0; i < READINGS_CH_COUNT; i++) {
+        printk("replay: sampled %d %u\n", i, _samples[i]);
+    }
+
+    printk("replay: dropped %u\n", _dropped);
+}
+
+/*
+ * Publishes the records that are due and waits for the next one. The
+ * 32-bit capture uptime is extended across its wrap.
+ */
+static void replay_work_handler(struct k_work *work)
+{
+    const u8_t *record;
+    s64_t due_ms;
+    s64_t now;
+
+    if (!_is_started) {
+        if (!sim_connected()) {
+            k_delayed_work_submit(&_replay_work, REPLAY_CONNECT_POLL);
+            return;
+        }
+
+        _is_started = true;
+        _start = k_uptime_get();
+        _last_ms = sys_get_le32(&_capture[0]);
+
+        /* Maps the uptime of the sent notifications to capture time */
+        printk("replay: start %u %u\n", (u32_t)_start, _last_ms);
+    }
+
+    while (_pos + REPLAY_RECORD_LEN <= sizeof(_capture)) {
+        record = &_capture[_pos];
+        due_ms = _elapsed_ms + (u32_t)(sys_get_le32(&record[0]) - _last_ms);
+
+        now = k_uptime_get();
+        if (_start + due_ms > now) {
+            k_delayed_work_submit(&_replay_work, _start + due_ms - now);
+            return;
+        }
+
+        _last_ms = sys_get_le32(&record[0]);
+        _elapsed_ms = due_ms;
+        _pos += REPLAY_RECORD_LEN;
+
+        replay_record(record);
+    }
+
+    replay_report();
+    sim_report();
+
+    posix_exit(0);
+}
+
+static int replay_init(struct device *unused)
+{
+    k_delayed_work_init(&_replay_work, replay_work_handler);
+    k_delayed_work_submit(&_replay_work, REPLAY_CONNECT_POLL);
+
+    return 0;
+}
+
+SYS_INIT(replay_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif /* REPLAY */
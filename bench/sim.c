@@ -0,0 +1,371 @@
+/** @file
+ *  @brief Battery life simulator for the native_posix variant
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <zephyr.h>
+#include <misc/byteorder.h>
+#include <misc/printk.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "emul.h"
+#include "../src/energy.h"
+#include "../src/ess.h"
+#include "../src/adv.h"
+#include "../src/notify.h"
+#include "sim.h"
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/*
+ * The knobs below can be set from the build, e.g.
+ * cmake -DSIM_CENTRAL=1 -DSIM_TRIGGER_CONDITION=6 ...
+ */
+
+/* A central connects and subscribes to every reading; 0 never connects */
+#ifndef SIM_CENTRAL
+#define SIM_CENTRAL             0
+#endif
+
+/*
+ * ESS Trigger Setting the central writes to every ESS characteristic;
+ * the reference value in the units of the characteristic, or seconds
+ */
+#ifndef SIM_TRIGGER_CONDITION
+#define SIM_TRIGGER_CONDITION   ESS_VALUE_CHANGED
+#endif
+
+#ifndef SIM_TRIGGER_REF
+#define SIM_TRIGGER_REF         0
+#endif
+
+/* Longest ES Trigger Setting, a condition and a 32-bit reference value */
+#define SIM_TRIGGER_LEN         5
+
+/* Nominal CR2032 capacity */
+#ifndef SIM_BATTERY_MAH
+#define SIM_BATTERY_MAH         225
+#endif
+
+/* Environment step */
+#define SIM_STEP                K_SECONDS(60)
+
+#define SIM_DAY_S               (24 * 60 * 60)
+#define SIM_WEATHER_S           (5 * SIM_DAY_S)
+
+/* Cell voltage from full to empty, linear in the charge used */
+#define SIM_VBAT_FULL_MV        3000
+#define SIM_VBAT_EMPTY_MV       2400
+
+#define SIM_STACK_SIZE          512
+#define SIM_PRIORITY            K_LOWEST_APPLICATION_THREAD_PRIO
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+/* A reading as the central receives it */
+struct sim_channel {
+    const char *name;
+    const struct bt_uuid *uuid;
+    u32_t sent;
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static struct sim_channel _channels[READINGS_CH_COUNT] = {
+    [READINGS_CH_TEMPERATURE]   = { "temperature", BT_UUID_TEMPERATURE },
+    [READINGS_CH_HUMIDITY]      = { "humidity", BT_UUID_HUMIDITY },
+    [READINGS_CH_AMBIENT_LIGHT] = { "ambient light", BT_UUID_IRRADIANCE },
+    [READINGS_CH_BARO_PRESSURE] = { "pressure", BT_UUID_PRESSURE },
+    [READINGS_CH_BATTERY]       = { "battery", BT_UUID_BAS_BATTERY_LEVEL },
+};
+
+static const char *const _consumers[ENERGY_COUNT] = {
+    [ENERGY_CPU]         = "cpu",
+    [ENERGY_IDLE]        = "idle",
+    [ENERGY_ADV]         = "adv",
+    [ENERGY_CONN]        = "conn",
+    [ENERGY_TX]          = "tx",
+    [ENERGY_RAIL]        = "rail",
+    [ENERGY_SI7020]      = "si7020",
+    [ENERGY_TSL4531]     = "tsl4531",
+    [ENERGY_BMP280]      = "bmp280",
+    [ENERGY_ADC]         = "adc",
+    [ENERGY_FLASH_WRITE] = "flash write",
+    [ENERGY_FLASH_ERASE] = "flash erase",
+};
+
+static struct bt_conn *_conn;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+/* 0 at the start of a period, @p amplitude halfway through */
+static s32_t triangle(u32_t t, u32_t period, s32_t amplitude)
+{
+    u32_t phase = t % period;
+
+    if (phase > period / 2) {
+        phase = period - phase;
+    }
+
+    return (s64_t)amplitude * phase / (period / 2);
+}
+
+/*
+ * Days of sampling from midnight: warmest and driest at noon, light from
+ * 06:00 to 18:00, and the pressure drifting over a few days. The cell
+ * voltage follows the charge the model has used so far.
+ */
+static void env_update(void)
+{
+    u32_t t = k_uptime_get() / MSEC_PER_SEC;
+    u32_t day = t % SIM_DAY_S;
+    energy_report_t report;
+    u64_t used_nah;
+    emul_env_t env;
+
+    emul_env_get(&env);
+
+    env.temperature = 18000 + triangle(t, SIM_DAY_S, 7000);
+    env.humidity = 60000 - triangle(t, SIM_DAY_S, 20000);
+    env.pressure = 100325 + triangle(t, SIM_WEATHER_S, 2000);
+
+    if (day > SIM_DAY_S / 4 && day < SIM_DAY_S * 3 / 4) {
+        env.light = triangle(day - SIM_DAY_S / 4, SIM_DAY_S / 2, 800);
+    } else {
+        env.light = 0;
+    }
+
+    energy_report_get(&report);
+    used_nah = (u64_t)report.total_na * t / (60 * 60);
+    if (used_nah < (u64_t)SIM_BATTERY_MAH * 1000000) {
+        env.vbat = SIM_VBAT_FULL_MV -
+                   (SIM_VBAT_FULL_MV - SIM_VBAT_EMPTY_MV) * used_nah /
+                   ((u64_t)SIM_BATTERY_MAH * 1000000);
+    } else {
+        env.vbat = SIM_VBAT_EMPTY_MV;
+    }
+
+    emul_env_set(&env);
+}
+
+/* ES Trigger Setting of a characteristic, in its format */
+static u16_t trigger_encode(const struct bt_uuid *chrc, u8_t *buf)
+{
+    u32_t ref = SIM_TRIGGER_REF;
+
+    buf[0] = SIM_TRIGGER_CONDITION;
+
+    switch (SIM_TRIGGER_CONDITION) {
+    case ESS_TRIGGER_INACTIVE:
+        /* fallthrough */
+    case ESS_VALUE_CHANGED:
+        return 1;
+    case ESS_FIXED_TIME_INTERVAL:
+        /* fallthrough */
+    case ESS_NO_LESS_THAN_SPECIFIED_TIME:
+        buf[1] = ref & 0xff;
+        buf[2] = (ref >> 8) & 0xff;
+        buf[3] = (ref >> 16) & 0xff;
+        return 4;
+    default:
+        if (!bt_uuid_cmp(chrc, BT_UUID_PRESSURE)) {
+            sys_put_le32(ref, &buf[1]);
+            return 5;
+        }
+        sys_put_le16(ref, &buf[1]);
+        return 3;
+    }
+}
+
+/*
+ * Subscribes to every characteristic and writes the trigger setting of
+ * every ESS one, as a gateway does after connecting. The characteristic
+ * declarations come before their descriptors.
+ */
+static u8_t central_configure(const struct bt_gatt_attr *attr,
+                              void *user_data)
+{
+    const struct bt_uuid **chrc = user_data;
+    u16_t ccc = sys_cpu_to_le16(BT_GATT_CCC_NOTIFY);
+    u8_t trigger[SIM_TRIGGER_LEN];
+    ssize_t err = 0;
+
+    if (!bt_uuid_cmp(attr->uuid, BT_UUID_GATT_CHRC)) {
+        *chrc = ((const struct bt_gatt_chrc *)attr->user_data)->uuid;
+    } else if (!bt_uuid_cmp(attr->uuid, BT_UUID_GATT_CCC)) {
+        err = attr->write(_conn, attr, &ccc, sizeof(ccc), 0, 0);
+    } else if (!bt_uuid_cmp(attr->uuid, BT_UUID_ES_TRIGGER_SETTING)) {
+        err = attr->write(_conn, attr, trigger,
+                          trigger_encode(*chrc, trigger), 0, 0);
+    }
+
+    if (err < 0) {
+        printk("sim: write to handle %u failed (err %d)\n", attr->handle,
+               (int)err);
+    }
+
+    return BT_GATT_ITER_CONTINUE;
+}
+
+#ifdef REPLAY
+/* Value of a notification in the units of its characteristic */
+static s32_t sim_value(readings_ch_t channel, const void *data)
+{
+    switch (channel) {
+    case READINGS_CH_TEMPERATURE:
+        return (s16_t)sys_get_le16(data);
+    case READINGS_CH_BARO_PRESSURE:
+        return sys_get_le32(data);
+    case READINGS_CH_BATTERY:
+        return *(const u8_t *)data;
+    default:
+        return sys_get_le16(data);
+    }
+}
+#endif
+
+/*
+ * The radio events are counted by adv.c and energy.c as on the device;
+ * the central only has to find the node advertising. The readings reach
+ * it through ess.c, bas.c and notify.c.
+ */
+static void sim_thread(void *p1, void *p2, void *p3)
+{
+    const struct bt_uuid *chrc = NULL;
+
+    while (true) {
+        env_update();
+
+        k_sleep(SIM_STEP);
+
+        if (SIM_CENTRAL && _conn == NULL) {
+            _conn = bt_stub_connect();
+            if (_conn != NULL) {
+                bt_gatt_foreach_attr(0x0001, 0xffff, central_configure,
+                                     &chrc);
+            }
+        }
+    }
+}
+
+K_THREAD_DEFINE(sim_tid, SIM_STACK_SIZE, sim_thread, NULL, NULL, NULL,
+                SIM_PRIORITY, 0, K_NO_WAIT);
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+bool sim_connected(void)
+{
+    return _conn != NULL;
+}
+
+/**
+* @brief Counts a notification the host sent to the central
+*
+* A replay lists every one with the uptime it was sent at, the channel
+* and the value, for the reconstruction error.
+*/
+void sim_notified(const struct bt_gatt_attr *attr, const void *data,
+                  u16_t len)
+{
+    for (int i = 0; i < READINGS_CH_COUNT; i++) {
+        if (bt_uuid_cmp(attr->uuid, _channels[i].uuid)) {
+            continue;
+        }
+
+        _channels[i].sent++;
+#ifdef REPLAY
+        printk("sim: sent %u %d %d\n", k_uptime_get_32(), i,
+               sim_value(i, data));
+#endif
+        return;
+    }
+}
+
+/**
+* @brief Prints the energy report and the battery life it projects
+*
+* The idle floor is the model's idle current over the whole window; CPU
+* time outside radio events is not modelled.
+*/
+void sim_report(void)
+{
+    energy_report_t report;
+    notify_stats_t notify_stats;
+    adv_stats_t adv_stats;
+    u32_t days;
+
+    energy_report_get(&report);
+    adv_stats_get(&adv_stats);
+    notify_stats_get(&notify_stats);
+    days = report.window_s / SIM_DAY_S;
+
+    printk("sim: window %u days, central %s, trigger 0x%02x\n",
+           days, _conn ? "connected" : "none", SIM_TRIGGER_CONDITION);
+
+    printk("sim: adv events %u, fast %u s, medium %u s, slow %u s, "
+           "ultra slow %u s, off %u s\n", adv_stats.events,
+           (u32_t)(adv_stats.time_ms[ADV_STATE_FAST] / MSEC_PER_SEC),
+           (u32_t)(adv_stats.time_ms[ADV_STATE_MEDIUM] / MSEC_PER_SEC),
+           (u32_t)(adv_stats.time_ms[ADV_STATE_SLOW] / MSEC_PER_SEC),
+           (u32_t)(adv_stats.time_ms[ADV_STATE_ULTRA_SLOW] / MSEC_PER_SEC),
+           (u32_t)(adv_stats.time_ms[ADV_STATE_OFF] / MSEC_PER_SEC));
+
+    for (int i = 0; i < ENERGY_COUNT; i++) {
+        if (report.avg_na[i] == 0) {
+            continue;
+        }
+
+        /* 24 nAh per day for each nA */
+        printk("sim: %s %u nA, %u uAh per day\n", _consumers[i],
+               report.avg_na[i], report.avg_na[i] * 24 / 1000);
+    }
+
+    for (int i = 0; i < READINGS_CH_COUNT; i++) {
+        if (_channels[i].sent) {
+            printk("sim: %s notifications %u\n", _channels[i].name,
+                   _channels[i].sent);
+        }
+    }
+
+    if (_conn != NULL) {
+        printk("sim: notify sent %u, coalesced %u, dropped %u\n",
+               notify_stats.sent, notify_stats.coalesced,
+               notify_stats.dropped);
+    }
+
+    if (report.total_na == 0) {
+        return;
+    }
+
+    /* mAh / nA = 1e6 h */
+    days = (u64_t)SIM_BATTERY_MAH * 1000000 / report.total_na / 24;
+
+    printk("sim: total %u nA, CR2032 %u mAh lasts %u days, %u.%u years\n",
+           report.total_na, SIM_BATTERY_MAH, days, days / 365,
+           days * 10 / 365 % 10);
+}
@@ -0,0 +1,43 @@
+/** @file
+ *  @brief Battery life simulator for the native_posix variant
+ *
+ *  Plays the environment and, if configured, a central on the emulated
+ *  board. The environment follows a day and night cycle so that trigger
+ *  conditions see changing values; the central connects to the node
+ *  through bt_stub.c and is notified of the readings. Advertising,
+ *  connection and notification events are counted by the application's
+ *  own modules. At the end of a run the energy report is turned into a
+ *  projected CR2032 lifetime.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+#include "../src/readings.h"
+
+struct bt_conn;
+struct bt_gatt_attr;
+
+bool sim_connected(void);
+void sim_notified(const struct bt_gatt_attr *attr, const void *data,
+                  u16_t len);
+void sim_report(void);
+
+/* bt_stub.c */
+struct bt_conn *bt_stub_connect(void);
+
+/* ble_stub.c */
+void ble_stub_sample(readings_ch_t channel, double value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_H */
@@ -31,6 +31,11 @@ case $key in
     BOARD_VARIANT=climate
     shift
     ;;
+    native | NATIVE )
+    BUILD_FW=1
+    BOARD_VARIANT=native
+    shift
+    ;;
     flash | FLASH )
     FLASH=1
     shift
@@ -55,6 +60,7 @@ function usage {
     echo "   boot  - build bootloader"
     echo "   evt1  - build for evt1 board (cleans build dir first)"
     echo "   evt2  - build for evt2 board (cleans build dir first)"
+    echo "   native - build for native_posix with emulated peripherals, then \"ninja -C build bench\""
     echo "   flash - flash the board, the file to flash depends on \"boot\" and \"evtx\" build options"
     echo "   help  - shows this help text"
     echo ""
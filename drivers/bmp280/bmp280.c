@@ -165,6 +165,12 @@ static int bmp280_sample_fetch(struct device *dev, enum sensor_channel chan)
 
 	__ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL);
 
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+	if (data->pm_state != DEVICE_PM_ACTIVE_STATE) {
+		return -EBUSY;
+	}
+#endif
+
 	// if (data->chip_id == BMP280_CHIP_ID) {
 	// 	size = 8;
 	// }
@@ -228,7 +234,56 @@ static int bmp280_channel_get(struct device *dev,
 	return 0;
 }
 
+/*
+ * SENSOR_ATTR_SAMPLING_FREQUENCY shortens the normal mode standby time so
+ * that a fetch returns a conversion no older than the requested period.
+ * Zero restores the configured standby time.
+ */
+static int bmp280_attr_set(struct device *dev, enum sensor_channel chan,
+			   enum sensor_attribute attr,
+			   const struct sensor_value *val)
+{
+	struct bmp280_data *data = dev->driver_data;
+	u8_t config = BMP280_CONFIG_VAL;
+	int err;
+
+	if (attr != SENSOR_ATTR_SAMPLING_FREQUENCY) {
+		return -ENOTSUP;
+	}
+
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+	/* Leaving sleep mode is up to the power management */
+	if (data->pm_state != DEVICE_PM_ACTIVE_STATE) {
+		return -EBUSY;
+	}
+#endif
+
+	if (val->val1 > 10) {
+		/* 0.5 ms */
+		config &= ~BMP280_STANDBY_MASK;
+	} else if (val->val1 > 0) {
+		/* 62.5 ms */
+		config = (config & ~BMP280_STANDBY_MASK) | (1 << 5);
+	}
+
+	/* Writes to the config register may be ignored in normal mode */
+	err = bm280_reg_write(data, BMP280_REG_CTRL_MEAS,
+			      BMP280_CTRL_MEAS_VAL & ~BMP280_MODE_MASK);
+	if (err < 0) {
+		return err;
+	}
+
+	err = bm280_reg_write(data, BMP280_REG_CONFIG, config);
+	if (err < 0) {
+		return err;
+	}
+
+	return bm280_reg_write(data, BMP280_REG_CTRL_MEAS,
+			       BMP280_CTRL_MEAS_VAL);
+}
+
 static const struct sensor_driver_api bmp280_api_funcs = {
+	.attr_set = bmp280_attr_set,
 	.sample_fetch = bmp280_sample_fetch,
 	.channel_get = bmp280_channel_get,
 };
@@ -328,6 +383,57 @@ static int bmp280_chip_init(struct device *dev)
 	return 0;
 }
 
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+/*
+ * Suspend puts the chip in sleep mode, 0.1 uA, where the config register
+ * and the last conversion are kept. Resume returns to normal mode and
+ * waits for the first new conversion, so the next fetch is fresh.
+ */
+static int bmp280_device_ctrl(struct device *dev, u32_t ctrl_command,
+			      void *context)
+{
+	struct bmp280_data *data = dev->driver_data;
+	u32_t state;
+	int err;
+
+	if (ctrl_command == DEVICE_PM_GET_POWER_STATE) {
+		*((u32_t *)context) = data->pm_state;
+		return 0;
+	}
+
+	if (ctrl_command != DEVICE_PM_SET_POWER_STATE) {
+		return -EINVAL;
+	}
+
+	state = *((u32_t *)context);
+	if (state == data->pm_state) {
+		return 0;
+	}
+
+	if (state == DEVICE_PM_ACTIVE_STATE) {
+		err = bm280_reg_write(data, BMP280_REG_CTRL_MEAS,
+				      BMP280_CTRL_MEAS_VAL);
+		if (err < 0) {
+			return err;
+		}
+
+		k_sleep(BMP280_MEAS_TIME_MS);
+	} else if (data->pm_state == DEVICE_PM_ACTIVE_STATE) {
+		err = bm280_reg_write(data, BMP280_REG_CTRL_MEAS,
+				      BMP280_CTRL_MEAS_VAL & ~BMP280_MODE_MASK);
+		if (err < 0) {
+			return err;
+		}
+	}
+
+	data->pm_state = state;
+
+	return 0;
+}
+#else
+#define bmp280_device_ctrl device_pm_control_nop
+#endif
+
 #ifdef CONFIG_BMP280_DEV_TYPE_SPI
 static inline int bmp280_spi_init(struct bmp280_data *data)
 {
@@ -374,11 +480,15 @@ int bmp280_init(struct device *dev)
 		return -EINVAL;
 	}
 
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+	data->pm_state = DEVICE_PM_ACTIVE_STATE;
+#endif
+
 	return 0;
 }
 
 static struct bmp280_data bmp280_data;
 
-DEVICE_AND_API_INIT(bmp280, CONFIG_BMP280_DEV_NAME, bmp280_init, &bmp280_data,
-		    NULL, POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY,
-		    &bmp280_api_funcs);
+DEVICE_DEFINE(bmp280, CONFIG_BMP280_DEV_NAME, bmp280_init, bmp280_device_ctrl,
+	      &bmp280_data, NULL, POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY,
+	      &bmp280_api_funcs);
@@ -24,32 +24,49 @@
 
 #define BMP280_CHIP_ID               	0x58
 #define BMP280_MODE_NORMAL              0x03
+#define BMP280_MODE_MASK                0x03
+#define BMP280_STANDBY_MASK             (7 << 5)
 #define BMP280_SPI_3W_DISABLE           0x00
 
 #if defined CONFIG_BMP280_TEMP_OVER_1X
 #define BMP280_TEMP_OVER                (1 << 5)
+#define BMP280_TEMP_SAMPLES             1
 #elif defined CONFIG_BMP280_TEMP_OVER_2X
 #define BMP280_TEMP_OVER                (2 << 5)
+#define BMP280_TEMP_SAMPLES             2
 #elif defined CONFIG_BMP280_TEMP_OVER_4X
 #define BMP280_TEMP_OVER                (3 << 5)
+#define BMP280_TEMP_SAMPLES             4
 #elif defined CONFIG_BMP280_TEMP_OVER_8X
 #define BMP280_TEMP_OVER                (4 << 5)
+#define BMP280_TEMP_SAMPLES             8
 #elif defined CONFIG_BMP280_TEMP_OVER_16X
 #define BMP280_TEMP_OVER                (5 << 5)
+#define BMP280_TEMP_SAMPLES             16
 #endif
 
 #if defined CONFIG_BMP280_PRESS_OVER_1X
 #define BMP280_PRESS_OVER               (1 << 2)
+#define BMP280_PRESS_SAMPLES            1
 #elif defined CONFIG_BMP280_PRESS_OVER_2X
 #define BMP280_PRESS_OVER               (2 << 2)
+#define BMP280_PRESS_SAMPLES            2
 #elif defined CONFIG_BMP280_PRESS_OVER_4X
 #define BMP280_PRESS_OVER               (3 << 2)
+#define BMP280_PRESS_SAMPLES            4
 #elif defined CONFIG_BMP280_PRESS_OVER_8X
 #define BMP280_PRESS_OVER               (4 << 2)
+#define BMP280_PRESS_SAMPLES            8
 #elif defined CONFIG_BMP280_PRESS_OVER_16X
 #define BMP280_PRESS_OVER               (5 << 2)
+#define BMP280_PRESS_SAMPLES            16
 #endif
 
+/* Maximum measurement time, datasheet section 3.8.1, rounded up to ms */
+#define BMP280_MEAS_TIME_MS             ((1250 + 2300 * BMP280_TEMP_SAMPLES + \
+                     2300 * BMP280_PRESS_SAMPLES + 575 + \
+                     999) / 1000)
+
 #if defined CONFIG_BMP280_STANDBY_05MS
 #define BMP280_STANDBY                  0
 #elif defined CONFIG_BMP280_STANDBY_62MS
@@ -121,6 +138,10 @@ struct bmp280_data {
     s32_t t_fine;
 
     u8_t chip_id;
+
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    u32_t pm_state;
+#endif
 };
 
 #define SYS_LOG_DOMAIN "BMP280"
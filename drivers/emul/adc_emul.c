@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2018 Thomas Berg
+ *
+ */
+
+#include <kernel.h>
+#include <misc/util.h>
+
+#include "emul_priv.h"
+
+
+/* Band gap reference, mV, and the 1/3 supply prescaling fg.c selects */
+#define ADC_EMUL_VBG            1200
+#define ADC_EMUL_PRESCALER      3
+#define ADC_EMUL_RESOLUTION     1024
+
+/* 10-bit conversion time, nRF51 reference manual */
+#define ADC_EMUL_CONV_TIME_US   68
+
+
+/*
+ * One 10-bit conversion of VDD with 1/3 prescaling against the band gap.
+ * Like the real one the caller busy-waits for the END event.
+ */
+u16_t adc_emul_convert(void)
+{
+    u32_t result = (u32_t)emul_env()->vbat * ADC_EMUL_RESOLUTION /
+               (ADC_EMUL_PRESCALER * ADC_EMUL_VBG);
+
+    k_busy_wait(ADC_EMUL_CONV_TIME_US);
+
+    return min(result, ADC_EMUL_RESOLUTION - 1);
+}
@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2018 Thomas Berg
+ *
+ */
+
+#include <kernel.h>
+#include <init.h>
+#include <errno.h>
+#include <string.h>
+#include <misc/util.h>
+#include <misc/byteorder.h>
+
+#include "emul_priv.h"
+
+#define CONFIG_SYS_LOG_BMP280_EMUL_LEVEL 1
+#define SYS_LOG_DOMAIN "bmp280_emul"
+#define SYS_LOG_LEVEL CONFIG_SYS_LOG_BMP280_EMUL_LEVEL
+#include <logging/sys_log.h>
+
+
+#ifdef CONFIG_BMP280_I2C_ADDR
+#define BMP280_EMUL_ADDR        CONFIG_BMP280_I2C_ADDR
+#else
+#define BMP280_EMUL_ADDR        0x76
+#endif
+
+/* Registers */
+#define REG_CALIB               0x88
+#define REG_CALIB_LEN           24
+#define REG_ID                  0xD0
+#define REG_RESET               0xE0
+#define REG_STATUS              0xF3
+#define REG_CTRL_MEAS           0xF4
+#define REG_CONFIG              0xF5
+#define REG_PRESS_MSB           0xF7
+#define REG_TEMP_MSB            0xFA
+
+#define BMP280_CHIP_ID          0x58
+#define BMP280_RESET_WORD       0xB6
+
+#define STATUS_MEASURING        0x08
+
+#define MODE_MASK               0x03
+#define MODE_SLEEP              0x00
+#define MODE_NORMAL             0x03
+
+#define OSRS_T(ctrl)            (((ctrl) >> 5) & 0x07)
+#define OSRS_P(ctrl)            (((ctrl) >> 2) & 0x07)
+#define T_SB(config)            (((config) >> 5) & 0x07)
+
+/* Data register value of a skipped or not yet run conversion */
+#define ADC_RESET               0x80000
+#define ADC_MAX                 0xFFFFF
+
+
+struct bmp280_emul {
+    struct i2c_emul i2c;
+    u8_t regs[256];
+    u8_t ptr;
+    u64_t mode_since;   /* Normal mode start or forced conversion start */
+    u64_t latched;      /* End of the conversion in the data registers */
+};
+
+/* Calibration of the datasheet example, section 3.12 */
+static const u16_t dig_t1 = 27504;
+static const s16_t dig_t2 = 26435;
+static const s16_t dig_t3 = -1000;
+static const u16_t dig_p1 = 36477;
+static const s16_t dig_p[8] = { -10685, 3024, 2855, 140, -7, 15500,
+                                -14600, 6000 };
+
+/* Standby time by t_sb, us */
+static const u32_t standby_us[] = { 500, 62500, 125000, 250000, 500000,
+                                    1000000, 2000000, 4000000 };
+
+
+static u8_t osrs_samples(u8_t osrs)
+{
+    return osrs ? 1 << (min(osrs, 5) - 1) : 0;
+}
+
+/* Maximum measurement time, datasheet section 3.8.1 */
+static u32_t meas_time_us(u8_t ctrl)
+{
+    u32_t t = 1250 + 2300 * osrs_samples(OSRS_T(ctrl));
+
+    if (OSRS_P(ctrl)) {
+        t += 2300 * osrs_samples(OSRS_P(ctrl)) + 575;
+    }
+
+    return t;
+}
+
+/* Compensation from the datasheet, 0.01 degC */
+static s32_t comp_temp(s32_t adc_t, s32_t *t_fine)
+{
+    s32_t var1, var2;
+
+    var1 = (((adc_t >> 3) - ((s32_t)dig_t1 << 1)) * dig_t2) >> 11;
+    var2 = (((((adc_t >> 4) - dig_t1) * ((adc_t >> 4) - dig_t1)) >> 12) *
+        dig_t3) >> 14;
+
+    *t_fine = var1 + var2;
+
+    return (*t_fine * 5 + 128) >> 8;
+}
+
+/* Compensation from the datasheet, Pa in Q24.8 */
+static u32_t comp_press(s32_t adc_p, s32_t t_fine)
+{
+    s64_t var1, var2, p;
+
+    var1 = (s64_t)t_fine - 128000;
+    var2 = var1 * var1 * dig_p[4];
+    var2 = var2 + ((var1 * dig_p[3]) << 17);
+    var2 = var2 + ((s64_t)dig_p[2] << 35);
+    var1 = ((var1 * var1 * dig_p[1]) >> 8) + ((var1 * dig_p[0]) << 12);
+    var1 = ((((s64_t)1) << 47) + var1) * dig_p1 >> 33;
+
+    if (var1 == 0) {
+        return 0;
+    }
+
+    p = 1048576 - adc_p;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = ((s64_t)dig_p[7] * (p >> 13) * (p >> 13)) >> 25;
+    var2 = ((s64_t)dig_p[6] * p) >> 19;
+
+    return ((p + var1 + var2) >> 8) + ((s64_t)dig_p[5] << 4);
+}
+
+/*
+ * The raw values are found by bisection on the compensation formulas;
+ * temperature rises and pressure falls with the raw value.
+ */
+static void raw_from_env(s32_t *adc_t, s32_t *adc_p)
+{
+    const emul_env_t *env = emul_env();
+    s32_t target_t = env->temperature / 10;
+    u32_t target_p = env->pressure << 8;
+    s32_t lo, hi, mid;
+    s32_t t_fine;
+
+    for (lo = 0, hi = ADC_MAX; lo < hi; ) {
+        mid = (lo + hi) / 2;
+        if (comp_temp(mid, &t_fine) < target_t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *adc_t = lo;
+    comp_temp(*adc_t, &t_fine);
+
+    for (lo = 0, hi = ADC_MAX; lo < hi; ) {
+        mid = (lo + hi) / 2;
+        if (comp_press(mid, t_fine) > target_p) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *adc_p = lo;
+}
+
+/* 16 bits at x1 oversampling, one more per step up to 20 */
+static void adc_store(u8_t *reg, s32_t adc, u8_t osrs)
+{
+    if (osrs == 0) {
+        adc = ADC_RESET;
+    } else {
+        adc &= ~((1 << (5 - min(osrs, 5))) - 1);
+    }
+
+    reg[0] = adc >> 12;
+    reg[1] = adc >> 4;
+    reg[2] = (adc & 0x0F) << 4;
+}
+
+static void result_latch(struct bmp280_emul *emul)
+{
+    u8_t ctrl = emul->regs[REG_CTRL_MEAS];
+    s32_t adc_t, adc_p;
+
+    raw_from_env(&adc_t, &adc_p);
+    adc_store(&emul->regs[REG_PRESS_MSB], adc_p, OSRS_P(ctrl));
+    adc_store(&emul->regs[REG_TEMP_MSB], adc_t, OSRS_T(ctrl));
+}
+
+/*
+ * Brings the data and status registers up to @p now. In normal mode a
+ * conversion starts every measurement plus standby time from entering the
+ * mode; a forced conversion returns the chip to sleep when done.
+ */
+static void update(struct bmp280_emul *emul, u64_t now)
+{
+    u8_t ctrl = emul->regs[REG_CTRL_MEAS];
+    u32_t meas = meas_time_us(ctrl);
+    u64_t elapsed = now - emul->mode_since;
+    u64_t period;
+    u64_t last_end;
+
+    emul->regs[REG_STATUS] &= ~STATUS_MEASURING;
+
+    switch (ctrl & MODE_MASK) {
+    case MODE_SLEEP:
+        return;
+    case MODE_NORMAL:
+        period = meas + standby_us[T_SB(emul->regs[REG_CONFIG])];
+
+        if (elapsed % period < meas) {
+            emul->regs[REG_STATUS] |= STATUS_MEASURING;
+        }
+
+        if (elapsed < meas) {
+            return;
+        }
+
+        last_end = emul->mode_since + (elapsed - meas) / period * period + meas;
+        if (last_end != emul->latched) {
+            emul->latched = last_end;
+            result_latch(emul);
+        }
+        break;
+    default:
+        if (elapsed < meas) {
+            emul->regs[REG_STATUS] |= STATUS_MEASURING;
+            return;
+        }
+
+        result_latch(emul);
+        emul->regs[REG_CTRL_MEAS] &= ~MODE_MASK;
+        break;
+    }
+}
+
+static void reset(struct bmp280_emul *emul)
+{
+    u8_t *calib = &emul->regs[REG_CALIB];
+
+    memset(emul->regs, 0, sizeof(emul->regs));
+
+    sys_put_le16(dig_t1, &calib[0]);
+    sys_put_le16(dig_t2, &calib[2]);
+    sys_put_le16(dig_t3, &calib[4]);
+    sys_put_le16(dig_p1, &calib[6]);
+    for (int i = 0; i < ARRAY_SIZE(dig_p); i++) {
+        sys_put_le16(dig_p[i], &calib[8 + 2 * i]);
+    }
+
+    emul->regs[REG_ID] = BMP280_CHIP_ID;
+    emul->regs[REG_PRESS_MSB] = ADC_RESET >> 12;
+    emul->regs[REG_TEMP_MSB] = ADC_RESET >> 12;
+    emul->latched = 0;
+}
+
+static void reg_write(struct bmp280_emul *emul, u8_t reg, u8_t val, u64_t now)
+{
+    u8_t mode = emul->regs[REG_CTRL_MEAS] & MODE_MASK;
+
+    switch (reg) {
+    case REG_RESET:
+        if (val == BMP280_RESET_WORD) {
+            reset(emul);
+        }
+        break;
+    case REG_CTRL_MEAS:
+        if ((val & MODE_MASK) != MODE_SLEEP &&
+            ((val & MODE_MASK) != MODE_NORMAL || mode != MODE_NORMAL)) {
+            emul->mode_since = now;
+        }
+        emul->regs[reg] = val;
+        break;
+    case REG_CONFIG:
+        // Writes in normal mode may be ignored, datasheet section 5.4.6
+        if (mode != MODE_NORMAL) {
+            emul->regs[reg] = val;
+        }
+        break;
+    default:
+        SYS_LOG_DBG("Write to read only register 0x%02x", reg);
+        break;
+    }
+}
+
+/* Writes are register and value pairs, there is no auto-increment */
+static int bmp280_emul_write(struct i2c_emul *i2c, const u8_t *buf, u32_t len)
+{
+    struct bmp280_emul *emul = CONTAINER_OF(i2c, struct bmp280_emul, i2c);
+    u64_t now = emul_time_us();
+
+    if (len == 0) {
+        return -EIO;
+    }
+
+    update(emul, now);
+
+    emul->ptr = buf[0];
+
+    for (u32_t i = 0; i + 1 < len; i += 2) {
+        reg_write(emul, buf[i], buf[i + 1], now);
+    }
+
+    return 0;
+}
+
+static int bmp280_emul_read(struct i2c_emul *i2c, u8_t *buf, u32_t len)
+{
+    struct bmp280_emul *emul = CONTAINER_OF(i2c, struct bmp280_emul, i2c);
+
+    update(emul, emul_time_us());
+
+    for (u32_t i = 0; i < len; i++) {
+        buf[i] = emul->regs[emul->ptr++];
+    }
+
+    return 0;
+}
+
+static const struct i2c_emul_api bmp280_emul_api = {
+    .write = bmp280_emul_write,
+    .read = bmp280_emul_read,
+};
+
+static struct bmp280_emul bmp280_emul = {
+    .i2c = {
+        .addr = BMP280_EMUL_ADDR,
+        .api = &bmp280_emul_api,
+    },
+};
+
+static int bmp280_emul_init(struct device *dev)
+{
+    ARG_UNUSED(dev);
+
+    reset(&bmp280_emul);
+    i2c_emul_register(&bmp280_emul.i2c);
+
+    return 0;
+}
+
+SYS_INIT(bmp280_emul_init, PRE_KERNEL_1, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2018 Thomas Berg
+ *
+ */
+
+#include <kernel.h>
+#include <string.h>
+
+#include "emul_priv.h"
+
+
+/* A mild indoor climate and a fresh CR2032 */
+static emul_env_t env = {
+    .temperature = 22500,
+    .humidity    = 45000,
+    .light       = 320,
+    .pressure    = 101325,
+    .vbat        = 3000,
+};
+
+static u32_t last_cycles;
+static u64_t elapsed_cycles;
+
+
+/*
+ * Extends the 32-bit cycle counter. It wraps after a bit more than an hour
+ * at the native_posix 1 MHz, the emulators are called every few minutes.
+ */
+u64_t emul_time_us(void)
+{
+    unsigned int key = irq_lock();
+    u32_t now = k_cycle_get_32();
+
+    elapsed_cycles += now - last_cycles;
+    last_cycles = now;
+    irq_unlock(key);
+
+    return elapsed_cycles * USEC_PER_SEC / sys_clock_hw_cycles_per_sec;
+}
+
+const emul_env_t *emul_env(void)
+{
+    return &env;
+}
+
+void emul_env_set(const emul_env_t *new_env)
+{
+    memcpy(&env, new_env, sizeof(env));
+}
+
+void emul_env_get(emul_env_t *cur_env)
+{
+    memcpy(cur_env, &env, sizeof(env));
+}
@@ -0,0 +1,46 @@
+/** @file
+ *  @brief Walnut peripheral emulators
+ *
+ *  Behavioural models of the parts on the walnut board for the
+ *  native_posix variant: the Si7020, TSL4531 and BMP280 with their
+ *  register maps and conversion times, the I2C bus they share, the GPIO
+ *  driving the ambient light sensor rail and the nRF51 ADC. The sensors
+ *  report the environment set with emul_env_set().
+ */
+
+#ifndef EMUL_H
+#define EMUL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+typedef struct {
+    s32_t temperature;  /* m°C */
+    u32_t humidity;     /* Per cent mille RH, 45000 = 45 %RH */
+    u32_t light;        /* lux */
+    u32_t pressure;     /* Pa */
+    u16_t vbat;         /* Battery voltage, mV */
+} emul_env_t;
+
+typedef struct {
+    u32_t transfers;    /* Transactions, START to STOP */
+    u32_t bytes;        /* Payload bytes, either direction */
+    u32_t nacks;        /* Transactions the target refused */
+} i2c_emul_stats_t;
+
+void emul_env_set(const emul_env_t *env);
+void emul_env_get(emul_env_t *env);
+int i2c_emul_stats_get(u16_t addr, i2c_emul_stats_t *stats);
+int i2c_emul_nack_inject(u16_t addr, u32_t after);
+bool gpio_emul_pin_get(u32_t pin);
+u16_t adc_emul_convert(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EMUL_H */
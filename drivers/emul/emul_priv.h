@@ -0,0 +1,41 @@
+/** @file
+ *  @brief Interfaces between the emulators
+ */
+
+#ifndef EMUL_PRIV_H
+#define EMUL_PRIV_H
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <misc/slist.h>
+
+#include "emul.h"
+
+struct i2c_emul;
+
+/*
+ * A message the target does not acknowledge returns -EIO, which the bus
+ * reports for the whole transaction.
+ */
+struct i2c_emul_api {
+    int (*write)(struct i2c_emul *emul, const u8_t *buf, u32_t len);
+    int (*read)(struct i2c_emul *emul, u8_t *buf, u32_t len);
+};
+
+struct i2c_emul {
+    sys_snode_t node;
+    u16_t addr;
+    const struct i2c_emul_api *api;
+    i2c_emul_stats_t stats;
+    u32_t nack_in;      /* Transactions to the injected NACK, 0 for none */
+};
+
+/* Time since boot, us */
+u64_t emul_time_us(void);
+const emul_env_t *emul_env(void);
+
+void i2c_emul_register(struct i2c_emul *emul);
+
+u32_t gpio_emul_pin_rises(u32_t pin);
+
+#endif /* EMUL_PRIV_H */
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2018 Thomas Berg
+ *
+ */
+
+#include <kernel.h>
+#include <device.h>
+#include <gpio.h>
+#include <errno.h>
+#include <misc/util.h>
+
+#include "emul_priv.h"
+
+
+#define GPIO_EMUL_PINS      32
+
+
+static u32_t outputs;
+static u32_t rises[GPIO_EMUL_PINS];
+
+
+static int gpio_emul_config(struct device *dev, int access_op,
+                u32_t pin, int flags)
+{
+    if (access_op != GPIO_ACCESS_BY_PIN || pin >= GPIO_EMUL_PINS) {
+        return -ENOTSUP;
+    }
+
+    return 0;
+}
+
+static int gpio_emul_write(struct device *dev, int access_op,
+               u32_t pin, u32_t value)
+{
+    if (access_op != GPIO_ACCESS_BY_PIN || pin >= GPIO_EMUL_PINS) {
+        return -ENOTSUP;
+    }
+
+    if (value && !(outputs & BIT(pin))) {
+        rises[pin]++;
+    }
+
+    if (value) {
+        outputs |= BIT(pin);
+    } else {
+        outputs &= ~BIT(pin);
+    }
+
+    return 0;
+}
+
+static int gpio_emul_read(struct device *dev, int access_op,
+              u32_t pin, u32_t *value)
+{
+    if (access_op != GPIO_ACCESS_BY_PIN || pin >= GPIO_EMUL_PINS) {
+        return -ENOTSUP;
+    }
+
+    *value = (outputs & BIT(pin)) != 0;
+
+    return 0;
+}
+
+static const struct gpio_driver_api gpio_emul_driver_api = {
+    .config = gpio_emul_config,
+    .write = gpio_emul_write,
+    .read = gpio_emul_read,
+};
+
+static int gpio_emul_init(struct device *dev)
+{
+    return 0;
+}
+
+DEVICE_AND_API_INIT(gpio_emul, CONFIG_EMUL_GPIO_NAME, gpio_emul_init, NULL,
+            NULL, PRE_KERNEL_1, CONFIG_KERNEL_INIT_PRIORITY_DEVICE,
+            &gpio_emul_driver_api);
+
+
+bool gpio_emul_pin_get(u32_t pin)
+{
+    return pin < GPIO_EMUL_PINS && (outputs & BIT(pin));
+}
+
+/* Rising edges so far, a power cycle on a rail shows as a new count */
+u32_t gpio_emul_pin_rises(u32_t pin)
+{
+    return pin < GPIO_EMUL_PINS ? rises[pin] : 0;
+}
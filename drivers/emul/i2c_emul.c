@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2018 Thomas Berg
+ *
+ */
+
+#include <kernel.h>
+#include <device.h>
+#include <i2c.h>
+#include <errno.h>
+#include <string.h>
+#include <misc/slist.h>
+
+#include "emul_priv.h"
+
+#define CONFIG_SYS_LOG_I2C_EMUL_LEVEL 1
+#define SYS_LOG_DOMAIN "i2c_emul"
+#define SYS_LOG_LEVEL CONFIG_SYS_LOG_I2C_EMUL_LEVEL
+#include <logging/sys_log.h>
+
+
+/* START, address byte and STOP, in bit times */
+#define I2C_FRAME_BITS      (9 + 2)
+
+
+static sys_slist_t targets;
+
+
+static struct i2c_emul *target_find(u16_t addr)
+{
+    struct i2c_emul *emul;
+
+    SYS_SLIST_FOR_EACH_CONTAINER(&targets, emul, node) {
+        if (emul->addr == addr) {
+            return emul;
+        }
+    }
+
+    return NULL;
+}
+
+static int i2c_emul_configure(struct device *dev, u32_t dev_config)
+{
+    return 0;
+}
+
+/*
+ * One call is one transaction; a repeated START does not end it. An
+ * address nobody answers is a NACK on the address byte.
+ */
+static int i2c_emul_transfer(struct device *dev, struct i2c_msg *msgs,
+                 u8_t num_msgs, u16_t addr)
+{
+    struct i2c_emul *emul = target_find(addr);
+    u32_t bits = I2C_FRAME_BITS;
+    int err = 0;
+
+    if (emul == NULL) {
+        SYS_LOG_DBG("No target at 0x%02x", addr);
+        k_busy_wait(bits * USEC_PER_SEC / CONFIG_EMUL_I2C_SPEED);
+        return -EIO;
+    }
+
+    emul->stats.transfers++;
+
+    // An injected fault refuses the address byte, the target sees nothing
+    if (emul->nack_in && --emul->nack_in == 0) {
+        emul->stats.nacks++;
+        k_busy_wait(bits * USEC_PER_SEC / CONFIG_EMUL_I2C_SPEED);
+        return -EIO;
+    }
+
+    for (int i = 0; i < num_msgs && !err; i++) {
+        if (msgs[i].flags & I2C_MSG_READ) {
+            err = emul->api->read(emul, msgs[i].buf, msgs[i].len);
+        } else {
+            err = emul->api->write(emul, msgs[i].buf, msgs[i].len);
+        }
+
+        if (!err) {
+            emul->stats.bytes += msgs[i].len;
+            bits += msgs[i].len * 9;
+        }
+
+        if (i > 0 && (msgs[i].flags & I2C_MSG_RESTART)) {
+            bits += I2C_FRAME_BITS;
+        }
+    }
+
+    if (err) {
+        emul->stats.nacks++;
+    }
+
+    // The transfer blocks its caller for as long as it takes on the wire
+    k_busy_wait(bits * USEC_PER_SEC / CONFIG_EMUL_I2C_SPEED);
+
+    return err;
+}
+
+static const struct i2c_driver_api i2c_emul_driver_api = {
+    .configure = i2c_emul_configure,
+    .transfer = i2c_emul_transfer,
+};
+
+static int i2c_emul_init(struct device *dev)
+{
+    return 0;
+}
+
+DEVICE_AND_API_INIT(i2c_emul, CONFIG_I2C_0_NAME, i2c_emul_init, NULL, NULL,
+            PRE_KERNEL_1, CONFIG_KERNEL_INIT_PRIORITY_DEVICE,
+            &i2c_emul_driver_api);
+
+
+void i2c_emul_register(struct i2c_emul *emul)
+{
+    sys_slist_append(&targets, &emul->node);
+}
+
+int i2c_emul_stats_get(u16_t addr, i2c_emul_stats_t *stats)
+{
+    struct i2c_emul *emul = target_find(addr);
+
+    if (emul == NULL) {
+        return -ENODEV;
+    }
+
+    memcpy(stats, &emul->stats, sizeof(*stats));
+
+    return 0;
+}
+
+/*
+ * NACKs one transaction to addr, whatever the target would have answered,
+ * after letting the next `after` ones through.
+ */
+int i2c_emul_nack_inject(u16_t addr, u32_t after)
+{
+    struct i2c_emul *emul = target_find(addr);
+
+    if (emul == NULL) {
+        return -ENODEV;
+    }
+
+    emul->nack_in = after + 1;
+
+    return 0;
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2018 Thomas Berg
+ *
+ */
+
+#include <kernel.h>
+#include <init.h>
+#include <errno.h>
+#include <string.h>
+#include <misc/util.h>
+
+#include "emul_priv.h"
+
+#define CONFIG_SYS_LOG_SI7020_EMUL_LEVEL 1
+#define SYS_LOG_DOMAIN "si7020_emul"
+#define SYS_LOG_LEVEL CONFIG_SYS_LOG_SI7020_EMUL_LEVEL
+#include <logging/sys_log.h>
+
+
+#define SI7020_EMUL_ADDR                0x40
+
+/* Commands */
+#define CMD_MEASURE_HUMIDITY_HOLD       0xE5
+#define CMD_MEASURE_HUMIDITY_NO_HOLD    0xF5
+#define CMD_MEASURE_TEMPERATURE_HOLD    0xE3
+#define CMD_MEASURE_TEMPERATURE_NO_HOLD 0xF3
+#define CMD_READ_PREVIOUS_TEMPERATURE   0xE0
+#define CMD_RESET                       0xFE
+#define CMD_WRITE_REGISTER_1            0xE6
+#define CMD_READ_REGISTER_1             0xE7
+#define CMD_READ_ID_1                   0xFA
+#define CMD_READ_ID_2                   0xFC
+#define CMD_READ_FIRMWARE_REV           0x84
+
+/* User Register 1, the resolution and heater bits are writable */
+#define REG1_RESET                      0x3A
+#define REG1_WRITABLE                   0x85
+#define REG1_RES(reg1)                  ((((reg1) >> 6) & 0x02) | ((reg1) & 0x01))
+
+#define SI7020_ID                       0x14
+#define SI7020_FW_REV                   0x20
+
+/* Power up time after a reset, us */
+#define SI7020_RESET_TIME_US            15000
+
+
+struct si7020_emul {
+    struct i2c_emul i2c;
+    u8_t reg1;
+    u8_t cmd;
+    bool hold;
+    u64_t ready_at;     /* End of the reset or the running conversion */
+    u16_t rh_code;
+    u16_t t_code;
+    u8_t out[8];
+    u8_t out_len;
+};
+
+/* Maximum conversion times by resolution, us, datasheet table 2 */
+static const u32_t rh_conv_us[] = { 12000, 3100, 4500, 7000 };
+static const u32_t t_conv_us[] = { 10800, 3800, 6200, 2400 };
+
+/* Code bits by resolution */
+static const u8_t rh_bits[] = { 12, 8, 10, 11 };
+static const u8_t t_bits[] = { 14, 12, 13, 11 };
+
+
+/* CRC-8, polynomial x^8 + x^5 + x^4 + 1, initialised to 0 */
+static u8_t crc8(const u8_t *buf, u32_t len)
+{
+    u8_t crc = 0;
+
+    for (u32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+static u16_t code_limit(s64_t code, u8_t bits, u8_t status)
+{
+    u16_t mask = 0xFFFF << (16 - bits);
+
+    if (code < 0) {
+        code = 0;
+    } else if (code > 0xFFFF) {
+        code = 0xFFFF;
+    }
+
+    return ((u16_t)code & mask) | status;
+}
+
+/* RH = 125 * code / 65536 - 6, T = 175.72 * code / 65536 - 46.85 */
+static void convert(struct si7020_emul *emul)
+{
+    const emul_env_t *env = emul_env();
+    u8_t res = REG1_RES(emul->reg1);
+
+    emul->rh_code = code_limit(((s64_t)env->humidity + 6000) * 65536 / 125000,
+                               rh_bits[res], 0x02);
+    emul->t_code = code_limit(((s64_t)env->temperature + 46850) * 65536 / 175720,
+                              t_bits[res], 0x00);
+}
+
+static void out_code(struct si7020_emul *emul, u16_t code)
+{
+    emul->out[0] = code >> 8;
+    emul->out[1] = code & 0xFF;
+    emul->out[2] = crc8(emul->out, 2);
+    emul->out_len = 3;
+}
+
+static void out_id(struct si7020_emul *emul, u8_t cmd)
+{
+    u8_t id[4];
+
+    emul->out_len = 0;
+
+    // Serial number bytes, each pair followed by its CRC
+    if (cmd == CMD_READ_ID_1) {
+        id[0] = 0x11; id[1] = 0x22; id[2] = 0x33; id[3] = 0x44;
+    } else {
+        id[0] = SI7020_ID; id[1] = 0x00; id[2] = 0x55; id[3] = 0x66;
+    }
+
+    for (int i = 0; i < 4; i += 2) {
+        emul->out[emul->out_len++] = id[i];
+        emul->out[emul->out_len++] = id[i + 1];
+        emul->out[emul->out_len++] = crc8(&id[i], 2);
+    }
+}
+
+static int si7020_emul_write(struct i2c_emul *i2c, const u8_t *buf, u32_t len)
+{
+    struct si7020_emul *emul = CONTAINER_OF(i2c, struct si7020_emul, i2c);
+    u64_t now = emul_time_us();
+    u8_t res = REG1_RES(emul->reg1);
+
+    // No acknowledge while resetting or converting
+    if (now < emul->ready_at || len == 0) {
+        return -EIO;
+    }
+
+    emul->cmd = buf[0];
+    emul->out_len = 0;
+
+    switch (buf[0]) {
+    case CMD_RESET:
+        emul->reg1 = REG1_RESET;
+        emul->ready_at = now + SI7020_RESET_TIME_US;
+        break;
+    case CMD_WRITE_REGISTER_1:
+        if (len < 2) {
+            return -EIO;
+        }
+        emul->reg1 = (emul->reg1 & ~REG1_WRITABLE) | (buf[1] & REG1_WRITABLE);
+        break;
+    case CMD_READ_REGISTER_1:
+        emul->out[0] = emul->reg1;
+        emul->out_len = 1;
+        break;
+    case CMD_MEASURE_HUMIDITY_HOLD:
+    case CMD_MEASURE_HUMIDITY_NO_HOLD:
+        // A humidity measurement includes a temperature conversion
+        convert(emul);
+        emul->hold = buf[0] == CMD_MEASURE_HUMIDITY_HOLD;
+        emul->ready_at = now + rh_conv_us[res] + t_conv_us[res];
+        out_code(emul, emul->rh_code);
+        break;
+    case CMD_MEASURE_TEMPERATURE_HOLD:
+    case CMD_MEASURE_TEMPERATURE_NO_HOLD:
+        convert(emul);
+        emul->hold = buf[0] == CMD_MEASURE_TEMPERATURE_HOLD;
+        emul->ready_at = now + t_conv_us[res];
+        out_code(emul, emul->t_code);
+        break;
+    case CMD_READ_PREVIOUS_TEMPERATURE:
+        // No CRC on this one
+        out_code(emul, emul->t_code);
+        emul->out_len = 2;
+        break;
+    case CMD_READ_ID_1:
+    case CMD_READ_ID_2:
+        out_id(emul, buf[0]);
+        break;
+    case CMD_READ_FIRMWARE_REV:
+        emul->out[0] = SI7020_FW_REV;
+        emul->out_len = 1;
+        break;
+    default:
+        SYS_LOG_DBG("Unknown command 0x%02x", buf[0]);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+static int si7020_emul_read(struct i2c_emul *i2c, u8_t *buf, u32_t len)
+{
+    struct si7020_emul *emul = CONTAINER_OF(i2c, struct si7020_emul, i2c);
+    u64_t now = emul_time_us();
+
+    if (now < emul->ready_at) {
+        if (!emul->hold) {
+            return -EIO;
+        }
+
+        // Hold master mode stretches the clock until the result is ready
+        k_busy_wait(emul->ready_at - now);
+    }
+
+    emul->hold = false;
+
+    memset(buf, 0xFF, len);
+    memcpy(buf, emul->out, min(len, emul->out_len));
+
+    return 0;
+}
+
+static const struct i2c_emul_api si7020_emul_api = {
+    .write = si7020_emul_write,
+    .read = si7020_emul_read,
+};
+
+static struct si7020_emul si7020_emul = {
+    .i2c = {
+        .addr = SI7020_EMUL_ADDR,
+        .api = &si7020_emul_api,
+    },
+    .reg1 = REG1_RESET,
+};
+
+static int si7020_emul_init(struct device *dev)
+{
+    ARG_UNUSED(dev);
+
+    i2c_emul_register(&si7020_emul.i2c);
+
+    return 0;
+}
+
+SYS_INIT(si7020_emul_init, PRE_KERNEL_1, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2018 Thomas Berg
+ *
+ */
+
+#include <kernel.h>
+#include <init.h>
+#include <errno.h>
+#include <string.h>
+#include <misc/util.h>
+
+#include "emul_priv.h"
+
+#define CONFIG_SYS_LOG_TSL4531_EMUL_LEVEL 1
+#define SYS_LOG_DOMAIN "tsl4531_emul"
+#define SYS_LOG_LEVEL CONFIG_SYS_LOG_TSL4531_EMUL_LEVEL
+#include <logging/sys_log.h>
+
+
+#define TSL4531_EMUL_ADDR       0x29
+
+/* The rail i2c_wrap switches, the chip is only powered while it is high */
+#define TSL4531_EMUL_RAIL_PIN   20
+
+/* Command byte */
+#define CMD_BIT                 0x80
+#define CMD_ADDR_MASK           0x0F
+
+/* Registers */
+#define REG_CONTROL             0x00
+#define REG_CONFIG              0x01
+#define REG_DATA_LOW            0x04
+#define REG_DATA_HIGH           0x05
+#define REG_ID                  0x0A
+#define REG_COUNT               0x10
+
+#define MODE_MASK               0x03
+#define MODE_POWER_DOWN         0x00
+#define MODE_SINGLE_SHOT        0x02
+#define MODE_NORMAL             0x03
+
+#define CFG_TCNTRL_MASK         0x03
+
+/* TSL45315 */
+#define TSL4531_ID              0xA0
+
+
+struct tsl4531_emul {
+    struct i2c_emul i2c;
+    u8_t regs[REG_COUNT];
+    u8_t ptr;
+    u32_t rises;        /* Rail power ups seen */
+    u64_t conv_start;
+};
+
+/* Integration time by TCNTRL, us */
+static const u32_t integration_us[] = { 400000, 200000, 100000, 400000 };
+
+
+static void power_on_reset(struct tsl4531_emul *emul)
+{
+    memset(emul->regs, 0, sizeof(emul->regs));
+    emul->regs[REG_ID] = TSL4531_ID;
+    emul->ptr = 0;
+}
+
+/*
+ * Unpowered the chip does not answer; powered up again it has lost its
+ * registers and the last result.
+ */
+static bool powered(struct tsl4531_emul *emul)
+{
+    u32_t rises = gpio_emul_pin_rises(TSL4531_EMUL_RAIL_PIN);
+
+    if (!gpio_emul_pin_get(TSL4531_EMUL_RAIL_PIN)) {
+        return false;
+    }
+
+    if (rises != emul->rises) {
+        emul->rises = rises;
+        power_on_reset(emul);
+    }
+
+    return true;
+}
+
+/* Lux = multiplier * data, the multiplier is 1, 2 or 4 */
+static void result_latch(struct tsl4531_emul *emul)
+{
+    u8_t tcntrl = emul->regs[REG_CONFIG] & CFG_TCNTRL_MASK;
+    u32_t data = emul_env()->light / (400000 / integration_us[tcntrl]);
+
+    data = min(data, 0xFFFF);
+    emul->regs[REG_DATA_LOW] = data & 0xFF;
+    emul->regs[REG_DATA_HIGH] = data >> 8;
+}
+
+static void update(struct tsl4531_emul *emul, u64_t now)
+{
+    u8_t mode = emul->regs[REG_CONTROL] & MODE_MASK;
+    u8_t tcntrl = emul->regs[REG_CONFIG] & CFG_TCNTRL_MASK;
+
+    if (mode != MODE_SINGLE_SHOT && mode != MODE_NORMAL) {
+        return;
+    }
+
+    if (now - emul->conv_start < integration_us[tcntrl]) {
+        return;
+    }
+
+    result_latch(emul);
+
+    if (mode == MODE_SINGLE_SHOT) {
+        emul->regs[REG_CONTROL] &= ~MODE_MASK;
+    } else {
+        emul->conv_start = now;
+    }
+}
+
+static int tsl4531_emul_write(struct i2c_emul *i2c, const u8_t *buf, u32_t len)
+{
+    struct tsl4531_emul *emul = CONTAINER_OF(i2c, struct tsl4531_emul, i2c);
+    u64_t now = emul_time_us();
+
+    if (!powered(emul) || len == 0 || !(buf[0] & CMD_BIT)) {
+        return -EIO;
+    }
+
+    update(emul, now);
+
+    emul->ptr = buf[0] & CMD_ADDR_MASK;
+
+    for (u32_t i = 1; i < len; i++, emul->ptr++) {
+        if (emul->ptr == REG_CONTROL &&
+            (buf[i] & MODE_MASK) != MODE_POWER_DOWN) {
+            emul->conv_start = now;
+        }
+
+        // Data and ID are read only
+        if (emul->ptr == REG_CONTROL || emul->ptr == REG_CONFIG) {
+            emul->regs[emul->ptr] = buf[i];
+        }
+    }
+
+    return 0;
+}
+
+static int tsl4531_emul_read(struct i2c_emul *i2c, u8_t *buf, u32_t len)
+{
+    struct tsl4531_emul *emul = CONTAINER_OF(i2c, struct tsl4531_emul, i2c);
+
+    if (!powered(emul)) {
+        return -EIO;
+    }
+
+    update(emul, emul_time_us());
+
+    for (u32_t i = 0; i < len; i++, emul->ptr++) {
+        buf[i] = emul->regs[emul->ptr % REG_COUNT];
+    }
+
+    return 0;
+}
+
+static const struct i2c_emul_api tsl4531_emul_api = {
+    .write = tsl4531_emul_write,
+    .read = tsl4531_emul_read,
+};
+
+static struct tsl4531_emul tsl4531_emul = {
+    .i2c = {
+        .addr = TSL4531_EMUL_ADDR,
+        .api = &tsl4531_emul_api,
+    },
+};
+
+static int tsl4531_emul_init(struct device *dev)
+{
+    ARG_UNUSED(dev);
+
+    power_on_reset(&tsl4531_emul);
+    i2c_emul_register(&tsl4531_emul.i2c);
+
+    return 0;
+}
+
+SYS_INIT(tsl4531_emul_init, PRE_KERNEL_1, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
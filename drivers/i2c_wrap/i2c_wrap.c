@@ -27,17 +27,81 @@
 static struct k_sem pow_sem;
 
 
+static bool is_suspended(struct i2c_wrap_data *drv_data)
+{
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    return drv_data->pm_state != DEVICE_PM_ACTIVE_STATE;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Drives the rail and keeps the time it has been on, for energy
+ * accounting.
+ */
+static int rail_set(struct i2c_wrap_data *drv_data, u32_t on)
+{
+    u32_t now = k_cycle_get_32();
+    int err;
+
+    err = gpio_pin_write(drv_data->gpio, ALS_VDD_GPIO_PIN_NUM, on);
+    if (err != 0) {
+        return err;
+    }
+
+    if (on && !drv_data->rail_on) {
+        drv_data->rail_since = now;
+    } else if (!on && drv_data->rail_on) {
+        drv_data->rail_cycles += now - drv_data->rail_since;
+    }
+
+    if (drv_data->rail_cb != NULL && on != drv_data->rail_on) {
+        drv_data->rail_cb(on);
+    }
+
+    drv_data->rail_on = on;
+
+    return 0;
+}
+
+/*
+ * Drops the rail after a transfer, failed or not, unless a sensor holds it
+ * for a conversion.
+ */
+static int rail_release(struct i2c_wrap_data *drv_data)
+{
+    int err;
+
+    if (k_sem_count_get(&pow_sem) != AL_SENSOR_MAX_NUM_USERS) {
+        return 0;
+    }
+
+    err = rail_set(drv_data, 0);
+    if (err != 0) {
+        SYS_LOG_ERR("Failed to set GPIO%d low", ALS_VDD_GPIO_PIN_NUM);
+    }
+
+    return err;
+}
+
 static int w_i2c_write(struct device *dev, u8_t *buf,
                 u32_t num_bytes, u16_t addr)
 {
     int err;
+    int rail_err;
     struct i2c_wrap_data *drv_data = dev->driver_data;
 
+    if (is_suspended(drv_data)) {
+        return -EBUSY;
+    }
+
     // Set GPIO high
-    err = gpio_pin_write(drv_data->gpio, ALS_VDD_GPIO_PIN_NUM, 1);
+    err = rail_set(drv_data, 1);
     if (err != 0) {
         SYS_LOG_ERR("Failed to set GPIO%d high", ALS_VDD_GPIO_PIN_NUM);
-        return -1;
+        rail_release(drv_data);
+        return err;
     }
 
     k_sleep(1);
@@ -45,33 +109,32 @@ static int w_i2c_write(struct device *dev, u8_t *buf,
     // Transfer I2C
     err = i2c_write(drv_data->i2c, buf, num_bytes, addr);
     if (err != 0) {
-        SYS_LOG_ERR("I2C write failed");
-        return -1;
+        SYS_LOG_ERR("I2C write failed (err %d)", err);
     }
 
-    // Check if semaphore is taken, otherwise set GPIO low
-    if (k_sem_count_get(&pow_sem) == AL_SENSOR_MAX_NUM_USERS) {
-        err = gpio_pin_write(drv_data->gpio, ALS_VDD_GPIO_PIN_NUM, 0);
-        if (err != 0) {
-            SYS_LOG_ERR("Failed to set GPIO%d low", ALS_VDD_GPIO_PIN_NUM);
-            return -1;
-        }
-    }
+    // The transfer error, if any, is the one the caller gets
+    rail_err = rail_release(drv_data);
 
-    return 0;
+    return err != 0 ? err : rail_err;
 }
 
 static int w_i2c_read(struct device *dev, u8_t *buf,
                 u32_t num_bytes, u16_t addr)
 {
     int err;
+    int rail_err;
     struct i2c_wrap_data *drv_data = dev->driver_data;
 
+    if (is_suspended(drv_data)) {
+        return -EBUSY;
+    }
+
     // Set GPIO high
-    err = gpio_pin_write(drv_data->gpio, ALS_VDD_GPIO_PIN_NUM, 1);
+    err = rail_set(drv_data, 1);
     if (err != 0) {
         SYS_LOG_ERR("Failed to set GPIO%d high", ALS_VDD_GPIO_PIN_NUM);
-        return -1;
+        rail_release(drv_data);
+        return err;
     }
 
     k_sleep(1);
@@ -79,20 +142,13 @@ static int w_i2c_read(struct device *dev, u8_t *buf,
     // Transfer I2C
     err = i2c_read(drv_data->i2c, buf, num_bytes, addr);
     if (err != 0) {
-        SYS_LOG_ERR("I2C read failed");
-        return -1;
+        SYS_LOG_ERR("I2C read failed (err %d)", err);
     }
 
-    // Check if semaphore is taken, otherwise set GPIO low
-    if (k_sem_count_get(&pow_sem) == AL_SENSOR_MAX_NUM_USERS) {
-        err = gpio_pin_write(drv_data->gpio, ALS_VDD_GPIO_PIN_NUM, 0);
-        if (err != 0) {
-            SYS_LOG_ERR("Failed to set GPIO%d low", ALS_VDD_GPIO_PIN_NUM);
-            return -1;
-        }
-    }
+    // The transfer error, if any, is the one the caller gets
+    rail_err = rail_release(drv_data);
 
-    return 0;
+    return err != 0 ? err : rail_err;
 }
 
 static int w_i2c_burst_read(struct device *dev, u16_t dev_addr,
@@ -100,13 +156,19 @@ static int w_i2c_burst_read(struct device *dev, u16_t dev_addr,
                  u8_t num_bytes)
 {
     int err;
+    int rail_err;
     struct i2c_wrap_data *drv_data = dev->driver_data;
 
+    if (is_suspended(drv_data)) {
+        return -EBUSY;
+    }
+
     // Set GPIO high
-    err = gpio_pin_write(drv_data->gpio, ALS_VDD_GPIO_PIN_NUM, 1);
+    err = rail_set(drv_data, 1);
     if (err != 0) {
         SYS_LOG_ERR("Failed to set GPIO%d high", ALS_VDD_GPIO_PIN_NUM);
-        return -1;
+        rail_release(drv_data);
+        return err;
     }
 
     k_sleep(1);
@@ -114,20 +176,13 @@ static int w_i2c_burst_read(struct device *dev, u16_t dev_addr,
     // Transfer I2C
     err = i2c_burst_read(drv_data->i2c, dev_addr, start_addr, buf, num_bytes);
     if (err != 0) {
-        SYS_LOG_ERR("I2C burst read failed");
-        return -1;
+        SYS_LOG_ERR("I2C burst read failed (err %d)", err);
     }
 
-    // Check if semaphore is taken, otherwise set GPIO low
-    if (k_sem_count_get(&pow_sem) == AL_SENSOR_MAX_NUM_USERS) {
-        err = gpio_pin_write(drv_data->gpio, ALS_VDD_GPIO_PIN_NUM, 0);
-        if (err != 0) {
-            SYS_LOG_ERR("Failed to set GPIO%d low", ALS_VDD_GPIO_PIN_NUM);
-            return -1;
-        }
-    }
+    // The transfer error, if any, is the one the caller gets
+    rail_err = rail_release(drv_data);
 
-    return 0;
+    return err != 0 ? err : rail_err;
 }
 
 static int w_sem_take(struct device *dev)
@@ -139,7 +194,7 @@ static int w_sem_take(struct device *dev)
     err = k_sem_take(&pow_sem, K_MSEC(50));
     if (err != 0) {
         SYS_LOG_ERR("Failed to take power semaphore");
-        return -1;
+        return err;
     }
 
     SYS_LOG_DBG("Succeded to take pow_sem:%d", k_sem_count_get(&pow_sem));
@@ -166,6 +221,48 @@ static const struct i2c_wrap_driver_api i2c_wrap_driver_api = {
     .w_sem_give       = w_sem_give,
 };
 
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+/*
+ * Suspending forces the rail off. It is refused while a sensor holds the
+ * rail for a conversion; transfers are refused until the rail is resumed.
+ */
+static int i2c_wrap_device_ctrl(struct device *dev, u32_t ctrl_command,
+                void *context)
+{
+    struct i2c_wrap_data *drv_data = dev->driver_data;
+    u32_t state;
+
+    if (ctrl_command == DEVICE_PM_GET_POWER_STATE) {
+        *((u32_t *)context) = drv_data->pm_state;
+        return 0;
+    }
+
+    if (ctrl_command != DEVICE_PM_SET_POWER_STATE) {
+        return -EINVAL;
+    }
+
+    state = *((u32_t *)context);
+
+    if (state != DEVICE_PM_ACTIVE_STATE) {
+        if (k_sem_count_get(&pow_sem) != AL_SENSOR_MAX_NUM_USERS) {
+            return -EBUSY;
+        }
+
+        if (rail_set(drv_data, 0)) {
+            SYS_LOG_ERR("Failed to set GPIO%d low", ALS_VDD_GPIO_PIN_NUM);
+            return -EIO;
+        }
+    }
+
+    // The rail comes back with the next transfer
+    drv_data->pm_state = state;
+
+    return 0;
+}
+#else
+#define i2c_wrap_device_ctrl device_pm_control_nop
+#endif
+
 static int i2c_wrap_init(struct device *dev)
 {
     struct i2c_wrap_data *drv_data = dev->driver_data;
@@ -191,14 +288,18 @@ static int i2c_wrap_init(struct device *dev)
         return -EINVAL;
     }
 
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    drv_data->pm_state = DEVICE_PM_ACTIVE_STATE;
+#endif
+
     return 0;
 }
 
 static struct i2c_wrap_data i2c_wrap_driver;
 
-DEVICE_AND_API_INIT(i2c_wrap, CONFIG_I2C_WRAP_NAME, i2c_wrap_init, &i2c_wrap_driver,
-            NULL, POST_KERNEL, CONFIG_I2C_INIT_PRIORITY,
-            &i2c_wrap_driver_api);
+DEVICE_DEFINE(i2c_wrap, CONFIG_I2C_WRAP_NAME, i2c_wrap_init,
+          i2c_wrap_device_ctrl, &i2c_wrap_driver, NULL, POST_KERNEL,
+          CONFIG_I2C_INIT_PRIORITY, &i2c_wrap_driver_api);
 
 
 
@@ -240,3 +341,22 @@ int i2c_wrap_sem_give(struct device *dev)
 
     return api->w_sem_give(dev);
 }
+
+u64_t i2c_wrap_rail_time_get(struct device *dev)
+{
+    struct i2c_wrap_data *drv_data = dev->driver_data;
+    u64_t cycles = drv_data->rail_cycles;
+
+    if (drv_data->rail_on) {
+        cycles += k_cycle_get_32() - drv_data->rail_since;
+    }
+
+    return cycles * USEC_PER_SEC / sys_clock_hw_cycles_per_sec;
+}
+
+void i2c_wrap_rail_cb_set(struct device *dev, i2c_wrap_rail_cb_t cb)
+{
+    struct i2c_wrap_data *drv_data = dev->driver_data;
+
+    drv_data->rail_cb = cb;
+}
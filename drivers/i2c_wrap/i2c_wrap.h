@@ -17,9 +17,18 @@
 #define I2C_WRAP_H
 
 
+typedef void (*i2c_wrap_rail_cb_t)(u32_t on);
+
 struct i2c_wrap_data {
 	struct device *gpio;
 	struct device *i2c;
+	u32_t rail_on;
+	u32_t rail_since;
+	u64_t rail_cycles;
+	i2c_wrap_rail_cb_t rail_cb;
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+	u32_t pm_state;
+#endif
 };
 
 
@@ -58,4 +67,10 @@ int i2c_wrap_sem_take(struct device *dev);
 
 int i2c_wrap_sem_give(struct device *dev);
 
+/* Time the rail has been on since boot, us */
+u64_t i2c_wrap_rail_time_get(struct device *dev);
+
+/* Called on every rail transition, for tracing */
+void i2c_wrap_rail_cb_set(struct device *dev, i2c_wrap_rail_cb_t cb);
+
 #endif /* I2C_WRAP_H */
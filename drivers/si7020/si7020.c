@@ -40,6 +40,10 @@
 #define REG1_LOW_VOLTAGE		0x40
 #define REG1_ENABLE_HEATER		0x04
 
+/* RH plus temperature conversion time, ms */
+#define CONV_TIME_H12_T14   25
+#define CONV_TIME_H08_T12   8
+
 /* Device Identification */
 #define SI7020_ID           0x14
 
@@ -80,9 +84,9 @@ static int check_id(struct device *dev)
     return 0;
 }
 
-static int set_resolution(struct device *dev)
+static int set_resolution(struct device *dev, u8_t resolution)
 {
-    u8_t buf[2] = { CMD_WRITE_REGISTER_1, REG1_RESOLUTION_H12_T14 };
+    u8_t buf[2] = { CMD_WRITE_REGISTER_1, resolution };
 
     if (i2c_write_wrap(dev, buf, 2, SI7020_I2C_ADDR)) {
         SYS_LOG_ERR("I2C write failed!");
@@ -92,54 +96,100 @@ static int set_resolution(struct device *dev)
     return 0;
 }
 
-static u16_t get_humi(struct device *dev)
+/*
+ * The reset alone takes 80 ms, so the chip is probed on first use rather
+ * than in si7020_init(), which would hold up the boot.
+ */
+static int probe(struct si7020_data *drv_data)
+{
+    if (reset(drv_data->i2c_wrap) ||
+        check_id(drv_data->i2c_wrap) ||
+        set_resolution(drv_data->i2c_wrap, REG1_RESOLUTION_H12_T14)) {
+        return -EIO;
+    }
+
+    drv_data->conv_time = CONV_TIME_H12_T14;
+    drv_data->probed = true;
+
+    return 0;
+}
+
+static bool is_suspended(struct si7020_data *drv_data)
+{
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    return drv_data->pm_state != DEVICE_PM_ACTIVE_STATE;
+#else
+    return false;
+#endif
+}
+
+static int get_humi(struct device *dev, u8_t conv_time, u16_t *humidity)
 {
-    u16_t humidity = 0;
     u8_t buf[2] = { CMD_MEASURE_HUMIDITY_NO_HOLD, 0 };
+    int err;
 
-    if (i2c_write_wrap(dev, buf, 1, SI7020_I2C_ADDR)) {
-        SYS_LOG_ERR("I2C write failed!");
-        return -1;
+    err = i2c_write_wrap(dev, buf, 1, SI7020_I2C_ADDR);
+    if (err) {
+        SYS_LOG_ERR("I2C write failed (err %d)", err);
+        return -EIO;
     }
 
-    k_sleep(25);
+    k_sleep(conv_time);
 
-    if (i2c_read_wrap(dev, buf, 2, SI7020_I2C_ADDR)) {
-        SYS_LOG_ERR("Failed to read humidity!");
-        return -1;
+    err = i2c_read_wrap(dev, buf, 2, SI7020_I2C_ADDR);
+    if (err) {
+        SYS_LOG_ERR("Failed to read humidity (err %d)", err);
+        return -EIO;
     }
 
-    humidity = (buf[0] << 8) | (buf[1] & 0xFC);
+    *humidity = (buf[0] << 8) | (buf[1] & 0xFC);
 
-    return humidity;
+    return 0;
 }
 
-static u16_t get_temp(struct device *dev)
+static int get_temp(struct device *dev, u16_t *temperature)
 {
-    u16_t temperature = 0;
     u8_t buf[2] = { 0 };
+    int err;
 
-    if (i2c_burst_read_wrap(dev, SI7020_I2C_ADDR, CMD_READ_PREVIOUS_TEMPERATURE, buf, 2))
-    {
-        SYS_LOG_ERR("Failed to read temperature!");
-        return 0;
+    err = i2c_burst_read_wrap(dev, SI7020_I2C_ADDR,
+                              CMD_READ_PREVIOUS_TEMPERATURE, buf, 2);
+    if (err) {
+        SYS_LOG_ERR("Failed to read temperature (err %d)", err);
+        return -EIO;
     }
 
-    temperature = (buf[0] << 8) | (buf[1] & 0xFC);
+    *temperature = (buf[0] << 8) | (buf[1] & 0xFC);
 
-    return temperature;
+    return 0;
 }
 
 static int si7020_sample_fetch(struct device *dev, enum sensor_channel chan)
 {
     struct si7020_data *drv_data = dev->driver_data;
+    u16_t rh_sample;
+    u16_t t_sample;
 
     __ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL || chan == SENSOR_CHAN_AMBIENT_TEMP);
 
-    drv_data->rh_sample = get_humi(drv_data->i2c_wrap);
-    SYS_LOG_INF("rh: %u", drv_data->rh_sample);
-    drv_data->t_sample = get_temp(drv_data->i2c_wrap);
-    SYS_LOG_INF("temp: %u", drv_data->t_sample);
+    if (is_suspended(drv_data)) {
+        return -EBUSY;
+    }
+
+    if (!drv_data->probed && probe(drv_data)) {
+        return -EIO;
+    }
+
+    /* The previous samples are kept unless both readings succeed */
+    if (get_humi(drv_data->i2c_wrap, drv_data->conv_time, &rh_sample) ||
+        get_temp(drv_data->i2c_wrap, &t_sample)) {
+        return -EIO;
+    }
+
+    drv_data->rh_sample = rh_sample;
+    SYS_LOG_DBG("rh: %u", drv_data->rh_sample);
+    drv_data->t_sample = t_sample;
+    SYS_LOG_DBG("temp: %u", drv_data->t_sample);
 
     return 0;
 }
@@ -165,11 +215,82 @@ static int si7020_channel_get(struct device *dev, enum sensor_channel chan,
     return 0;
 }
 
+/*
+ * SENSOR_ATTR_SAMPLING_FREQUENCY above 1 Hz selects the lowest resolution,
+ * which has the shortest conversion time. Lower rates restore the full
+ * resolution.
+ */
+static int si7020_attr_set(struct device *dev, enum sensor_channel chan,
+               enum sensor_attribute attr,
+               const struct sensor_value *val)
+{
+    struct si7020_data *drv_data = dev->driver_data;
+    bool fast;
+
+    if (attr != SENSOR_ATTR_SAMPLING_FREQUENCY) {
+        return -ENOTSUP;
+    }
+
+    if (is_suspended(drv_data)) {
+        return -EBUSY;
+    }
+
+    if (!drv_data->probed && probe(drv_data)) {
+        return -EIO;
+    }
+
+    fast = val->val1 > 1;
+
+    if (set_resolution(drv_data->i2c_wrap, fast ? REG1_RESOLUTION_H08_T12 :
+                               REG1_RESOLUTION_H12_T14)) {
+        return -EIO;
+    }
+
+    drv_data->conv_time = fast ? CONV_TIME_H08_T12 : CONV_TIME_H12_T14;
+
+    return 0;
+}
+
 static const struct sensor_driver_api si7020_driver_api = {
+    .attr_set = si7020_attr_set,
     .sample_fetch = si7020_sample_fetch,
     .channel_get = si7020_channel_get,
 };
 
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+/*
+ * The chip drops into standby by itself after every conversion, so
+ * suspending only keeps the driver off the bus. The chip is not on the
+ * switched rail and keeps its configuration.
+ */
+static int si7020_device_ctrl(struct device *dev, u32_t ctrl_command,
+                  void *context)
+{
+    struct si7020_data *drv_data = dev->driver_data;
+    u32_t state;
+
+    if (ctrl_command == DEVICE_PM_GET_POWER_STATE) {
+        *((u32_t *)context) = drv_data->pm_state;
+        return 0;
+    }
+
+    if (ctrl_command != DEVICE_PM_SET_POWER_STATE) {
+        return -EINVAL;
+    }
+
+    state = *((u32_t *)context);
+    if (state == DEVICE_PM_OFF_STATE) {
+        return -ENOTSUP;
+    }
+
+    drv_data->pm_state = state;
+
+    return 0;
+}
+#else
+#define si7020_device_ctrl device_pm_control_nop
+#endif
+
 static int si7020_init(struct device *dev)
 {
     struct si7020_data *drv_data = dev->driver_data;
@@ -183,15 +304,15 @@ static int si7020_init(struct device *dev)
         return -EINVAL;
     }
 
-    reset(drv_data->i2c_wrap);
-    check_id(drv_data->i2c_wrap);
-    set_resolution(drv_data->i2c_wrap);
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    drv_data->pm_state = DEVICE_PM_ACTIVE_STATE;
+#endif
 
     return 0;
 }
 
 static struct si7020_data si7020_driver;
 
-DEVICE_AND_API_INIT(si7020, CONFIG_SI7020_NAME, si7020_init, &si7020_driver,
-            NULL, POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY,
-            &si7020_driver_api);
+DEVICE_DEFINE(si7020, CONFIG_SI7020_NAME, si7020_init, si7020_device_ctrl,
+          &si7020_driver, NULL, POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY,
+          &si7020_driver_api);
@@ -13,6 +13,11 @@ struct si7020_data {
     struct device *i2c_wrap;
     u16_t t_sample;
     u16_t rh_sample;
+    u8_t conv_time;
+    bool probed;
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    u32_t pm_state;
+#endif
 };
 
 #define SYS_LOG_DOMAIN "si7020"
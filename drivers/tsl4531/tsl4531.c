@@ -114,9 +114,8 @@ static int start_sample(struct device *dev)
     return 0;
 }
 
-static u16_t get_ambient_light(struct device *dev)
+static int get_ambient_light(struct device *dev, u16_t *ambient_light)
 {
-    u16_t ambient_light = 0;
     u8_t buf[2] = { 0 };
 
     i2c_wrap_sem_give(dev);
@@ -124,12 +123,12 @@ static u16_t get_ambient_light(struct device *dev)
     if (i2c_burst_read_wrap(dev, TSL4531_I2C_ADDR, TSL4531_CMD_DATA_LOW, buf, 2))
     {
         SYS_LOG_ERR("Failed to read ambient light!");
-        return 0;
+        return -1;
     }
 
-    ambient_light = (buf[1] << 8) | buf[0];
+    *ambient_light = (buf[1] << 8) | buf[0];
 
-    return ambient_light;
+    return 0;
 }
 
 static int tsl4531_sample_fetch(struct device *dev, enum sensor_channel chan)
@@ -138,9 +137,22 @@ static int tsl4531_sample_fetch(struct device *dev, enum sensor_channel chan)
 
     __ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL || chan == SENSOR_CHAN_LIGHT);
 
-    start_sample(drv_data->i2c_wrap);
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    if (drv_data->pm_state != DEVICE_PM_ACTIVE_STATE) {
+        return -EBUSY;
+    }
+#endif
+
+    if (start_sample(drv_data->i2c_wrap)) {
+        i2c_wrap_sem_give(drv_data->i2c_wrap);
+        return -EIO;
+    }
+
     k_sleep(420);
-    drv_data->al_sample = get_ambient_light(drv_data->i2c_wrap);
+
+    if (get_ambient_light(drv_data->i2c_wrap, &drv_data->al_sample)) {
+        return -EIO;
+    }
     SYS_LOG_DBG("Lux: %u", drv_data->al_sample);
 
     return 0;
@@ -164,6 +176,34 @@ static const struct sensor_driver_api tsl4531_driver_api = {
     .channel_get = tsl4531_channel_get,
 };
 
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+/*
+ * The chip sits on the switched rail and is unpowered between samples;
+ * every fetch starts a new single shot conversion. Suspending keeps the
+ * driver from powering the rail up again.
+ */
+static int tsl4531_device_ctrl(struct device *dev, u32_t ctrl_command,
+                   void *context)
+{
+    struct tsl4531_data *drv_data = dev->driver_data;
+
+    if (ctrl_command == DEVICE_PM_GET_POWER_STATE) {
+        *((u32_t *)context) = drv_data->pm_state;
+        return 0;
+    }
+
+    if (ctrl_command != DEVICE_PM_SET_POWER_STATE) {
+        return -EINVAL;
+    }
+
+    drv_data->pm_state = *((u32_t *)context);
+
+    return 0;
+}
+#else
+#define tsl4531_device_ctrl device_pm_control_nop
+#endif
+
 static int tsl4531_init(struct device *dev)
 {
     struct tsl4531_data *drv_data = dev->driver_data;
@@ -185,11 +225,15 @@ static int tsl4531_init(struct device *dev)
 
     // set_resolution(drv_data->i2c_wrap);
 
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    drv_data->pm_state = DEVICE_PM_ACTIVE_STATE;
+#endif
+
     return 0;
 }
 
 static struct tsl4531_data tsl4531_driver;
 
-DEVICE_AND_API_INIT(tsl4531, CONFIG_TSL4531_NAME, tsl4531_init, &tsl4531_driver,
-            NULL, POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY,
-            &tsl4531_driver_api);
+DEVICE_DEFINE(tsl4531, CONFIG_TSL4531_NAME, tsl4531_init, tsl4531_device_ctrl,
+          &tsl4531_driver, NULL, POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY,
+          &tsl4531_driver_api);
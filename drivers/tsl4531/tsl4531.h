@@ -12,6 +12,9 @@
 struct tsl4531_data {
     struct device *i2c_wrap;
     u16_t al_sample;
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    u32_t pm_state;
+#endif
 };
 
 #define SYS_LOG_DOMAIN "tsl4531"
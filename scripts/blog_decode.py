@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Decodes binary dictionary log frames written by src/blog.c.
+
+The frames are read from RTT channel 1, e.g. captured with
+
+    JLinkRTTLogger -Device NRF51822_XXAA -If SWD -Speed 4000 \\
+        -RTTChannel 1 blog.bin
+
+and the format strings are taken from the .blog_fmt section of the ELF file
+of the same build, which custom-sections.ld links unallocated:
+
+    scripts/blog_decode.py build/zephyr/zephyr.elf blog.bin
+
+Frame layout, little endian:
+    u8  magic 0xb1
+    u8  level << 4 | number of arguments
+    u16 address of the format string, low half
+    u32 uptime, ms
+    u32 arguments
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+from elftools.elf.constants import SH_FLAGS
+from elftools.elf.elffile import ELFFile
+
+MAGIC = 0xb1
+HEADER = struct.Struct('<BBHI')
+ID_DROPPED = 0xffff
+LEVELS = {1: 'ERR', 2: 'WRN', 3: 'INF', 4: 'DBG'}
+
+# printf conversion: flags, width, precision, length, conversion
+CONVERSION = re.compile(r'%([-+ #0]*)(\d*)(?:\.(\d+))?(hh|h|l|z)?([diuxXocp%])')
+
+
+def load_strings(elf_path):
+    """Returns the address and contents of the format string section."""
+    with open(elf_path, 'rb') as f:
+        section = ELFFile(f).get_section_by_name('.blog_fmt')
+        if section is None:
+            sys.exit('{}: no .blog_fmt section'.format(elf_path))
+        if section['sh_flags'] & SH_FLAGS.SHF_ALLOC:
+            # Linked into memory, the ids are truncated addresses
+            sys.exit('{}: .blog_fmt is allocated, was it linked without '
+                     'custom-sections.ld?'.format(elf_path))
+        return section['sh_addr'], section.data()
+
+
+def format_message(fmt, args):
+    args = list(args)
+
+    def convert(match):
+        flags, width, precision, _, conv = match.groups()
+        if conv == '%':
+            return '%'
+        value = args.pop(0) if args else 0
+        if conv in 'di' and value & 0x80000000:
+            value -= 1 << 32
+        if conv == 'p':
+            conv, flags = 'x', flags + '#'
+        if conv == 'u':
+            conv = 'd'
+        spec = '%' + flags + width
+        if precision is not None:
+            spec += '.' + precision
+        if conv == 'c':
+            return (spec + 'c') % chr(value & 0xff)
+        return (spec + conv) % value
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def string_at(strings, offset):
+    end = strings.find(b'\0', offset)
+    if offset >= len(strings) or end < 0:
+        return None
+    return strings[offset:end].decode('ascii', 'replace')
+
+
+def decode(base, strings, data, out):
+    pos = 0
+    while pos + HEADER.size <= len(data):
+        magic, value, msg_id, timestamp = HEADER.unpack_from(data, pos)
+        if magic != MAGIC:
+            # Lost sync, look for the next frame
+            pos += 1
+            continue
+
+        num_args = value & 0x0f
+        level = LEVELS.get(value >> 4, '???')
+        end = pos + HEADER.size + 4 * num_args
+        if end > len(data):
+            break
+
+        args = struct.unpack_from('<{}I'.format(num_args), data,
+                                  pos + HEADER.size)
+        pos = end
+
+        if msg_id == ID_DROPPED:
+            text = 'blog: {} messages dropped'.format(args[0])
+        else:
+            fmt = string_at(strings, (msg_id - base) & 0xffff)
+            if fmt is None:
+                text = '<unknown id 0x{:04x}> {}'.format(msg_id, args)
+            else:
+                text = format_message(fmt, args)
+
+        out.write('[{:10.3f}] <{}> {}\n'.format(timestamp / 1000.0, level,
+                                                text))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('elf', help='ELF file of the running firmware')
+    parser.add_argument('log', nargs='?', default='-',
+                        help='captured RTT channel 1 data, - for stdin')
+    args = parser.parse_args()
+
+    base, strings = load_strings(args.elf)
+
+    if args.log == '-':
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.log, 'rb') as f:
+            data = f.read()
+
+    decode(base, strings, data, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
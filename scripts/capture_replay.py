@@ -0,0 +1,303 @@
+#!/usr/bin/env python3
+"""Replays a sensor capture through the ESS notification policies.
+
+Capture RTT channel 2 with the sample capture enabled (src/capture.h),
+e.g.
+
+    JLinkRTTLogger -Device NRF51822_XXAA -If SWD -Speed 4000 \\
+        -RTTChannel 2 capture.bin
+
+then compare policies:
+
+    scripts/capture_replay.py capture.bin -p value-changed \\
+        -p greater-than-ref-value,ref=2500 -p value-changed,interval=300
+
+A policy is an ESS trigger condition, named after its ESS_ define in
+src/ess.h or given as a number, followed by options:
+
+    ref=N        reference value of the condition, in ESS units
+    interval=S   sample at most every S seconds instead of at the
+                 captured rate
+
+Every policy is a replay build of the native variant (bench/replay.c,
+boards/arm/walnut/doc/native.rst), so ZEPHYR_BASE must be set. The
+captured samples go through the firmware's own trigger conditions,
+notify.c, advertising and connection parameter policies and energy
+accounting, with a central connected for the whole capture.
+
+The reconstruction error is the difference between every captured sample
+and the value a central holds at that time, the last one sent to it.
+"""
+
+import argparse
+import bisect
+import math
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+
+# Wire format of a record, see capture.c
+RECORD = struct.Struct('<IBxxxii')
+
+CH_DROPPED = 0xff
+
+# readings_ch_t, with the ESS value scale of the characteristic
+CHANNELS = {
+    0: ('temperature', 100, 'C'),
+    1: ('humidity', 100, '%'),
+    2: ('ambient-light', 100, 'lx'),
+    3: ('pressure', 10000, 'kPa'),
+}
+
+# Energy consumers of the radio in the simulator report
+RADIO = ('adv', 'conn', 'tx')
+
+APP = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+
+
+def conditions(path):
+    """Reads the trigger conditions from the ESS_ defines in ess.h."""
+    with open(path) as f:
+        text = f.read()
+    body = text[text.index('Trigger Setting conditions'):]
+    found = re.findall(r'#define ESS_(\w+)\s+(0x[0-9a-fA-F]+)', body)
+    return {name.lower().replace('_', '-'): int(value, 16)
+            for name, value in found}
+
+
+class Unwrapper:
+    """Extends the 32-bit uptime in ms to a monotonic count."""
+
+    def __init__(self):
+        self.offset = 0
+        self.last = None
+
+    def __call__(self, ms):
+        if self.last is not None and ms + (1 << 31) < self.last:
+            self.offset += 1 << 32
+        self.last = ms
+        return ms + self.offset
+
+
+def read_capture(data, channels):
+    """Splits a capture into (ms, value) lists per channel and keeps the
+    records of the selected channels for the replay."""
+    samples = {ch: [] for ch in CHANNELS}
+    records = []
+    unwrap = Unwrapper()
+    dropped = 0
+
+    for pos in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        record = data[pos:pos + RECORD.size]
+        ms, ch, val1, val2 = RECORD.unpack(record)
+        ms = unwrap(ms)
+
+        if ch == CH_DROPPED:
+            dropped += val1
+        elif ch in channels:
+            samples[ch].append((ms, val1 + val2 / 1e6))
+            records.append(record)
+
+    return samples, records, dropped
+
+
+def parse_policy(spec, conds):
+    name, *options = spec.split(',')
+    cond = conds.get(name)
+    if cond is None:
+        try:
+            cond = int(name, 0)
+        except ValueError:
+            raise argparse.ArgumentTypeError(
+                'unknown condition {}, one of {}'.format(
+                    name, ', '.join(sorted(conds))))
+
+    policy = {'name': spec, 'condition': cond, 'ref': 0, 'interval': 0}
+    for option in options:
+        key, _, value = option.partition('=')
+        if key not in ('ref', 'interval'):
+            raise argparse.ArgumentTypeError('unknown option ' + key)
+        policy[key] = int(value, 0)
+
+    return policy
+
+
+def run_replay(policy, capture, build_dir):
+    """Builds the native variant for a policy, runs it and returns its
+    output."""
+    subprocess.check_call(
+        ['cmake', '-H' + APP, '-B' + build_dir, '-DBOARD_VARIANT=native',
+         '-DREPLAY_CAPTURE=' + capture, '-DSIM_CENTRAL=1',
+         '-DSIM_TRIGGER_CONDITION={}'.format(policy['condition']),
+         '-DSIM_TRIGGER_REF={}'.format(policy['ref']),
+         '-DREPLAY_INTERVAL_S={}'.format(policy['interval'])],
+        stdout=subprocess.DEVNULL)
+    subprocess.check_call(['cmake', '--build', build_dir],
+                          stdout=subprocess.DEVNULL)
+
+    exe = os.path.join(build_dir, 'zephyr', 'zephyr.exe')
+    return subprocess.run([exe], stdout=subprocess.PIPE, check=True,
+                          universal_newlines=True).stdout
+
+
+def parse_output(output):
+    """Collects the replay and simulator lines of a run."""
+    result = {'start': None, 'sampled': {},
+              'sent': {ch: [] for ch in CHANNELS},
+              'coalesced': 0, 'dropped': 0,
+              'na': {name: 0 for name in RADIO}}
+
+    for line in output.splitlines():
+        words = line.split()
+        if line.startswith('replay: start '):
+            result['start'] = (int(words[2]), int(words[3]))
+        elif line.startswith('replay: sampled '):
+            result['sampled'][int(words[2])] = int(words[3])
+        elif line.startswith('sim: sent '):
+            ch = int(words[3])
+            if ch in CHANNELS:
+                result['sent'][ch].append((int(words[2]), int(words[4])))
+        elif line.startswith('sim: notify sent '):
+            counts = re.findall(r'\d+', line)
+            result['coalesced'] = int(counts[1])
+            result['dropped'] = int(counts[2])
+        elif re.match(r'sim: \w+ \d+ nA,', line) and words[1] in RADIO:
+            result['na'][words[1]] = int(words[2])
+
+    if result['start'] is None:
+        sys.exit('The replay did not start:\n' + output)
+
+    return result
+
+
+def reconstruction(samples, sent, start, first_ms, scale):
+    """Compares every captured sample with the value last sent before it."""
+    uptime, _ = start
+    times = [first_ms + t - uptime for t, _ in sent]
+    result = {'sq': 0.0, 'max': 0.0, 'held': 0}
+
+    for ms, value in samples:
+        i = bisect.bisect_right(times, ms)
+        if i == 0:
+            continue
+        error = abs(value - sent[i - 1][1] / scale)
+        result['sq'] += error * error
+        result['max'] = max(result['max'], error)
+        result['held'] += 1
+
+    return result
+
+
+def replay(policy, samples, capture, build_dir):
+    output = run_replay(policy, capture, build_dir)
+    run = parse_output(output)
+    first_ms = min(ms for ch in samples for ms, _ in samples[ch][:1])
+    rows = []
+    sent = 0
+
+    for ch, (name, scale, unit) in CHANNELS.items():
+        if not samples[ch]:
+            continue
+        result = reconstruction(samples[ch], run['sent'][ch], run['start'],
+                                first_ms, scale)
+        result['sampled'] = run['sampled'].get(ch, 0)
+        result['sent'] = len(run['sent'][ch])
+        rows.append((name, unit, len(samples[ch]), result))
+        sent += result['sent']
+
+    # Replaced by a newer value before they were sent, or not sent
+    return rows, {'sent': sent, 'coalesced': run['coalesced'],
+                  'dropped': run['dropped'], 'na': run['na']}
+
+
+def print_text(policy, rows, totals):
+    print('policy {}'.format(policy['name']))
+    print('  {:<14} {:>8} {:>8} {:>6} {:>12} {:>12}'.format(
+        'channel', 'captured', 'sampled', 'sent', 'rms error', 'max error'))
+    for name, unit, captured, r in rows:
+        if r['held']:
+            rms = '{:.4f} {:<3}'.format(math.sqrt(r['sq'] / r['held']), unit)
+            worst = '{:.4f} {:<3}'.format(r['max'], unit)
+        else:
+            # Nothing sent, the central has no value
+            rms = worst = '-'
+        print('  {:<14} {:>8} {:>8} {:>6} {:>12} {:>12}'.format(
+            name, captured, r['sampled'], r['sent'], rms, worst))
+    print('  notifications {}, coalesced {}, dropped {}, radio {} nA'.format(
+        totals['sent'], totals['coalesced'], totals['dropped'],
+        ', '.join('{} {}'.format(name, totals['na'][name])
+                  for name in RADIO)))
+    print()
+
+
+def print_csv(policy, rows, totals):
+    for name, unit, captured, r in rows:
+        rms = math.sqrt(r['sq'] / r['held']) if r['held'] else float('nan')
+        print('"{}",{},{},{},{},{:.6f},{:.6f},{},{},{},{}'.format(
+            policy['name'], name, captured, r['sampled'], r['sent'], rms,
+            r['max'], totals['sent'], totals['coalesced'], totals['dropped'],
+            ','.join(str(totals['na'][name]) for name in RADIO)))
+
+
+def main():
+    conds = conditions(os.path.join(APP, 'src', 'ess.h'))
+    names = [name for name, _, _ in CHANNELS.values()]
+
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('capture', help='captured RTT channel 2 data')
+    parser.add_argument('-p', '--policy', action='append', required=True,
+                        type=lambda spec: parse_policy(spec, conds),
+                        help='condition[,ref=N][,interval=S]')
+    parser.add_argument('-c', '--channel', action='append', choices=names,
+                        help='channel to replay, default all')
+    parser.add_argument('--csv', action='store_true',
+                        help='one line per policy and channel')
+    parser.add_argument('--build-dir',
+                        help='directory for the replay builds '
+                             '(default: a temporary one)')
+    args = parser.parse_args()
+
+    if 'ZEPHYR_BASE' not in os.environ:
+        sys.exit('ZEPHYR_BASE is not set')
+
+    selected = [ch for ch, (name, _, _) in CHANNELS.items()
+                if args.channel is None or name in args.channel]
+
+    with open(args.capture, 'rb') as f:
+        samples, records, dropped = read_capture(f.read(), selected)
+
+    if dropped:
+        sys.stderr.write('{} samples were dropped during the capture\n'
+                         .format(dropped))
+
+    if not records:
+        sys.exit('No samples in ' + args.capture)
+
+    build_root = args.build_dir or tempfile.mkdtemp()
+    capture = os.path.join(os.path.abspath(build_root), 'capture.bin')
+    os.makedirs(build_root, exist_ok=True)
+    with open(capture, 'wb') as f:
+        f.write(b''.join(records))
+
+    if args.csv:
+        print('policy,channel,captured,sampled,sent,rms_error,max_error,'
+              'notifications,coalesced,dropped,' +
+              ','.join(name + '_na' for name in RADIO))
+
+    for i, policy in enumerate(args.policy):
+        build_dir = os.path.join(os.path.abspath(build_root),
+                                 'policy{}'.format(i))
+        rows, totals = replay(policy, samples, capture, build_dir)
+        if args.csv:
+            print_csv(policy, rows, totals)
+        else:
+            print_text(policy, rows, totals)
+
+
+if __name__ == '__main__':
+    main()
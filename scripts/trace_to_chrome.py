@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""Converts a trace captured from src/trace.c to the Chrome trace format.
+
+Capture RTT channel 2 with the trace recorder enabled, e.g.
+
+    JLinkRTTLogger -Device NRF51822_XXAA -If SWD -Speed 4000 \\
+        -RTTChannel 2 trace.bin
+
+then convert and open the result in chrome://tracing or ui.perfetto.dev:
+
+    scripts/trace_to_chrome.py trace.bin -e build/zephyr/zephyr.elf \\
+        -o trace.json
+
+With the ELF file, threads are named after the symbol of their thread
+structure. Thread switches and interrupts are only in the trace of a
+build with the trace.conf overlay, which enables the kernel event logger. Span names come from the probe_id_t enum in src/probe.h.
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+# Wire format of an event, see trace.c
+EVENT = struct.Struct('<IBBBxI')
+
+TRACE_THREAD = 1
+TRACE_SPAN = 2
+TRACE_TIMER = 3
+TRACE_RAIL = 4
+TRACE_SWITCH = 5
+TRACE_ISR = 6
+TRACE_DROPPED = 8
+
+CTX_ISR = 0xff
+
+PROBE_H = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                       '..', 'src', 'probe.h')
+
+
+def probe_names(path):
+    """Reads the probe names from the probe_id_t enum, in order."""
+    with open(path) as f:
+        text = f.read()
+    body = re.search(r'typedef enum \{(.*?)\} probe_id_t;', text, re.S)
+    names = re.findall(r'PROBE_(\w+),', body.group(1))
+    return [n.lower() for n in names if n != 'COUNT']
+
+
+def thread_symbols(elf_path):
+    """Maps addresses of data objects to their symbol names."""
+    from elftools.elf.elffile import ELFFile
+
+    symbols = {}
+    with open(elf_path, 'rb') as f:
+        symtab = ELFFile(f).get_section_by_name('.symtab')
+        for sym in symtab.iter_symbols():
+            if sym['st_info']['type'] == 'STT_OBJECT':
+                symbols[sym['st_value']] = sym.name
+    return symbols
+
+
+class Unwrapper:
+    """Extends the 32-bit cycle counter to a monotonic count."""
+
+    def __init__(self):
+        self.offset = 0
+        self.last = None
+
+    def __call__(self, cycles):
+        if self.last is not None and cycles + (1 << 31) < self.last:
+            self.offset += 1 << 32
+        self.last = cycles
+        return cycles + self.offset
+
+
+def convert(data, hz, names, symbols):
+    events = []
+    unwrap = Unwrapper()
+
+    def us(cycles):
+        return cycles * 1e6 / hz
+
+    events.append({'ph': 'M', 'name': 'thread_name', 'pid': 0,
+                   'tid': CTX_ISR, 'args': {'name': 'interrupts'}})
+
+    for pos in range(0, len(data) - EVENT.size + 1, EVENT.size):
+        time, kind, ev_id, ctx, arg = EVENT.unpack_from(data, pos)
+        ts = us(unwrap(time))
+        base = {'pid': 0, 'tid': ctx, 'ts': ts}
+
+        if kind == TRACE_THREAD:
+            name = symbols.get(arg, 'thread 0x{:08x}'.format(arg))
+            events.append({'ph': 'M', 'name': 'thread_name', 'pid': 0,
+                           'tid': ev_id, 'args': {'name': name}})
+        elif kind == TRACE_SPAN:
+            name = names[ev_id] if ev_id < len(names) else str(ev_id)
+            events.append(dict(base, ph='X', name=name, dur=us(arg)))
+        elif kind == TRACE_TIMER:
+            name = names[ev_id] if ev_id < len(names) else str(ev_id)
+            events.append(dict(base, ph='i', s='t', name='timer ' + name))
+        elif kind == TRACE_RAIL:
+            events.append(dict(base, ph='C', name='sensor rail',
+                               args={'on': arg}))
+        elif kind == TRACE_SWITCH:
+            # Logged by the kernel on the thread that is switched out
+            events.append(dict(base, ph='i', s='t', name='switch out'))
+        elif kind == TRACE_ISR:
+            # The kernel logs no interrupt exit
+            events.append(dict(base, ph='i', s='t',
+                               name='irq {}'.format(ev_id)))
+        elif kind == TRACE_DROPPED:
+            events.append(dict(base, ph='i', s='g',
+                               name='{} events dropped'.format(arg)))
+        else:
+            sys.stderr.write('Unknown event {} at offset {}\n'.format(kind,
+                                                                     pos))
+
+    return {'traceEvents': events, 'displayTimeUnit': 'ms'}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('trace', help='captured RTT channel 2 data')
+    parser.add_argument('-e', '--elf', help='ELF file, to name threads')
+    parser.add_argument('-o', '--output', default='-',
+                        help='JSON output, - for stdout')
+    parser.add_argument('--hz', type=int, default=32768,
+                        help='cycle counter frequency (default: %(default)s)')
+    parser.add_argument('--probe-h', default=PROBE_H,
+                        help='probe.h of the traced build')
+    args = parser.parse_args()
+
+    with open(args.trace, 'rb') as f:
+        data = f.read()
+
+    symbols = thread_symbols(args.elf) if args.elf else {}
+    trace = convert(data, args.hz, probe_names(args.probe_h), symbols)
+
+    if args.output == '-':
+        json.dump(trace, sys.stdout, indent=1)
+    else:
+        with open(args.output, 'w') as f:
+            json.dump(trace, f, indent=1)
+
+
+if __name__ == '__main__':
+    main()
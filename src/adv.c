@@ -0,0 +1,485 @@
+/** @file
+ *  @brief Advertising manager
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <zephyr.h>
+#include <net/buf.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+
+#include "adv.h"
+#include "beacon.h"
+#include "nv.h"
+#include "boot.h"
+
+#define SYS_LOG_DOMAIN "adv"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+#define DEVICE_NAME             CONFIG_BT_DEVICE_NAME
+#define DEVICE_NAME_LEN         (sizeof(DEVICE_NAME) - 1)
+
+#define ADV_DATA_MAX_LEN        31
+
+/* Ultra slow advertising interval, 2.5 s - 2.56 s */
+#define ADV_ULTRA_SLOW_INT_MIN  0x0fa0
+#define ADV_ULTRA_SLOW_INT_MAX  0x1000
+
+/* Model charge of one connectable advertising event on all three channels */
+#define ADV_EVENT_CHARGE_NC     15000
+
+/* Mean of the 0-10 ms pseudo-random advDelay added to every event */
+#define ADV_DELAY_MEAN_US       5000
+
+#define ESS_BEACON BT_LE_ADV_PARAM(BT_LE_ADV_OPT_NONE, \
+                       BT_GAP_ADV_SLOW_INT_MIN, \
+                       BT_GAP_ADV_SLOW_INT_MAX)
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+/* Interval and dwell time of one connectable advertising state */
+struct adv_policy {
+    u16_t interval_min;
+    u16_t interval_max;
+    s32_t duration;
+};
+
+/* Payload as last written to the controller */
+struct adv_raw {
+    u8_t len;
+    u8_t data[ADV_DATA_MAX_LEN];
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+/*
+ * Advertise fast right after boot, disconnect or an alarm so that gateways
+ * find the node quickly, then back off in stages while nobody connects.
+ */
+static const struct adv_policy adv_policy[] = {
+    [ADV_STATE_FAST] = {
+        BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, K_SECONDS(30)
+    },
+    [ADV_STATE_MEDIUM] = {
+        BT_GAP_ADV_FAST_INT_MIN_2, BT_GAP_ADV_FAST_INT_MAX_2, K_SECONDS(90)
+    },
+    [ADV_STATE_SLOW] = {
+        BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, K_MINUTES(15)
+    },
+    [ADV_STATE_ULTRA_SLOW] = {
+        ADV_ULTRA_SLOW_INT_MIN, ADV_ULTRA_SLOW_INT_MAX, K_FOREVER
+    },
+};
+
+static u8_t batt[3] = { 0x0f, 0x18, 0x00 };
+
+static struct bt_data ad[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+    BT_DATA_BYTES(BT_DATA_UUID16_SOME, 0x1a, 0x18),
+    BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+    BT_DATA(BT_DATA_SVC_DATA16, batt, 3),
+};
+
+static u8_t beacon_data[BEACON_DATA_MAX_LEN];
+
+static struct bt_data beacon_ad[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, beacon_data, 0),
+    BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+};
+
+static struct bt_data beacon_sd[] = {
+    BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+};
+
+static u8_t _mode;
+static bool _is_started;
+
+static struct adv_raw _ad_raw;
+static struct adv_raw _sd_raw;
+
+static u32_t _num_updates;
+static u32_t _num_suppressed;
+
+/* Written on the workqueue with interrupts locked, see adv_stats_get() */
+static adv_state_t _state = ADV_STATE_OFF;
+static s64_t _state_entered;
+static adv_stats_t _stats;
+
+/* State requested from connection callbacks, applied on the workqueue */
+static atomic_t _requested_state;
+
+/* Set when the controller stopped advertising but a link slot is free */
+static atomic_t _restart_pending;
+
+static atomic_t _num_conns;
+
+static struct k_delayed_work _policy_work;
+static struct k_work _request_work;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static int adv_encode(const struct bt_data *data, size_t count,
+              struct adv_raw *raw)
+{
+    u8_t len = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (len + 2 + data[i].data_len > ADV_DATA_MAX_LEN) {
+            return -EINVAL;
+        }
+
+        raw->data[len++] = data[i].data_len + 1;
+        raw->data[len++] = data[i].type;
+        memcpy(&raw->data[len], data[i].data, data[i].data_len);
+        len += data[i].data_len;
+    }
+
+    raw->len = len;
+
+    return 0;
+}
+
+/**
+* @private
+* @brief Writes advertising or scan response data to the controller
+*
+* LE Set Advertising Data and LE Set Scan Response Data share the same
+* parameter layout, and both may be issued while advertising is enabled.
+*/
+static int adv_hci_set_data(u16_t opcode, const struct adv_raw *raw)
+{
+    struct bt_hci_cp_le_set_adv_data *cp;
+    struct net_buf *buf;
+
+    buf = bt_hci_cmd_create(opcode, sizeof(*cp));
+    if (buf == NULL) {
+        return -ENOBUFS;
+    }
+
+    cp = net_buf_add(buf, sizeof(*cp));
+    memset(cp, 0, sizeof(*cp));
+    memcpy(cp->data, raw->data, raw->len);
+    cp->len = raw->len;
+
+    return bt_hci_cmd_send_sync(opcode, buf, NULL);
+}
+
+/**
+* @private
+* @brief Updates a payload in place if its encoded content has changed
+*/
+static int adv_data_update(u16_t opcode, const struct bt_data *data,
+               size_t count, struct adv_raw *cache)
+{
+    struct adv_raw raw;
+    int err;
+
+    err = adv_encode(data, count, &raw);
+    if (err) {
+        SYS_LOG_ERR("Payload does not fit (err %d)", err);
+        return err;
+    }
+
+    if (raw.len == cache->len && memcmp(raw.data, cache->data, raw.len) == 0) {
+        _num_suppressed++;
+        SYS_LOG_DBG("Unchanged payload suppressed (%u)", _num_suppressed);
+        return 0;
+    }
+
+    err = adv_hci_set_data(opcode, &raw);
+    if (err) {
+        SYS_LOG_ERR("Failed to update payload (err %d)", err);
+        return err;
+    }
+
+    memcpy(cache, &raw, sizeof(raw));
+    _num_updates++;
+
+    return 0;
+}
+
+static size_t beacon_ad_count(void)
+{
+    /* The scannable beacon carries the name in the scan response */
+    if (_mode == NV_ADV_MODE_BEACON_SCANNABLE) {
+        return ARRAY_SIZE(beacon_ad) - 1;
+    }
+
+    return ARRAY_SIZE(beacon_ad);
+}
+
+/**
+* @private
+* @brief Adds the time and estimated events of the current state up to now
+*
+* Events are counted from the start of the state, so a partial event is
+* only dropped when the state ends. Called with interrupts locked.
+*/
+static void adv_state_account(adv_stats_t *stats, s64_t now)
+{
+    const struct adv_policy *policy;
+    s64_t elapsed = now - _state_entered;
+    u32_t period_us;
+
+    stats->time_ms[_state] += elapsed;
+
+    if (_state >= ADV_STATE_OFF) {
+        return;
+    }
+
+    policy = &adv_policy[_state];
+    period_us = (policy->interval_min + policy->interval_max) / 2 * 625 +
+                ADV_DELAY_MEAN_US;
+    stats->events += elapsed * USEC_PER_MSEC / period_us;
+}
+
+/**
+* @private
+* @brief Closes the accounting of the current state and switches state
+*/
+static void adv_state_set(adv_state_t state)
+{
+    unsigned int key = irq_lock();
+    s64_t now = k_uptime_get();
+
+    adv_state_account(&_stats, now);
+    _state_entered = now;
+    _state = state;
+    irq_unlock(key);
+}
+
+static int adv_state_enter(adv_state_t state)
+{
+    const struct adv_policy *policy;
+    int err;
+
+    k_delayed_work_cancel(&_policy_work);
+
+    SYS_LOG_DBG("Advertising state %d -> %d, %u events", _state, state,
+            _stats.events);
+
+    adv_state_set(state);
+
+    if (state == ADV_STATE_OFF) {
+        return 0;
+    }
+
+    policy = &adv_policy[state];
+
+    /* The interval can only be changed while advertising is disabled */
+    bt_le_adv_stop();
+
+    err = bt_le_adv_start(BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE,
+                          policy->interval_min,
+                          policy->interval_max),
+                  ad, ARRAY_SIZE(ad), NULL, 0);
+    if (err) {
+        SYS_LOG_ERR("Advertising failed to start (err %d)", err);
+        adv_state_set(ADV_STATE_OFF);
+        return err;
+    }
+
+    adv_encode(ad, ARRAY_SIZE(ad), &_ad_raw);
+    _sd_raw.len = 0;
+
+    if (policy->duration != K_FOREVER) {
+        k_delayed_work_submit(&_policy_work, policy->duration);
+    }
+
+    return 0;
+}
+
+static void policy_work_handler(struct k_work *work)
+{
+    if (_state < ADV_STATE_ULTRA_SLOW) {
+        adv_state_enter(_state + 1);
+    }
+}
+
+static void request_work_handler(struct k_work *work)
+{
+    adv_state_t state = atomic_get(&_requested_state);
+
+    if (atomic_clear(&_restart_pending) || state != _state) {
+        adv_state_enter(state);
+    }
+}
+
+static void adv_state_request(adv_state_t state)
+{
+    atomic_set(&_requested_state, state);
+    k_work_submit(&_request_work);
+}
+
+static void connected(struct bt_conn *conn, u8_t err)
+{
+    if (err || !_is_started || _mode != NV_ADV_MODE_CONNECTABLE) {
+        return;
+    }
+
+    /* The controller stops connectable advertising on connection */
+    if (atomic_inc(&_num_conns) + 1 >= CONFIG_BT_MAX_CONN) {
+        adv_state_request(ADV_STATE_OFF);
+        return;
+    }
+
+    /* Stay discoverable for a second central, e.g. a maintenance phone */
+    atomic_set(&_restart_pending, 1);
+    adv_state_request(ADV_STATE_FAST);
+}
+
+static void disconnected(struct bt_conn *conn, u8_t reason)
+{
+    if (!_is_started || _mode != NV_ADV_MODE_CONNECTABLE) {
+        return;
+    }
+
+    atomic_dec(&_num_conns);
+    adv_state_request(ADV_STATE_FAST);
+}
+
+static struct bt_conn_cb conn_callbacks = {
+    .connected = connected,
+    .disconnected = disconnected,
+};
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+void adv_init(u8_t mode)
+{
+    _mode = mode;
+
+    k_delayed_work_init(&_policy_work, policy_work_handler);
+    k_work_init(&_request_work, request_work_handler);
+
+    bt_conn_cb_register(&conn_callbacks);
+}
+
+int adv_start(void)
+{
+    int err;
+
+    if (_mode == NV_ADV_MODE_CONNECTABLE) {
+        err = adv_state_enter(ADV_STATE_FAST);
+        if (err) {
+            return err;
+        }
+
+        _is_started = true;
+        atomic_set(&_requested_state, ADV_STATE_FAST);
+        boot_mark(BOOT_ADV_START);
+
+        return 0;
+    }
+
+    if (_mode == NV_ADV_MODE_BEACON_SCANNABLE) {
+        err = bt_le_adv_start(ESS_BEACON, beacon_ad, beacon_ad_count(),
+                      beacon_sd, ARRAY_SIZE(beacon_sd));
+        adv_encode(beacon_ad, beacon_ad_count(), &_ad_raw);
+        adv_encode(beacon_sd, ARRAY_SIZE(beacon_sd), &_sd_raw);
+    } else {
+        err = bt_le_adv_start(ESS_BEACON, beacon_ad, beacon_ad_count(),
+                      NULL, 0);
+        adv_encode(beacon_ad, beacon_ad_count(), &_ad_raw);
+        _sd_raw.len = 0;
+    }
+
+    if (err) {
+        SYS_LOG_ERR("Advertising failed to start (err %d)", err);
+        return err;
+    }
+
+    _is_started = true;
+    boot_mark(BOOT_ADV_START);
+
+    return 0;
+}
+
+/**
+* @brief Returns to fast advertising, e.g. when an alarm is pending
+*/
+void adv_alarm(void)
+{
+    if (!_is_started || _mode != NV_ADV_MODE_CONNECTABLE ||
+        atomic_get(&_requested_state) == ADV_STATE_OFF) {
+        return;
+    }
+
+    adv_state_request(ADV_STATE_FAST);
+}
+
+/**
+* @brief Gets the advertising statistics up to now
+*
+* Safe from any thread; the state itself is only changed on the system
+* workqueue.
+*/
+void adv_stats_get(adv_stats_t *stats)
+{
+    unsigned int key = irq_lock();
+
+    memcpy(stats, &_stats, sizeof(*stats));
+    adv_state_account(stats, k_uptime_get());
+    irq_unlock(key);
+
+    stats->charge_uc = (u64_t)stats->events * ADV_EVENT_CHARGE_NC / 1000;
+}
+
+void adv_battery_update(u8_t capacity)
+{
+    batt[2] = capacity;
+
+    if (!_is_started || _mode != NV_ADV_MODE_CONNECTABLE) {
+        return;
+    }
+
+    adv_data_update(BT_HCI_OP_LE_SET_ADV_DATA, ad, ARRAY_SIZE(ad), &_ad_raw);
+}
+
+void adv_beacon_update(const u8_t *data, u8_t len)
+{
+    memcpy(beacon_data, data, len);
+    beacon_ad[1].data_len = len;
+
+    if (_mode == NV_ADV_MODE_CONNECTABLE) {
+        return;
+    }
+
+    /* Beacon advertising starts with the first payload */
+    if (!_is_started) {
+        adv_start();
+        return;
+    }
+
+    adv_data_update(BT_HCI_OP_LE_SET_ADV_DATA, beacon_ad, beacon_ad_count(),
+            &_ad_raw);
+}
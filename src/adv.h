@@ -0,0 +1,45 @@
+/** @file
+ *  @brief Advertising manager
+ *
+ *  Owns the advertising set of the application. Payload changes are
+ *  written to the controller in place, without stopping advertising, and
+ *  are suppressed entirely when the encoded payload is unchanged.
+ */
+
+#ifndef ADV_H
+#define ADV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+/* Connectable advertising policy states, fastest first */
+typedef enum {
+    ADV_STATE_FAST,
+    ADV_STATE_MEDIUM,
+    ADV_STATE_SLOW,
+    ADV_STATE_ULTRA_SLOW,
+    ADV_STATE_OFF,
+    ADV_STATE_COUNT,
+} adv_state_t;
+
+typedef struct {
+    u64_t time_ms[ADV_STATE_COUNT];
+    u32_t events;       /* Estimated number of advertising events */
+    u32_t charge_uc;    /* Estimated advertising charge, uC */
+} adv_stats_t;
+
+void adv_init(u8_t mode);
+int adv_start(void);
+void adv_alarm(void);
+void adv_stats_get(adv_stats_t *stats);
+void adv_battery_update(u8_t capacity);
+void adv_beacon_update(const u8_t *data, u8_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ADV_H */
@@ -11,17 +11,26 @@
 #include "als.h"
 #include "nv.h"
 #include "ess.h"
+#include "retained.h"
+#include "dev_pm.h"
+#include "sens_fetch.h"
+#include "energy.h"
+#include "probe.h"
+#include "trace.h"
+#include "metrics.h"
 
 #define CONFIG_SYS_LOG_ALS_LEVEL 1
 #define SYS_LOG_DOMAIN "als"
 #define SYS_LOG_LEVEL CONFIG_SYS_LOG_ALS_LEVEL
 #include <logging/sys_log.h>
+#include "blog.h"
 
 
 static struct device *tsl4531_dev;
 static struct sensor_value als_val;
 static struct k_timer meas_timer;
 static struct k_work meas_work;
+static bool _is_initialized;
 static als_meas_cb_t meas_cb;
 
 static nv_sensor_data_t _default_sensor_data = {
@@ -30,6 +39,7 @@ static nv_sensor_data_t _default_sensor_data = {
     .update_interval  = 60,
     .application      = ESS_APPL_Air,
     .meas_uncertainty = 0,
+    .max_age          = 30,
 };
 
 static void meas_work_handler(struct k_work *work);
@@ -38,23 +48,55 @@ static void meas_timer_handler(struct k_timer *timer);
 
 static void meas_work_handler(struct k_work *work)
 {
+    u32_t start = probe_start();
+
+    metrics_wakeup();
+
     SYS_LOG_DBG("Periodic als measurement");
-    als_meas();
 
-    if (meas_cb != NULL) {
+    /* A failed sample is not published, the readings keep the last one */
+    if (als_meas() == 0 && meas_cb != NULL) {
         meas_cb(&als_val);
     }
+
+    probe_end(PROBE_ALS_WORK, start);
 }
 
 static void meas_timer_handler(struct k_timer *timer)
 {
+    trace_event(TRACE_TIMER, PROBE_ALS_WORK, 0);
     k_work_submit(&meas_work);
 }
 
+/**
+* @brief Starts a measurement outside the periodic schedule
+*
+* The result is delivered through the measurement callback.
+*/
+int als_request(void)
+{
+    if (!_is_initialized) {
+        return -ENODEV;
+    }
+
+    k_work_submit(&meas_work);
+
+    return 0;
+}
+
 int als_meas(void)
 {
 #ifdef CONFIG_TSL4531
-    if (sensor_sample_fetch(tsl4531_dev)) {
+    int err;
+    u32_t start = k_cycle_get_32();
+
+    /* No retry, it would keep the rail on for another 420 ms conversion */
+    err = sens_fetch(tsl4531_dev, 1);
+
+    energy_time_add(ENERGY_TSL4531, k_cycle_get_32() - start);
+    probe_end(PROBE_TSL4531_FETCH, start);
+
+    if (err) {
         SYS_LOG_ERR("Error fetching tsl4531 sample");
         return -1;
     }
@@ -67,7 +109,7 @@ int als_meas(void)
         //             (int)(sensor_value_to_double(&als_val) * 100) % 100);
         // SYS_LOG_DBG("RH1:%d", rh_sensor_value.val1);
         // SYS_LOG_DBG("RH2:%d", rh_sensor_value.val2);
-        SYS_LOG_INF("ALS:%d.%06d", als_val.val1, als_val.val2);
+        BLOG_INF("ALS:%d.%06d", als_val.val1, als_val.val2);
     }
 #endif
     return 0;
@@ -78,14 +120,21 @@ void als_init(als_meas_cb_t callback)
 #ifdef CONFIG_TSL4531
     int err;
     nv_sensor_data_t sensor_data;
+    struct device *rail_dev;
 
     meas_cb = callback;
 
     tsl4531_dev = device_get_binding(CONFIG_TSL4531_NAME);
     if (tsl4531_dev == NULL) {
         SYS_LOG_ERR("Failed to get pointer to %s device!", CONFIG_TSL4531_NAME);
+        return;
     }
 
+    // Powered from the switched rail, which is off between samples
+    rail_dev = device_get_binding(CONFIG_I2C_WRAP_NAME);
+    dev_pm_add(rail_dev, NULL);
+    dev_pm_add(tsl4531_dev, rail_dev);
+
     err = nv_get_sensor_data(NV_SENSOR_AMBIENT_LIGHT, &sensor_data);
     if (err == -ENOENT) {
         nv_set_sensor_data(NV_SENSOR_AMBIENT_LIGHT, &_default_sensor_data);
@@ -93,7 +142,12 @@ void als_init(als_meas_cb_t callback)
     }
 
     k_work_init(&meas_work, meas_work_handler);
+    _is_initialized = true;
     k_timer_init(&meas_timer, meas_timer_handler, NULL);
-    k_timer_start(&meas_timer, K_SECONDS(5), K_SECONDS(sensor_data.update_interval));
+    k_timer_start(&meas_timer,
+                  retained_first_delay(READINGS_CH_AMBIENT_LIGHT,
+                                       K_SECONDS(sensor_data.update_interval),
+                                       K_SECONDS(5)),
+                  K_SECONDS(sensor_data.update_interval));
 #endif
 }
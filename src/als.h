@@ -10,5 +10,6 @@ typedef void (*als_meas_cb_t)(struct sensor_value *ambient_light);
 
 void als_init(als_meas_cb_t callback);
 int als_meas(void);
+int als_request(void);
 
 #endif /* ALS_H */
@@ -22,6 +22,9 @@
 #include <bluetooth/uuid.h>
 #include <bluetooth/gatt.h>
 
+#include "notify.h"
+#include "ccc_store.h"
+
 static struct bt_gatt_ccc_cfg  blvl_ccc_cfg[BT_GATT_CCC_MAX] = {};
 static u8_t is_notify_enabled;
 static u8_t battery = 100;
@@ -30,6 +33,7 @@ static void blvl_ccc_cfg_changed(const struct bt_gatt_attr *attr,
                  u16_t value)
 {
     is_notify_enabled = (value == BT_GATT_CCC_NOTIFY) ? 1 : 0;
+    ccc_store_changed();
 }
 
 static ssize_t read_blvl(struct bt_conn *conn, const struct bt_gatt_attr *attr,
@@ -55,15 +59,20 @@ static struct bt_gatt_service bas_svc = BT_GATT_SERVICE(attrs);
 void bas_init(void)
 {
     bt_gatt_service_register(&bas_svc);
+    ccc_store_register("bas", blvl_ccc_cfg, ARRAY_SIZE(blvl_ccc_cfg));
 }
 
 void bas_update(uint8_t capacity)
 {
+    if (capacity == battery) {
+        return;
+    }
+
     battery = capacity;
 
     if (!is_notify_enabled) {
         return;
     }
 
-    bt_gatt_notify(NULL, &attrs[2], &battery, sizeof(battery));
+    notify_submit_all(&attrs[2], blvl_ccc_cfg, &battery, sizeof(battery));
 }
@@ -0,0 +1,172 @@
+/** @file
+ *  @brief Sensor broadcast (beacon) payload
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <misc/byteorder.h>
+#include <zephyr.h>
+
+#include "beacon.h"
+
+#define SYS_LOG_DOMAIN "beacon"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+struct beacon_readings {
+    s16_t temperature;
+    u16_t humidity;
+    u16_t ambient_light;
+    u32_t pressure;
+    u8_t battery;
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static struct beacon_readings _readings = {
+    .battery = 100,
+};
+
+static beacon_update_cb_t _update_cb;
+static u16_t _update_interval;
+static bool _use_counter;
+static u32_t _counter;
+
+static struct k_timer _update_timer;
+static struct k_work _update_work;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static void update_work_handler(struct k_work *work)
+{
+    u8_t data[BEACON_DATA_MAX_LEN];
+    u8_t len;
+
+    len = beacon_encode(data, sizeof(data));
+    if (len == 0) {
+        SYS_LOG_ERR("Failed to encode beacon payload");
+        return;
+    }
+
+    if (_update_cb != NULL) {
+        _update_cb(data, len);
+    }
+}
+
+static void update_timer_handler(struct k_timer *timer)
+{
+    k_work_submit(&_update_work);
+}
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Encodes the latest readings as manufacturer specific data
+*
+* Every call produces a new payload, so the replay counter (if enabled)
+* is advanced on each call.
+*
+* @return Number of bytes written, or 0 if @p len is too small
+*/
+u8_t beacon_encode(u8_t *buf, size_t len)
+{
+    u8_t *p = buf;
+
+    if (len < BEACON_DATA_MAX_LEN) {
+        return 0;
+    }
+
+    sys_put_le16(CONFIG_WALNUT_BEACON_COMPANY_ID, p);
+    p += 2;
+
+    *p++ = BEACON_FORMAT_VERSION;
+    *p++ = _use_counter ? BEACON_FLAG_COUNTER : 0;
+
+    if (_use_counter) {
+        sys_put_le32(++_counter, p);
+        p += 4;
+    }
+
+    sys_put_le16(_readings.temperature, p);
+    p += 2;
+    sys_put_le16(_readings.humidity, p);
+    p += 2;
+    sys_put_le16(_readings.ambient_light, p);
+    p += 2;
+
+    *p++ = _readings.pressure & 0xff;
+    *p++ = (_readings.pressure >> 8) & 0xff;
+    *p++ = (_readings.pressure >> 16) & 0xff;
+
+    *p++ = _readings.battery;
+
+    return p - buf;
+}
+
+void beacon_init(u16_t update_interval, bool replay_counter,
+                 beacon_update_cb_t cb)
+{
+    _update_cb = cb;
+    _update_interval = update_interval ? update_interval :
+                       BEACON_UPDATE_INTERVAL_DEFAULT;
+    _use_counter = replay_counter;
+
+    k_work_init(&_update_work, update_work_handler);
+    k_timer_init(&_update_timer, update_timer_handler, NULL);
+}
+
+void beacon_start(void)
+{
+    SYS_LOG_INF("Beacon updates every %ds", _update_interval);
+
+    k_timer_start(&_update_timer, K_NO_WAIT, K_SECONDS(_update_interval));
+}
+
+void beacon_stop(void)
+{
+    k_timer_stop(&_update_timer);
+}
+
+void beacon_temperature_update(s16_t temperature)
+{
+    _readings.temperature = temperature;
+}
+
+void beacon_humidity_update(u16_t humidity)
+{
+    _readings.humidity = humidity;
+}
+
+void beacon_als_update(u16_t ambient_light)
+{
+    _readings.ambient_light = ambient_light;
+}
+
+void beacon_baro_press_update(u32_t pressure)
+{
+    _readings.pressure = pressure;
+}
+
+void beacon_battery_update(u8_t battery)
+{
+    _readings.battery = battery;
+}
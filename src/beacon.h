@@ -0,0 +1,62 @@
+/** @file
+ *  @brief Sensor broadcast (beacon) payload
+ *
+ *  Encodes the latest readings into manufacturer specific data so that
+ *  passive scanners can collect them without connecting. The layout is
+ *  walnut's own, so it is not sent as Environmental Sensing service data.
+ *
+ *  Layout (little endian, after the CONFIG_WALNUT_BEACON_COMPANY_ID
+ *  company identifier):
+ *
+ *  | Size | Field                                        |
+ *  |------|----------------------------------------------|
+ *  | 1    | Format version (BEACON_FORMAT_VERSION)       |
+ *  | 1    | Flags (BEACON_FLAG_*)                        |
+ *  | 4    | Replay counter, only if BEACON_FLAG_COUNTER  |
+ *  | 2    | Temperature, 0.01 degC                       |
+ *  | 2    | Humidity, 0.01 %                             |
+ *  | 2    | Ambient light, 0.01 lux                      |
+ *  | 3    | Pressure, 0.1 Pa                             |
+ *  | 1    | Battery, %                                   |
+ */
+
+#ifndef BEACON_H
+#define BEACON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+#define BEACON_FORMAT_VERSION       1
+
+#define BEACON_FLAG_COUNTER         0x01
+
+/* Largest encoded payload, including the company identifier */
+#define BEACON_DATA_MAX_LEN         18
+
+#define BEACON_UPDATE_INTERVAL_DEFAULT  CONFIG_WALNUT_BEACON_UPDATE_INTERVAL
+
+typedef void (*beacon_update_cb_t)(const u8_t *data, u8_t len);
+
+void beacon_init(u16_t update_interval, bool replay_counter,
+                 beacon_update_cb_t cb);
+void beacon_start(void);
+void beacon_stop(void);
+
+void beacon_temperature_update(s16_t temperature);
+void beacon_humidity_update(u16_t humidity);
+void beacon_als_update(u16_t ambient_light);
+void beacon_baro_press_update(u32_t pressure);
+void beacon_battery_update(u8_t battery);
+
+u8_t beacon_encode(u8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BEACON_H */
@@ -12,6 +12,7 @@
 #include <misc/printk.h>
 #include <misc/byteorder.h>
 #include <zephyr.h>
+#include <settings/settings.h>
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
@@ -22,14 +23,24 @@
 #include "bas.h"
 #include "dis.h"
 #include "ess.h"
+#include "climate.h"
+#include "burst.h"
+#include "beacon.h"
+#include "adv.h"
+#include "conn_param.h"
+#include "notify.h"
+#include "nv.h"
+#include "readings.h"
+#include "boot.h"
+#include "ccc_store.h"
+#include "gatt_db.h"
+#include "diag.h"
+#include "metrics.h"
 
 #define SYS_LOG_DOMAIN "BLE"
 // #define SYS_LOG_LEVEL CONFIG_SYS_LOG_SENSOR_LEVEL
 #include <logging/sys_log.h>
 
-#define DEVICE_NAME				CONFIG_BT_DEVICE_NAME
-#define DEVICE_NAME_LEN				(sizeof(DEVICE_NAME) - 1)
-
 #ifndef BUILD_VERSION
 #define BUILD_VERSION UNKNOWN
 #endif
@@ -37,17 +48,31 @@
 #define DEVICE_SOFTWARE_VERSION     STRINGIFY(BUILD_VERSION)
 #define DEVICE_HARDWARE_VERSION     STRINGIFY(BOARD_VARIANT)
 
-#define ESS_ADV_SLOW BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE, \
-                       BT_GAP_ADV_SLOW_INT_MIN, \
-                       BT_GAP_ADV_SLOW_INT_MAX)
+#if defined(CONFIG_WALNUT_ADV_MODE_BEACON)
+#define BLE_ADV_MODE                NV_ADV_MODE_BEACON
+#elif defined(CONFIG_WALNUT_ADV_MODE_BEACON_SCANNABLE)
+#define BLE_ADV_MODE                NV_ADV_MODE_BEACON_SCANNABLE
+#else
+#define BLE_ADV_MODE                NV_ADV_MODE_CONNECTABLE
+#endif
 
-#define ESS_ADV_FAST_1 BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE, \
-                       BT_GAP_ADV_FAST_INT_MIN_1, \
-                       BT_GAP_ADV_FAST_INT_MAX_1)
+#ifdef CONFIG_WALNUT_BEACON_REPLAY_COUNTER
+#define BLE_BEACON_REPLAY_COUNTER   1
+#else
+#define BLE_BEACON_REPLAY_COUNTER   0
+#endif
+
+// Default advertising configuration, used until one is stored in NV
+static nv_device_data_t default_device_data = {
+    .adv_interval           = 0,
+    .adv_mode               = BLE_ADV_MODE,
+    .beacon_update_interval = BEACON_UPDATE_INTERVAL_DEFAULT,
+    .beacon_replay_counter  = BLE_BEACON_REPLAY_COUNTER,
+};
 
-#define ESS_ADV_FAST_2 BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE, \
-                       BT_GAP_ADV_FAST_INT_MIN_2, \
-                       BT_GAP_ADV_FAST_INT_MAX_2)
+static nv_device_data_t device_data;
+
+static bool _connected_once;
 
 // Default Device Information Service data
 static dis_data_t dis_data = {
@@ -56,66 +81,31 @@ static dis_data_t dis_data = {
 };
 
 
-static uint8_t batt[3] = { 0x0f, 0x18, 0x00 };
-
-static struct bt_data ad[] = {
-    BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
-    BT_DATA_BYTES(BT_DATA_UUID16_SOME, 0x1a, 0x18),
-    BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
-    BT_DATA(BT_DATA_SVC_DATA16, batt, 3),
-};
-
-// static struct bt_data sd[] = {
-//     BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
-// };
-
 static void connected(struct bt_conn *conn, u8_t err)
 {
     if (err) {
         SYS_LOG_ERR("Connection failed (err %u)", err);
     } else {
         SYS_LOG_DBG("Connected");
+        conn_param_connected(conn);
 
-
-    // struct bt_le_conn_param param = {
-    //     .interval_min = 24,
-    //     // .interval_max = 40,
-    //     .interval_max = 100,
-    //     .latency = 0,
-    //     .timeout = 400,
-    // };
-    // bt_conn_le_param_update(conn, &param);
-
-    struct bt_conn_info info;
-    bt_conn_get_info(conn, &info);
-
-    struct bt_conn_le_info *le = &info.le;
-
-    SYS_LOG_INF("Interval:%d", le->interval);
-    SYS_LOG_INF("Latency:%d", le->latency);
-    SYS_LOG_INF("Timeout:%d", le->timeout);
-
-        // struct bt_le_conn_param param = {
-        //     .interval_min = 24,
-        //     .interval_max = 40,
-        //     .latency = 0,
-        //     .timeout = 400,
-        // };
-        // bt_conn_le_param_update(conn, &param);
+        if (_connected_once) {
+            metrics_inc(METRIC_RECONNECTS);
+        }
+        _connected_once = true;
     }
 }
 
 static void disconnected(struct bt_conn *conn, u8_t reason)
 {
     SYS_LOG_DBG("Disconnected (reason %u)", reason);
+    conn_param_disconnected(conn);
 }
 
 static void le_param_updated(struct bt_conn *conn, u16_t interval,
                 u16_t latency, u16_t timeout)
 {
-    SYS_LOG_INF("U:Interval:%d", interval);
-    SYS_LOG_INF("U:Latency:%d", latency);
-    SYS_LOG_INF("U:Timeout:%d", timeout);
+    conn_param_updated(conn, interval, latency, timeout);
 }
 
 static struct bt_conn_cb conn_callbacks = {
@@ -132,16 +122,40 @@ static void bt_ready(int err)
     }
 
     SYS_LOG_INF("Bluetooth initialized");
+    boot_mark(BOOT_BT_READY);
+
+    /*
+     * Registration order defines the attribute handles that gateways
+     * cache; new services go at the end. Any change to the layout
+     * changes the database hash.
+     */
+    ccc_store_init();
+    gatt_db_init();
 
     dis_init(&dis_data);
     ess_init();
     bas_init();
+#ifdef CONFIG_WALNUT_CLIMATE_SVC
+    climate_init();
+#endif
+#ifdef CONFIG_WALNUT_BURST_SVC
+    burst_init();
+#endif
+#ifdef CONFIG_WALNUT_DIAG_SVC
+    diag_init();
+#endif
+
+    /* Bond keys and the CCC values of bonded peers */
+    settings_load();
+
+    if (device_data.adv_mode != NV_ADV_MODE_CONNECTABLE) {
+        /* Advertising starts with the first beacon payload */
+        beacon_start();
+        return;
+    }
 
-    err = bt_le_adv_start(ESS_ADV_SLOW, ad, ARRAY_SIZE(ad),
-                //   sd, ARRAY_SIZE(sd));
-                  NULL, 0);
+    err = adv_start();
     if (err) {
-        SYS_LOG_ERR("Advertising failed to start (err %d)", err);
         return;
     }
 
@@ -172,47 +186,126 @@ static struct bt_conn_auth_cb auth_cb_display = {
     .cancel = auth_cancel,
 };
 
-static void adv_update(uint8_t batt_capacity)
+void ble_update_temp(double temperature)
 {
-    int err;
+    readings_t *readings = readings_begin();
 
-    err = bt_le_adv_stop();
-    if (err) {
-        SYS_LOG_ERR("Failed to stop advertising");
-    }
+    readings->temperature = (int16_t)(100 * temperature);
+    readings_commit(readings, READINGS_TEMPERATURE);
 
-    batt[2] = batt_capacity;
-
-    err = bt_le_adv_start(ESS_ADV_SLOW, ad, ARRAY_SIZE(ad), NULL, 0);
-    if (err) {
-        SYS_LOG_ERR("start error");
-    }
-}
-
-void ble_update_temp(double temperature)
-{
     ess_temperature_update((int16_t)(100 * temperature));
+    beacon_temperature_update((int16_t)(100 * temperature));
+#ifdef CONFIG_WALNUT_CLIMATE_SVC
+    climate_temperature_update((int16_t)(100 * temperature));
+#endif
 }
 
 void ble_update_humidity(double humidity)
 {
+    readings_t *readings = readings_begin();
+
+    readings->humidity = (uint16_t)(100 * humidity);
+    readings_commit(readings, READINGS_HUMIDITY);
+
     ess_humidity_update((int16_t)(100 * humidity));
+    beacon_humidity_update((uint16_t)(100 * humidity));
+#ifdef CONFIG_WALNUT_CLIMATE_SVC
+    climate_humidity_update((uint16_t)(100 * humidity));
+#endif
 }
 
 void ble_update_ambient_light(double ambient_light)
 {
-    ess_als_update((int16_t)(100 * ambient_light));
+    readings_t *readings = readings_begin();
+    u16_t als = readings_als_from_lux(ambient_light);
+
+    readings->ambient_light = als;
+    readings_commit(readings, READINGS_AMBIENT_LIGHT);
+
+    ess_als_update(als);
+    beacon_als_update(als);
+#ifdef CONFIG_WALNUT_CLIMATE_SVC
+    climate_als_update(als);
+#endif
 }
 
 void ble_update_baro_pressure(double pressure)
 {
+    readings_t *readings = readings_begin();
+
+    readings->pressure = (uint32_t)(10000 * pressure);
+    readings_commit(readings, READINGS_BARO_PRESSURE);
+
     ess_baro_press_update((uint32_t)(10000 * pressure));
+    beacon_baro_press_update((uint32_t)(10000 * pressure));
+#ifdef CONFIG_WALNUT_CLIMATE_SVC
+    climate_baro_press_update((uint32_t)(10000 * pressure));
+#endif
 }
 
 void ble_update_battery(uint8_t battery_capacity)
 {
-    adv_update(battery_capacity);
+    readings_t *readings = readings_begin();
+
+    readings->battery = battery_capacity;
+    readings_commit(readings, READINGS_BATTERY);
+
+    adv_battery_update(battery_capacity);
     bas_update(battery_capacity);
+    beacon_battery_update(battery_capacity);
+#ifdef CONFIG_WALNUT_CLIMATE_SVC
+    climate_battery_update(battery_capacity);
+#endif
+}
+
+/**
+* @brief Seeds the services with readings restored after a warm start
+*
+* Unlike the ble_update_* functions the snapshot is not republished, so
+* the restored values keep their age.
+*/
+void ble_restore(const readings_t *readings)
+{
+    if (readings->valid & READINGS_TEMPERATURE) {
+        ess_temperature_update(readings->temperature);
+        beacon_temperature_update(readings->temperature);
+#ifdef CONFIG_WALNUT_CLIMATE_SVC
+        climate_temperature_update(readings->temperature);
+#endif
+    }
+
+    if (readings->valid & READINGS_HUMIDITY) {
+        ess_humidity_update(readings->humidity);
+        beacon_humidity_update(readings->humidity);
+#ifdef CONFIG_WALNUT_CLIMATE_SVC
+        climate_humidity_update(readings->humidity);
+#endif
+    }
+
+    if (readings->valid & READINGS_AMBIENT_LIGHT) {
+        ess_als_update(readings->ambient_light);
+        beacon_als_update(readings->ambient_light);
+#ifdef CONFIG_WALNUT_CLIMATE_SVC
+        climate_als_update(readings->ambient_light);
+#endif
+    }
+
+    if (readings->valid & READINGS_BARO_PRESSURE) {
+        ess_baro_press_update(readings->pressure);
+        beacon_baro_press_update(readings->pressure);
+#ifdef CONFIG_WALNUT_CLIMATE_SVC
+        climate_baro_press_update(readings->pressure);
+#endif
+    }
+
+    if (readings->valid & READINGS_BATTERY) {
+        adv_battery_update(readings->battery);
+        bas_update(readings->battery);
+        beacon_battery_update(readings->battery);
+#ifdef CONFIG_WALNUT_CLIMATE_SVC
+        climate_battery_update(readings->battery);
+#endif
+    }
 }
 
 void ble_init(void)
@@ -221,6 +314,21 @@ void ble_init(void)
 
     SYS_LOG_INF("Initializing BLE");
 
+    err = nv_get_device_data(&device_data);
+    if (err == -ENOENT) {
+        nv_set_device_data(&default_device_data);
+        nv_get_device_data(&device_data);
+    }
+
+    SYS_LOG_INF("Advertising mode %u, beacon interval %us",
+                device_data.adv_mode, device_data.beacon_update_interval);
+
+    beacon_init(device_data.beacon_update_interval,
+            device_data.beacon_replay_counter, adv_beacon_update);
+    adv_init(device_data.adv_mode);
+    conn_param_init();
+    notify_init();
+
     err = bt_enable(bt_ready);
     if (err) {
         SYS_LOG_ERR("Bluetooth init failed (err %d)", err);
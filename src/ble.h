@@ -5,6 +5,8 @@
 #ifndef BLE_H
 #define BLE_H
 
+#include "readings.h"
+
 void ble_init(void);
 
 void ble_update_temp(double temperature);
@@ -12,5 +14,6 @@ void ble_update_humidity(double humidity);
 void ble_update_ambient_light(double ambient_light);
 void ble_update_baro_pressure(double pressure);
 void ble_update_battery(uint8_t battery_capacity);
+void ble_restore(const readings_t *readings);
 
 #endif /* BLE_H */
\ No newline at end of file
@@ -0,0 +1,165 @@
+/** @file
+ *  @brief Binary dictionary logging
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <zephyr.h>
+#include <ring_buffer.h>
+#include <misc/byteorder.h>
+
+#ifdef CONFIG_HAS_SEGGER_RTT
+#include <rtt/SEGGER_RTT.h>
+#endif
+
+#define SYS_LOG_DOMAIN "blog"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+#include "blog.h"
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Ring buffer of 2^7 words */
+#define BLOG_RING_SIZE_POW      7
+
+#define BLOG_RTT_CHANNEL        1
+#define BLOG_RTT_BUF_SIZE       256
+
+#define BLOG_STACK_SIZE         512
+
+/* Frame: magic, level and argument count, id, timestamp, arguments */
+#define BLOG_MAGIC              0xb1
+#define BLOG_HEADER_LEN         8
+#define BLOG_FRAME_MAX          (BLOG_HEADER_LEN + BLOG_ARGS_MAX * 4)
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+SYS_RING_BUF_DECLARE_POW2(_ring, BLOG_RING_SIZE_POW);
+
+static K_SEM_DEFINE(_pending, 0, 1);
+
+static u32_t _dropped;
+
+#ifdef CONFIG_HAS_SEGGER_RTT
+static u8_t _rtt_buf[BLOG_RTT_BUF_SIZE];
+#endif
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static void frame_write(u16_t id, u8_t value, const u32_t *data, u8_t size32)
+{
+    u8_t frame[BLOG_FRAME_MAX];
+    u8_t *p = frame;
+
+    frame[0] = BLOG_MAGIC;
+    frame[1] = value;
+    sys_put_le16(id, &frame[2]);
+    p += 4;
+
+    /* Timestamp first, then the arguments */
+    for (int i = 0; i < size32; i++) {
+        sys_put_le32(data[i], p);
+        p += 4;
+    }
+
+#ifdef CONFIG_HAS_SEGGER_RTT
+    /* Skipped whole when the host is not reading fast enough */
+    SEGGER_RTT_Write(BLOG_RTT_CHANNEL, frame, p - frame);
+#endif
+}
+
+/**
+* @private
+* @brief Drains the ring buffer whenever no other thread is ready
+*/
+static void blog_thread(void *p1, void *p2, void *p3)
+{
+    u32_t data[1 + BLOG_ARGS_MAX];
+    u32_t dropped;
+    u16_t id;
+    u8_t value;
+    u8_t size32;
+    unsigned int key;
+    int err;
+
+#ifdef CONFIG_HAS_SEGGER_RTT
+    SEGGER_RTT_ConfigUpBuffer(BLOG_RTT_CHANNEL, "blog", _rtt_buf,
+                  sizeof(_rtt_buf), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+#endif
+
+    while (1) {
+        k_sem_take(&_pending, K_FOREVER);
+
+        while (1) {
+            size32 = ARRAY_SIZE(data);
+
+            key = irq_lock();
+            err = sys_ring_buf_get(&_ring, &id, &value, data, &size32);
+            dropped = _dropped;
+            _dropped = 0;
+            irq_unlock(key);
+
+            if (dropped) {
+                data[0] = k_uptime_get_32();
+                data[1] = dropped;
+                frame_write(BLOG_ID_DROPPED, (2 << 4) | 1, data, 2);
+            }
+
+            if (err) {
+                break;
+            }
+
+            frame_write(id, value, data, size32);
+        }
+    }
+}
+
+K_THREAD_DEFINE(blog_tid, BLOG_STACK_SIZE, blog_thread, NULL, NULL, NULL,
+        K_LOWEST_APPLICATION_THREAD_PRIO, 0, K_NO_WAIT);
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Queues a message, use the BLOG_* macros instead
+*
+* Safe from any thread and from interrupts. A message that does not fit
+* is counted and reported as dropped once there is room again.
+*/
+void blog_put(u8_t level, const char *fmt, const u32_t *args, u8_t num_args)
+{
+    u32_t data[1 + BLOG_ARGS_MAX];
+    unsigned int key;
+
+    num_args = min(num_args, BLOG_ARGS_MAX);
+
+    data[0] = k_uptime_get_32();
+    memcpy(&data[1], args, num_args * sizeof(u32_t));
+
+    /* The string address is its offset in the unloaded section */
+    key = irq_lock();
+    if (sys_ring_buf_put(&_ring, (u16_t)(u32_t)fmt,
+                 (level << 4) | num_args, data, 1 + num_args)) {
+        _dropped++;
+    }
+    irq_unlock(key);
+
+    k_sem_give(&_pending);
+}
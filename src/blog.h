@@ -0,0 +1,62 @@
+/** @file
+ *  @brief Binary dictionary logging
+ *
+ *  Deferred logging for hot paths. A message is stored as the id of its
+ *  format string plus the raw arguments; the lowest priority thread drains
+ *  the messages to RTT channel 1 when nothing else runs, and
+ *  scripts/blog_decode.py rebuilds the text from the ELF file.
+ *
+ *  The format strings live in a section that is not loaded, so they cost
+ *  no flash. Arguments are stored as u32: integers and characters only,
+ *  no strings or floating point.
+ *
+ *  Include after defining SYS_LOG_DOMAIN and SYS_LOG_LEVEL.
+ */
+
+#ifndef BLOG_H
+#define BLOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+#include <misc/util.h>
+
+/* Largest number of arguments per message */
+#define BLOG_ARGS_MAX           8
+
+/* Message id of the record of dropped messages */
+#define BLOG_ID_DROPPED         0xffff
+
+/*
+ * custom-sections.ld links this section at address 0 and not allocated;
+ * the compiler cannot set those flags from C.
+ */
+#define BLOG_SECTION            ".blog_fmt"
+
+void blog_put(u8_t level, const char *fmt, const u32_t *args, u8_t num_args);
+
+#define BLOG(_level, _fmt, ...)                                             \
+    do {                                                                    \
+        if (SYS_LOG_LEVEL >= (_level)) {                                    \
+            static const char _blog_fmt[]                                   \
+                __attribute__((section(BLOG_SECTION))) =                    \
+                SYS_LOG_DOMAIN ": " _fmt;                                   \
+            const u32_t _blog_args[] = { 0, ##__VA_ARGS__ };                \
+                                                                            \
+            blog_put(_level, _blog_fmt, &_blog_args[1],                     \
+                     ARRAY_SIZE(_blog_args) - 1);                           \
+        }                                                                   \
+    } while (0)
+
+#define BLOG_ERR(...)           BLOG(1, __VA_ARGS__)
+#define BLOG_WRN(...)           BLOG(2, __VA_ARGS__)
+#define BLOG_INF(...)           BLOG(3, __VA_ARGS__)
+#define BLOG_DBG(...)           BLOG(4, __VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BLOG_H */
@@ -0,0 +1,106 @@
+/** @file
+ *  @brief Boot stage timing
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <zephyr.h>
+
+#include "boot.h"
+
+#define SYS_LOG_DOMAIN "boot"
+#define SYS_LOG_LEVEL 3
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static const char * const _stage_names[BOOT_STAGE_COUNT] = {
+    [BOOT_MAIN]         = "main",
+    [BOOT_RETAINED]     = "retained",
+    [BOOT_NV]           = "nv",
+    [BOOT_BT_ENABLE]    = "bt_enable",
+    [BOOT_BT_READY]     = "bt_ready",
+    [BOOT_ADV_START]    = "adv_start",
+    [BOOT_SENSORS]      = "sensors",
+    [BOOT_FIRST_SAMPLE] = "first_sample",
+};
+
+/* Cycle counter when each stage was reached, 0 if not yet */
+static atomic_t _cycles[BOOT_STAGE_COUNT];
+
+static atomic_t _reported;
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Records that a stage has been reached
+*
+* Only the first call per stage counts, so marks can sit on paths that run
+* again later, e.g. advertising restarts. Callable from any thread.
+*/
+void boot_mark(boot_stage_t stage)
+{
+    u32_t cycles = k_cycle_get_32();
+
+    if (stage >= BOOT_STAGE_COUNT) {
+        return;
+    }
+
+    /* 0 means unset; a stage really reached at cycle 0 shifts by one tick */
+    atomic_cas(&_cycles[stage], 0, cycles ? cycles : 1);
+}
+
+/**
+* @brief Returns the time from kernel start to a stage, ms
+*
+* @return 0 if the stage has not been reached
+*/
+u32_t boot_stage_ms(boot_stage_t stage)
+{
+    if (stage >= BOOT_STAGE_COUNT || _cycles[stage] == 0) {
+        return 0;
+    }
+
+    return (u32_t)(SYS_CLOCK_HW_CYCLES_TO_NS64((u32_t)_cycles[stage]) /
+                   NSEC_PER_MSEC);
+}
+
+/**
+* @brief Logs the time spent per stage once the boot has completed
+*
+* Does nothing until the first sample is in and after the first report,
+* so it can be called periodically.
+*/
+void boot_report(void)
+{
+    u32_t prev = 0;
+    u32_t ms;
+
+    if (_cycles[BOOT_FIRST_SAMPLE] == 0 || !atomic_cas(&_reported, 0, 1)) {
+        return;
+    }
+
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        if (_cycles[i] == 0) {
+            SYS_LOG_INF("%-12s      -", _stage_names[i]);
+            continue;
+        }
+
+        /* Stages on other threads can finish out of order */
+        ms = boot_stage_ms(i);
+        SYS_LOG_INF("%-12s %6u ms (+%u)", _stage_names[i], ms,
+                    ms > prev ? ms - prev : 0);
+        prev = ms;
+    }
+}
@@ -0,0 +1,37 @@
+/** @file
+ *  @brief Boot stage timing
+ *
+ *  Records when each stage of the start-up sequence is first reached and
+ *  logs the time spent per stage once the first sample has been published.
+ */
+
+#ifndef BOOT_H
+#define BOOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+typedef enum {
+    BOOT_MAIN,          /* main() entered, kernel and drivers up */
+    BOOT_RETAINED,      /* Retained state checked */
+    BOOT_NV,            /* Flash storage mounted */
+    BOOT_BT_ENABLE,     /* bt_enable() returned */
+    BOOT_BT_READY,      /* Host ready, services registered */
+    BOOT_ADV_START,     /* First advertising packet scheduled */
+    BOOT_SENSORS,       /* Sensor modules scheduled */
+    BOOT_FIRST_SAMPLE,  /* First temperature sample published */
+    BOOT_STAGE_COUNT
+} boot_stage_t;
+
+void boot_mark(boot_stage_t stage);
+u32_t boot_stage_ms(boot_stage_t stage);
+void boot_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_H */
@@ -11,17 +11,26 @@
 #include "bp_sens.h"
 #include "nv.h"
 #include "ess.h"
+#include "retained.h"
+#include "dev_pm.h"
+#include "sens_fetch.h"
+#include "energy.h"
+#include "probe.h"
+#include "trace.h"
+#include "metrics.h"
 
 #define CONFIG_SYS_LOG_BP_SENS_LEVEL 1
 #define SYS_LOG_DOMAIN "bp_sens"
 #define SYS_LOG_LEVEL CONFIG_SYS_LOG_BP_SENS_LEVEL
 #include <logging/sys_log.h>
+#include "blog.h"
 
 
 static struct device *bmp280_dev;
 static struct sensor_value bp_val;
 static struct k_timer meas_timer;
 static struct k_work meas_work;
+static bool _is_initialized;
 static bp_meas_cb_t meas_cb;
 
 static nv_sensor_data_t _default_sensor_data = {
@@ -30,6 +39,7 @@ static nv_sensor_data_t _default_sensor_data = {
     .update_interval  = 60,
     .application      = ESS_APPL_Air,
     .meas_uncertainty = 0,
+    .max_age          = 30,
 };
 
 static void meas_work_handler(struct k_work *work);
@@ -38,36 +48,66 @@ static void meas_timer_handler(struct k_timer *timer);
 
 static void meas_work_handler(struct k_work *work)
 {
+    u32_t start = probe_start();
+
+    metrics_wakeup();
+
     SYS_LOG_DBG("Periodic barometric pressure measurement");
-    bp_sens_meas();
 
-    if (meas_cb != NULL) {
+    /* A failed sample is not published, the readings keep the last one */
+    if (bp_sens_meas() == 0 && meas_cb != NULL) {
         meas_cb(&bp_val);
     }
 
+    probe_end(PROBE_BP_WORK, start);
 }
 
 static void meas_timer_handler(struct k_timer *timer)
 {
+    trace_event(TRACE_TIMER, PROBE_BP_WORK, 0);
     k_work_submit(&meas_work);
 }
 
-void bp_sens_meas(void)
+/**
+* @brief Starts a measurement outside the periodic schedule
+*
+* The result is delivered through the measurement callback.
+*/
+int bp_sens_request(void)
+{
+    if (!_is_initialized) {
+        return -ENODEV;
+    }
+
+    k_work_submit(&meas_work);
+
+    return 0;
+}
+
+int bp_sens_meas(void)
 {
     int err;
+    u32_t start = k_cycle_get_32();
+
+    err = sens_fetch(bmp280_dev, 2);
+
+    energy_time_add(ENERGY_BMP280, k_cycle_get_32() - start);
+    probe_end(PROBE_BMP280_FETCH, start);
 
-    err = sensor_sample_fetch(bmp280_dev);
     if (err != 0) {
         SYS_LOG_ERR("Error fetching barometric pressure sample");
-        return;
+        return err;
     }
 
     err = sensor_channel_get(bmp280_dev, SENSOR_CHAN_PRESS, &bp_val);
     if (err != 0) {
         SYS_LOG_ERR("Error reading bmp280 data");
-    } else {
-        SYS_LOG_INF("BP:%d.%06d", bp_val.val1, bp_val.val2);
+        return err;
     }
+
+    BLOG_INF("BP:%d.%06d", bp_val.val1, bp_val.val2);
+
+    return 0;
 }
 
 void bp_sens_init(bp_meas_cb_t callback)
@@ -81,8 +121,12 @@ void bp_sens_init(bp_meas_cb_t callback)
     bmp280_dev = device_get_binding(CONFIG_BMP280_DEV_NAME);
     if (bmp280_dev == NULL) {
         SYS_LOG_ERR("Failed to get pointer to %s device!", CONFIG_BMP280_DEV_NAME);
+        return;
     }
 
+    // Sleep mode between samples
+    dev_pm_add(bmp280_dev, NULL);
+
     err = nv_get_sensor_data(NV_SENSOR_BARO_PRESSURE, &sensor_data);
     if (err == -ENOENT) {
         nv_set_sensor_data(NV_SENSOR_BARO_PRESSURE, &_default_sensor_data);
@@ -90,7 +134,12 @@ void bp_sens_init(bp_meas_cb_t callback)
     }
 
     k_work_init(&meas_work, meas_work_handler);
+    _is_initialized = true;
     k_timer_init(&meas_timer, meas_timer_handler, NULL);
-    k_timer_start(&meas_timer, K_SECONDS(5), K_SECONDS(sensor_data.update_interval));
+    k_timer_start(&meas_timer,
+                  retained_first_delay(READINGS_CH_BARO_PRESSURE,
+                                       K_SECONDS(sensor_data.update_interval),
+                                       K_SECONDS(5)),
+                  K_SECONDS(sensor_data.update_interval));
 #endif
 }
@@ -9,6 +9,7 @@
 typedef void (*bp_meas_cb_t)(struct sensor_value *baro_pressure);
 
 void bp_sens_init(bp_meas_cb_t callback);
-void bp_sens_meas(void);
+int bp_sens_meas(void);
+int bp_sens_request(void);
 
 #endif /* BP_SENS_H */
@@ -0,0 +1,485 @@
+/** @file
+ *  @brief Walnut Burst Service
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <misc/byteorder.h>
+#include <zephyr.h>
+#include <device.h>
+#include <sensor.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "burst.h"
+#include "conn_param.h"
+#include "notify.h"
+#include "ccc_store.h"
+#include "dev_pm.h"
+#include "energy.h"
+#include "probe.h"
+
+#define SYS_LOG_DOMAIN "burst"
+#define SYS_LOG_LEVEL 3
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+#define BURST_CP_NAME       "Burst Control Point"
+#define BURST_DATA_NAME     "Burst Data"
+
+/* Control point opcodes */
+#define BURST_CP_START      0x01
+#define BURST_CP_STOP       0x02
+
+/* Samples buffered while waiting for TX buffers, 6.4 s at 10 Hz */
+#define BURST_RING_SIZE     64
+
+/* Largest notification payload, used when the ATT MTU allows it */
+#define BURST_PDU_MAX       64
+
+/* Time to wait for TX buffers before sending again */
+#define BURST_RETRY_DELAY   K_MSEC(20)
+
+#define BURST_SAMPLE_SIZE   7
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+struct burst_sample {
+    s16_t temperature;      /* 0.01 degC */
+    u16_t humidity;         /* 0.01 % */
+    u32_t pressure;         /* 0.1 Pa */
+};
+
+struct burst_cp_start {
+    u8_t opcode;
+    u8_t rate;              /* Hz */
+    u16_t duration;         /* s */
+} __packed;
+
+/*
+ * Data notification: u16 index of the first sample, followed by as many
+ * samples as fit, each s16 temperature, u16 humidity and u24 pressure,
+ * little endian. A gap in the index means samples were dropped.
+ */
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static struct bt_uuid_128 burst_svc_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x00, 0x02, 0xa1, 0x57);
+
+static struct bt_uuid_128 burst_cp_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x01, 0x02, 0xa1, 0x57);
+
+static struct bt_uuid_128 burst_data_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x02, 0x02, 0xa1, 0x57);
+
+static struct bt_gatt_ccc_cfg _data_ccc_cfg[BT_GATT_CCC_MAX];
+
+static struct device *_t_rh_dev;
+static struct device *_bp_dev;
+
+/* Devices kept resumed for the burst */
+static bool _t_rh_held;
+static bool _bp_held;
+
+/* Connection the burst streams to, NULL while idle */
+static struct bt_conn *_conn;
+static u8_t _rate;
+static u16_t _duration;
+
+static struct burst_sample _ring[BURST_RING_SIZE];
+static u16_t _head;     /* Index of the next sample taken */
+static u16_t _tail;     /* Index of the oldest sample not sent */
+
+static burst_stats_t _stats;
+
+static struct k_timer _sample_timer;
+static struct k_work _start_work;
+static struct k_work _sample_work;
+static struct k_delayed_work _send_work;
+static struct k_delayed_work _end_work;
+
+static ssize_t write_burst_cp(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, const void *buf,
+                 u16_t len, u16_t offset, u8_t flags);
+static void burst_data_ccc_cfg_changed(const struct bt_gatt_attr *attr,
+                 u16_t value);
+
+static struct bt_gatt_attr burst_attrs[] = {
+    BT_GATT_PRIMARY_SERVICE(&burst_svc_uuid),
+
+    BT_GATT_CHARACTERISTIC(&burst_cp_uuid.uuid,
+                    BT_GATT_CHRC_WRITE,
+                    BT_GATT_PERM_WRITE,
+                    NULL, write_burst_cp, NULL),
+    BT_GATT_CUD(BURST_CP_NAME, BT_GATT_PERM_READ),
+
+    BT_GATT_CHARACTERISTIC(&burst_data_uuid.uuid,
+                    BT_GATT_CHRC_NOTIFY,
+                    BT_GATT_PERM_NONE,
+                    NULL, NULL, NULL),
+    BT_GATT_CUD(BURST_DATA_NAME, BT_GATT_PERM_READ),
+    BT_GATT_CCC(_data_ccc_cfg, burst_data_ccc_cfg_changed),
+};
+
+static struct bt_gatt_service burst_svc = BT_GATT_SERVICE(burst_attrs);
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static inline s32_t sensor_value_to_centi(const struct sensor_value *val)
+{
+    return val->val1 * 100 + val->val2 / 10000;
+}
+
+/**
+* @private
+* @brief Ends a running burst when its central unsubscribes
+*
+* @p value is the combined setting of all centrals, so the streaming
+* central's own setting is looked up.
+*/
+static void burst_data_ccc_cfg_changed(const struct bt_gatt_attr *attr,
+                 u16_t value)
+{
+    struct bt_conn *conn = _conn;
+
+    if (conn != NULL && !notify_ccc_enabled(_data_ccc_cfg, conn)) {
+        k_delayed_work_submit(&_end_work, K_NO_WAIT);
+    }
+
+    ccc_store_changed();
+}
+
+static void sensors_configure(u8_t rate)
+{
+    struct sensor_value freq = { .val1 = rate };
+
+    if (_t_rh_dev != NULL) {
+        sensor_attr_set(_t_rh_dev, SENSOR_CHAN_ALL,
+                SENSOR_ATTR_SAMPLING_FREQUENCY, &freq);
+    }
+
+    if (_bp_dev != NULL) {
+        sensor_attr_set(_bp_dev, SENSOR_CHAN_ALL,
+                SENSOR_ATTR_SAMPLING_FREQUENCY, &freq);
+    }
+}
+
+static void sample_work_handler(struct k_work *work)
+{
+    struct burst_sample *sample;
+    struct sensor_value val;
+    u32_t start;
+
+    if (_conn == NULL) {
+        return;
+    }
+
+    if ((u16_t)(_head - _tail) == BURST_RING_SIZE) {
+        /* Oldest sample makes room, the index gap tells the central */
+        _tail++;
+        _stats.dropped++;
+    }
+
+    sample = &_ring[_head % BURST_RING_SIZE];
+    memset(sample, 0, sizeof(*sample));
+
+    start = k_cycle_get_32();
+
+    if (_t_rh_dev != NULL && !sensor_sample_fetch(_t_rh_dev)) {
+        sensor_channel_get(_t_rh_dev, SENSOR_CHAN_AMBIENT_TEMP, &val);
+        sample->temperature = sensor_value_to_centi(&val);
+        sensor_channel_get(_t_rh_dev, SENSOR_CHAN_HUMIDITY, &val);
+        sample->humidity = sensor_value_to_centi(&val);
+    }
+
+    energy_time_add(ENERGY_SI7020, k_cycle_get_32() - start);
+    probe_end(PROBE_SI7020_FETCH, start);
+    start = k_cycle_get_32();
+
+    /* Only the read is timed, the BMP280 converts on its own in between */
+    if (_bp_dev != NULL && !sensor_sample_fetch(_bp_dev)) {
+        /* kPa to 0.1 Pa */
+        sensor_channel_get(_bp_dev, SENSOR_CHAN_PRESS, &val);
+        sample->pressure = val.val1 * 10000 + val.val2 / 100;
+    }
+
+    energy_time_add(ENERGY_BMP280, k_cycle_get_32() - start);
+    probe_end(PROBE_BMP280_FETCH, start);
+
+    _head++;
+    _stats.samples++;
+
+    k_delayed_work_submit(&_send_work, K_NO_WAIT);
+}
+
+static void sample_timer_handler(struct k_timer *timer)
+{
+    k_work_submit(&_sample_work);
+}
+
+static u8_t pdu_encode(u8_t *pdu, u8_t num_samples)
+{
+    struct burst_sample *sample;
+    u8_t *p = pdu;
+
+    sys_put_le16(_tail, p);
+    p += sizeof(u16_t);
+
+    for (int i = 0; i < num_samples; i++) {
+        sample = &_ring[(u16_t)(_tail + i) % BURST_RING_SIZE];
+
+        sys_put_le16(sample->temperature, p);
+        sys_put_le16(sample->humidity, p + 2);
+        p[4] = sample->pressure & 0xff;
+        p[5] = (sample->pressure >> 8) & 0xff;
+        p[6] = (sample->pressure >> 16) & 0xff;
+        p += BURST_SAMPLE_SIZE;
+    }
+
+    return p - pdu;
+}
+
+/**
+* @private
+* @brief Sends buffered samples, as many per notification as fit
+*
+* Only full notifications are sent while sampling, the remainder goes out
+* when the burst ends.
+*/
+static void send_work_handler(struct k_work *work)
+{
+    u8_t pdu[BURST_PDU_MAX];
+    u16_t payload;
+    u8_t per_pdu;
+    u8_t num_samples;
+    u8_t len;
+    u32_t start;
+    int err;
+
+    /* Not subscribed any more, the burst is ending */
+    if (_conn == NULL || !notify_ccc_enabled(_data_ccc_cfg, _conn)) {
+        return;
+    }
+
+    payload = min(bt_gatt_get_mtu(_conn) - 3, BURST_PDU_MAX);
+    per_pdu = (payload - sizeof(u16_t)) / BURST_SAMPLE_SIZE;
+
+    while (_tail != _head) {
+        num_samples = min((u16_t)(_head - _tail), per_pdu);
+
+        if (num_samples < per_pdu && k_timer_remaining_get(&_sample_timer)) {
+            return;
+        }
+
+        len = pdu_encode(pdu, num_samples);
+
+        start = probe_start();
+        err = bt_gatt_notify(_conn, &burst_attrs[5], pdu, len);
+        probe_end(PROBE_NOTIFY, start);
+        if (err == -ENOMEM || err == -ENOBUFS) {
+            k_delayed_work_submit(&_send_work, BURST_RETRY_DELAY);
+            return;
+        }
+
+        if (err) {
+            SYS_LOG_ERR("Notification failed (err %d)", err);
+            _stats.dropped += num_samples;
+        } else {
+            _stats.sent += num_samples;
+            _stats.packets++;
+            energy_event_add(ENERGY_TX, 1);
+        }
+
+        _tail += num_samples;
+    }
+}
+
+/**
+* @private
+* @brief Ends the burst and restores normal operation
+*/
+static void burst_stop(void)
+{
+    if (_conn == NULL) {
+        return;
+    }
+
+    k_timer_stop(&_sample_timer);
+    k_delayed_work_cancel(&_end_work);
+
+    /* Flush what is left while the link is still fast */
+    send_work_handler(NULL);
+    k_delayed_work_cancel(&_send_work);
+
+    sensors_configure(0);
+    conn_param_bulk_end();
+
+    if (_t_rh_held) {
+        dev_pm_put(_t_rh_dev);
+        _t_rh_held = false;
+    }
+
+    if (_bp_held) {
+        dev_pm_put(_bp_dev);
+        _bp_held = false;
+    }
+
+    bt_conn_unref(_conn);
+    _conn = NULL;
+
+    SYS_LOG_INF("Burst ended, %u samples, %u sent, %u dropped",
+            _stats.samples, _stats.sent, _stats.dropped);
+}
+
+static void end_work_handler(struct k_work *work)
+{
+    burst_stop();
+}
+
+static void start_work_handler(struct k_work *work)
+{
+    _head = 0;
+    _tail = 0;
+
+    conn_param_bulk_begin();
+
+    /* Stay out of suspend between the periodic samples */
+    _t_rh_held = (_t_rh_dev != NULL && !dev_pm_get(_t_rh_dev));
+    _bp_held = (_bp_dev != NULL && !dev_pm_get(_bp_dev));
+
+    sensors_configure(_rate);
+
+    k_timer_start(&_sample_timer, K_NO_WAIT, MSEC_PER_SEC / _rate);
+    k_delayed_work_submit(&_end_work, K_SECONDS(_duration));
+
+    SYS_LOG_INF("Burst started, %u Hz for %u s", _rate, _duration);
+}
+
+/**
+* @private
+* @brief Starts or stops a burst
+*
+* Runs in the RX thread; the sensors are reconfigured from the system
+* workqueue, where they are sampled.
+*/
+static ssize_t write_burst_cp(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, const void *buf,
+                 u16_t len, u16_t offset, u8_t flags)
+{
+    const struct burst_cp_start *req = buf;
+    u16_t duration;
+
+    if (offset) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    if (len < 1) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    if (req->opcode == BURST_CP_STOP) {
+        if (_conn == conn) {
+            k_delayed_work_submit(&_end_work, K_NO_WAIT);
+        }
+        return len;
+    }
+
+    if (req->opcode != BURST_CP_START) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+
+    if (len != sizeof(*req)) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    duration = sys_le16_to_cpu(req->duration);
+
+    if (req->rate < BURST_RATE_MIN || req->rate > BURST_RATE_MAX ||
+        duration == 0 || duration > BURST_DURATION_MAX) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+
+    if (!notify_ccc_enabled(_data_ccc_cfg, conn)) {
+        return BT_GATT_ERR(BT_ATT_ERR_CCC_IMPROPER_CONF);
+    }
+
+    if (_conn != NULL) {
+        return BT_GATT_ERR(BT_ATT_ERR_PROCEDURE_IN_PROGRESS);
+    }
+
+    _conn = bt_conn_ref(conn);
+    _rate = req->rate;
+    _duration = duration;
+    k_work_submit(&_start_work);
+
+    return len;
+}
+
+static void disconnected(struct bt_conn *conn, u8_t reason)
+{
+    if (conn == _conn) {
+        k_delayed_work_submit(&_end_work, K_NO_WAIT);
+    }
+}
+
+static struct bt_conn_cb conn_callbacks = {
+    .disconnected = disconnected,
+};
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+void burst_init(void)
+{
+#ifdef CONFIG_SI7020
+    _t_rh_dev = device_get_binding(CONFIG_SI7020_NAME);
+#endif
+#ifdef CONFIG_BMP280
+    _bp_dev = device_get_binding(CONFIG_BMP280_DEV_NAME);
+#endif
+
+    k_timer_init(&_sample_timer, sample_timer_handler, NULL);
+    k_work_init(&_start_work, start_work_handler);
+    k_work_init(&_sample_work, sample_work_handler);
+    k_delayed_work_init(&_send_work, send_work_handler);
+    k_delayed_work_init(&_end_work, end_work_handler);
+
+    bt_conn_cb_register(&conn_callbacks);
+    bt_gatt_service_register(&burst_svc);
+    ccc_store_register("burst", _data_ccc_cfg, ARRAY_SIZE(_data_ccc_cfg));
+}
+
+void burst_stats_get(burst_stats_t *stats)
+{
+    memcpy(stats, &_stats, sizeof(*stats));
+}
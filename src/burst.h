@@ -0,0 +1,40 @@
+/** @file
+ *  @brief Walnut Burst Service
+ *
+ *  Time-bounded high-rate sampling of temperature, humidity and pressure
+ *  for short diagnostic windows. A central starts a burst through the
+ *  control point and receives the samples packed into notifications on
+ *  the data characteristic. Normal operation resumes when the burst ends.
+ */
+
+#ifndef BURST_H
+#define BURST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+/* Sampling rate limits, Hz */
+#define BURST_RATE_MIN          1
+#define BURST_RATE_MAX          10
+
+/* Longest burst, s */
+#define BURST_DURATION_MAX      600
+
+typedef struct {
+    u32_t samples;      /* Samples taken */
+    u32_t sent;         /* Samples handed to the host */
+    u32_t dropped;      /* Samples lost to a full buffer */
+    u32_t packets;      /* Notifications sent */
+} burst_stats_t;
+
+void burst_init(void);
+void burst_stats_get(burst_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BURST_H */
@@ -0,0 +1,113 @@
+/** @file
+ *  @brief Sensor sample capture
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <zephyr.h>
+#include <sensor.h>
+#include <misc/byteorder.h>
+#include <device.h>
+#include <init.h>
+
+#ifdef CONFIG_HAS_SEGGER_RTT
+#include <rtt/SEGGER_RTT.h>
+#endif
+
+#include "capture.h"
+
+#ifdef CONFIG_WALNUT_CAPTURE
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+#define CAPTURE_RTT_CHANNEL     2
+#define CAPTURE_RTT_BUF_SIZE    128
+
+/* Record on the wire: u32 uptime ms, u8 channel, pad, s32 val1, s32 val2 */
+#define CAPTURE_RECORD_LEN      16
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static u32_t _dropped;
+
+#ifdef CONFIG_HAS_SEGGER_RTT
+static u8_t _rtt_buf[CAPTURE_RTT_BUF_SIZE];
+#endif
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+/* @return true if the host took the record */
+static bool record_write(u32_t time, u8_t channel, s32_t val1, s32_t val2)
+{
+    u8_t buf[CAPTURE_RECORD_LEN] = { 0 };
+
+    sys_put_le32(time, &buf[0]);
+    buf[4] = channel;
+    sys_put_le32(val1, &buf[8]);
+    sys_put_le32(val2, &buf[12]);
+
+#ifdef CONFIG_HAS_SEGGER_RTT
+    return SEGGER_RTT_Write(CAPTURE_RTT_CHANNEL, buf, sizeof(buf)) != 0;
+#else
+    return false;
+#endif
+}
+
+static int capture_init(struct device *unused)
+{
+#ifdef CONFIG_HAS_SEGGER_RTT
+    /* Whole records are skipped when the host falls behind */
+    SEGGER_RTT_ConfigUpBuffer(CAPTURE_RTT_CHANNEL, "capture", _rtt_buf,
+                  sizeof(_rtt_buf), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+#endif
+
+    return 0;
+}
+
+SYS_INIT(capture_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Streams a sample as the driver reported it
+*
+* Samples arrive every few seconds at most, so they are written straight
+* to the RTT buffer from the caller, without a ring buffer and thread of
+* their own. A sample the host has no room for is counted and reported
+* with the next one that fits.
+*/
+void capture_sample(readings_ch_t channel, const struct sensor_value *value)
+{
+    u32_t time = k_uptime_get_32();
+
+    if (_dropped) {
+        if (!record_write(time, CAPTURE_CH_DROPPED, _dropped, 0)) {
+            _dropped++;
+            return;
+        }
+
+        _dropped = 0;
+    }
+
+    if (!record_write(time, channel, value->val1, value->val2)) {
+        _dropped++;
+    }
+}
+
+#endif /* CONFIG_WALNUT_CAPTURE */
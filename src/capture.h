@@ -0,0 +1,41 @@
+/** @file
+ *  @brief Sensor sample capture
+ *
+ *  Streams every sample the sensor modules deliver, timestamped and as
+ *  the driver reported it, on RTT channel 2. scripts/capture_replay.py
+ *  replays a capture on the native variant (bench/replay.c) to compare
+ *  notification policies on real data.
+ *
+ *  Off by default (CONFIG_WALNUT_CAPTURE). RTT channel 2 is the last up
+ *  buffer and also carries the event trace, so capture and trace cannot be
+ *  enabled together.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+#include "readings.h"
+
+/* Channel of the record of dropped samples, arg in val1 */
+#define CAPTURE_CH_DROPPED      0xff
+
+struct sensor_value;
+
+#ifdef CONFIG_WALNUT_CAPTURE
+void capture_sample(readings_ch_t channel, const struct sensor_value *value);
+#else
+static inline void capture_sample(readings_ch_t channel,
+                                  const struct sensor_value *value) {}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAPTURE_H */
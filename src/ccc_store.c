@@ -0,0 +1,307 @@
+/** @file
+ *  @brief Persistent CCC configuration
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <zephyr.h>
+#include <misc/printk.h>
+#include <misc/byteorder.h>
+#include <settings/settings.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "ccc_store.h"
+#include "nv.h"
+
+#define SYS_LOG_DOMAIN "ccc_store"
+#define SYS_LOG_LEVEL 3
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Settings subtree, keys are "ccc/<name>" */
+#define CCC_STORE_SUBTREE       "ccc"
+
+/* Coalesces the writes of a central subscribing to several characteristics */
+#define CCC_STORE_SAVE_DELAY    K_SECONDS(2)
+
+#define CCC_STORE_KEY_LEN       (sizeof(CCC_STORE_SUBTREE) + CCC_STORE_NAME_MAX + 1)
+
+/* Base64 encoding of a full descriptor, including the terminator */
+#define CCC_STORE_STR_LEN \
+    ((sizeof(struct ccc_store_record) * BT_GATT_CCC_MAX + 2) / 3 * 4 + 1)
+
+#define FNV_OFFSET_BASIS        0x811c9dc5
+#define FNV_PRIME               0x01000193
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+/* Stored per subscribed peer */
+struct ccc_store_record {
+    bt_addr_le_t peer;
+    u16_t value;
+} __packed;
+
+struct ccc_store_entry {
+    const char *name;
+    struct bt_gatt_ccc_cfg *cfg;
+    size_t count;
+    u32_t hash;         /* Hash of the stored records */
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static struct ccc_store_entry _entries[CCC_STORE_MAX];
+static size_t _num_entries;
+
+static struct k_delayed_work _save_work;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static u32_t records_hash(const struct ccc_store_record *records, size_t len)
+{
+    const u8_t *p = (const u8_t *)records;
+    u32_t hash = FNV_OFFSET_BASIS;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static struct ccc_store_entry *entry_find(const char *name)
+{
+    for (size_t i = 0; i < _num_entries; i++) {
+        if (!strcmp(_entries[i].name, name)) {
+            return &_entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+* @private
+* @brief Collects the subscriptions of bonded peers
+*
+* Peers without a bond get a new address and new CCC values on the next
+* connection anyway, so storing them would only wear the flash.
+*
+* @return Length of the records, bytes
+*/
+static size_t entry_encode(const struct ccc_store_entry *entry,
+                           struct ccc_store_record *records)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < entry->count; i++) {
+        if (!entry->cfg[i].value ||
+            !bt_addr_le_is_bonded(&entry->cfg[i].peer)) {
+            continue;
+        }
+
+        bt_addr_le_copy(&records[n].peer, &entry->cfg[i].peer);
+        records[n].value = sys_cpu_to_le16(entry->cfg[i].value);
+        n++;
+    }
+
+    return n * sizeof(*records);
+}
+
+static int entry_save(struct ccc_store_entry *entry)
+{
+    struct ccc_store_record records[BT_GATT_CCC_MAX];
+    char key[CCC_STORE_KEY_LEN];
+    char str[CCC_STORE_STR_LEN];
+    char *val = NULL;
+    size_t len;
+    u32_t hash;
+    int err;
+
+    len = entry_encode(entry, records);
+    hash = records_hash(records, len);
+    if (hash == entry->hash) {
+        return 0;
+    }
+
+    if (len) {
+        val = settings_str_from_bytes(records, len, str, sizeof(str));
+        if (val == NULL) {
+            return -EINVAL;
+        }
+    }
+
+    snprintk(key, sizeof(key), CCC_STORE_SUBTREE "/%s", entry->name);
+
+    /* An empty value deletes the key */
+    err = nv_settings_save(key, val);
+    if (err) {
+        return err;
+    }
+
+    SYS_LOG_DBG("Stored %s, %u peers", entry->name,
+                len / sizeof(struct ccc_store_record));
+    entry->hash = hash;
+
+    return 0;
+}
+
+static void save_work_handler(struct k_work *work)
+{
+    int err;
+
+    for (size_t i = 0; i < _num_entries; i++) {
+        err = entry_save(&_entries[i]);
+        if (err) {
+            SYS_LOG_ERR("Failed to store %s (err %d)", _entries[i].name, err);
+        }
+    }
+}
+
+static int ccc_store_set(int argc, char **argv, char *val)
+{
+    struct ccc_store_record records[BT_GATT_CCC_MAX];
+    struct ccc_store_entry *entry;
+    int len = sizeof(records);
+    size_t n;
+    int err;
+
+    if (argc != 1) {
+        return -ENOENT;
+    }
+
+    entry = entry_find(argv[0]);
+    if (entry == NULL) {
+        /* A descriptor that no longer exists, dropped on the next save */
+        SYS_LOG_WRN("Unknown CCC %s", argv[0]);
+        return 0;
+    }
+
+    if (val == NULL) {
+        return 0;
+    }
+
+    err = settings_bytes_from_str(val, records, &len);
+    if (err) {
+        SYS_LOG_ERR("Failed to decode %s (err %d)", entry->name, err);
+        return err;
+    }
+
+    n = min(len / sizeof(records[0]), entry->count);
+
+    /* The host restores the subscription when the peer reconnects */
+    for (size_t i = 0; i < n; i++) {
+        bt_addr_le_copy(&entry->cfg[i].peer, &records[i].peer);
+        entry->cfg[i].value = sys_le16_to_cpu(records[i].value);
+    }
+
+    entry->hash = records_hash(records, n * sizeof(records[0]));
+
+    SYS_LOG_DBG("Restored %s, %u peers", entry->name, n);
+
+    return 0;
+}
+
+static void disconnected(struct bt_conn *conn, u8_t reason)
+{
+    /* The host keeps the values of a bonded peer, they are final now */
+    ccc_store_changed();
+}
+
+static struct bt_conn_cb conn_callbacks = {
+    .disconnected = disconnected,
+};
+
+static struct settings_handler ccc_store_handler = {
+    .h_name = CCC_STORE_SUBTREE,
+    .h_set = ccc_store_set,
+};
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Hooks the store into the settings subsystem
+*
+* Must run after bt_enable(), which initialises the settings subsystem, and
+* before settings_load().
+*/
+void ccc_store_init(void)
+{
+    int err;
+
+    k_delayed_work_init(&_save_work, save_work_handler);
+    bt_conn_cb_register(&conn_callbacks);
+
+    err = settings_register(&ccc_store_handler);
+    if (err) {
+        SYS_LOG_ERR("Failed to register settings handler (err %d)", err);
+    }
+}
+
+/**
+* @brief Makes a CCC descriptor persistent
+*
+* @p name identifies the descriptor in the storage and must stay the same
+* across firmware versions. Registration has to happen before
+* settings_load().
+*/
+int ccc_store_register(const char *name, struct bt_gatt_ccc_cfg *cfg,
+                       size_t count)
+{
+    struct ccc_store_entry *entry;
+
+    if (strlen(name) > CCC_STORE_NAME_MAX || entry_find(name) != NULL) {
+        return -EINVAL;
+    }
+
+    if (_num_entries >= CCC_STORE_MAX) {
+        return -ENOMEM;
+    }
+
+    entry = &_entries[_num_entries++];
+    entry->name = name;
+    entry->cfg = cfg;
+    entry->count = count;
+    entry->hash = records_hash(NULL, 0);
+
+    return 0;
+}
+
+/**
+* @brief Schedules storing of the CCC values
+*
+* Called from the CCC changed callbacks. Values that did not change since
+* the last store are not written again.
+*/
+void ccc_store_changed(void)
+{
+    k_delayed_work_submit(&_save_work, CCC_STORE_SAVE_DELAY);
+}
@@ -0,0 +1,37 @@
+/** @file
+ *  @brief Persistent CCC configuration
+ *
+ *  Keeps the Client Characteristic Configuration of bonded centrals in
+ *  the settings storage, next to the bond keys stored by the host. After
+ *  a reset a bonded gateway reconnects already subscribed and gets the
+ *  next notification without rewriting any descriptor.
+ */
+
+#ifndef CCC_STORE_H
+#define CCC_STORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <zephyr/types.h>
+
+/* CCC descriptors that can be registered */
+#define CCC_STORE_MAX           10
+
+/* Longest name of a descriptor in the storage */
+#define CCC_STORE_NAME_MAX      8
+
+struct bt_gatt_ccc_cfg;
+
+void ccc_store_init(void);
+int ccc_store_register(const char *name, struct bt_gatt_ccc_cfg *cfg,
+                       size_t count);
+void ccc_store_changed(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CCC_STORE_H */
@@ -0,0 +1,428 @@
+/** @file
+ *  @brief Walnut Climate Service
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <misc/printk.h>
+#include <misc/byteorder.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "climate.h"
+#include "notify.h"
+#include "readings.h"
+#include "ccc_store.h"
+
+#define SYS_LOG_DOMAIN "climate"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+#define CLIMATE_MEAS_NAME   "Climate Measurement"
+#define CLIMATE_CP_NAME     "Climate Control Point"
+
+/* Fields present in a climate measurement, same bits as the snapshot */
+#define CLIMATE_TEMPERATURE     READINGS_TEMPERATURE
+#define CLIMATE_HUMIDITY        READINGS_HUMIDITY
+#define CLIMATE_AMBIENT_LIGHT   READINGS_AMBIENT_LIGHT
+#define CLIMATE_BARO_PRESSURE   READINGS_BARO_PRESSURE
+#define CLIMATE_BATTERY         READINGS_BATTERY
+
+/* Fields reported by every periodic measurement cycle */
+#define CLIMATE_CYCLE_FIELDS    (CLIMATE_TEMPERATURE | CLIMATE_HUMIDITY | \
+                                 CLIMATE_AMBIENT_LIGHT | CLIMATE_BARO_PRESSURE)
+
+
+/* Control point opcodes */
+#define CLIMATE_CP_MEASURE_NOW  0x01
+#define CLIMATE_CP_RESPONSE     0x80
+
+/* Control point response status */
+#define CLIMATE_CP_SUCCESS      0x00
+#define CLIMATE_CP_TIMEOUT      0x01
+
+/* Time allowed for all requested sensors to report */
+#define CLIMATE_MEASURE_TIMEOUT K_MSEC(2000)
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+/* Little endian, units as in the corresponding ESS/BAS characteristics */
+struct climate_meas {
+    u32_t timestamp;        /* Seconds since boot */
+    s16_t temperature;      /* 0.01 degC */
+    u16_t humidity;         /* 0.01 % */
+    u16_t ambient_light;    /* 0.01 lux */
+    u32_t pressure;         /* 0.1 Pa */
+    u8_t battery;           /* % */
+    u8_t updated;           /* CLIMATE_* fields updated since last notify */
+} __packed;
+
+struct climate_cp_measure_now {
+    u8_t opcode;
+    u8_t fields;            /* CLIMATE_* fields to measure */
+} __packed;
+
+struct climate_cp_rsp {
+    u8_t opcode;            /* CLIMATE_CP_RESPONSE */
+    u8_t req_opcode;
+    u8_t status;
+    u8_t fields;            /* CLIMATE_* fields measured */
+    u16_t latency;          /* Request to notification, ms */
+} __packed;
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static struct bt_uuid_128 climate_svc_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x00, 0x01, 0xa1, 0x57);
+
+static struct bt_uuid_128 climate_meas_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x01, 0x01, 0xa1, 0x57);
+
+static struct bt_uuid_128 climate_cp_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x02, 0x01, 0xa1, 0x57);
+
+static struct climate_meas _meas = {
+    .battery = 100,
+};
+
+static struct bt_gatt_ccc_cfg _ccc_cfg[BT_GATT_CCC_MAX];
+static u8_t _is_notify_enabled;
+
+static struct bt_gatt_ccc_cfg _cp_ccc_cfg[BT_GATT_CCC_MAX];
+
+/* Measure now request in progress */
+static struct bt_conn *_measure_conn;
+static atomic_t _measure_pending;
+static u8_t _measure_fields;
+static s64_t _measure_start;
+static struct k_delayed_work _measure_timeout_work;
+static climate_measure_stats_t _measure_stats;
+
+static struct k_delayed_work _notify_work;
+static bool _cycle_open;
+static bool _is_initialized;
+
+static ssize_t read_climate_meas(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, void *buf,
+                 u16_t len, u16_t offset);
+static void climate_ccc_cfg_changed(const struct bt_gatt_attr *attr,
+                 u16_t value);
+static ssize_t write_climate_cp(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, const void *buf,
+                 u16_t len, u16_t offset, u8_t flags);
+static void climate_cp_ccc_cfg_changed(const struct bt_gatt_attr *attr,
+                 u16_t value);
+
+static struct bt_gatt_attr climate_attrs[] = {
+    BT_GATT_PRIMARY_SERVICE(&climate_svc_uuid),
+
+    BT_GATT_CHARACTERISTIC(&climate_meas_uuid.uuid,
+                    BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+                    BT_GATT_PERM_READ,
+                    read_climate_meas, NULL, NULL),
+    BT_GATT_CUD(CLIMATE_MEAS_NAME, BT_GATT_PERM_READ),
+    BT_GATT_CCC(_ccc_cfg, climate_ccc_cfg_changed),
+
+    BT_GATT_CHARACTERISTIC(&climate_cp_uuid.uuid,
+                    BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY,
+                    BT_GATT_PERM_WRITE,
+                    NULL, write_climate_cp, NULL),
+    BT_GATT_CUD(CLIMATE_CP_NAME, BT_GATT_PERM_READ),
+    BT_GATT_CCC(_cp_ccc_cfg, climate_cp_ccc_cfg_changed),
+};
+
+static struct bt_gatt_service climate_svc = BT_GATT_SERVICE(climate_attrs);
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static void climate_meas_encode(struct climate_meas *rsp)
+{
+    rsp->timestamp     = sys_cpu_to_le32(_meas.timestamp);
+    rsp->temperature   = sys_cpu_to_le16(_meas.temperature);
+    rsp->humidity      = sys_cpu_to_le16(_meas.humidity);
+    rsp->ambient_light = sys_cpu_to_le16(_meas.ambient_light);
+    rsp->pressure      = sys_cpu_to_le32(_meas.pressure);
+    rsp->battery       = _meas.battery;
+    rsp->updated       = _meas.updated;
+}
+
+static ssize_t read_climate_meas(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, void *buf,
+                 u16_t len, u16_t offset)
+{
+    struct climate_meas rsp;
+    readings_t snapshot;
+
+    /* Reads come from the RX thread, serve a consistent snapshot */
+    readings_read(&snapshot);
+
+    rsp.timestamp     = sys_cpu_to_le32(snapshot.timestamp / MSEC_PER_SEC);
+    rsp.temperature   = sys_cpu_to_le16(snapshot.temperature);
+    rsp.humidity      = sys_cpu_to_le16(snapshot.humidity);
+    rsp.ambient_light = sys_cpu_to_le16(snapshot.ambient_light);
+    rsp.pressure      = sys_cpu_to_le32(snapshot.pressure);
+    rsp.battery       = (snapshot.valid & READINGS_BATTERY) ?
+                        snapshot.battery : _meas.battery;
+    rsp.updated       = _meas.updated;
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &rsp,
+                 sizeof(rsp));
+}
+
+static void climate_ccc_cfg_changed(const struct bt_gatt_attr *attr,
+                 u16_t value)
+{
+    _is_notify_enabled = (value == BT_GATT_CCC_NOTIFY) ? 1 : 0;
+    ccc_store_changed();
+}
+
+static void climate_cp_ccc_cfg_changed(const struct bt_gatt_attr *attr,
+                 u16_t value)
+{
+    ccc_store_changed();
+}
+
+/**
+* @private
+* @brief Starts an immediate measurement of the requested sensors
+*
+* The response is notified on the control point to the writing central when
+* every sensor has reported, together with the request latency.
+*/
+static ssize_t write_climate_cp(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, const void *buf,
+                 u16_t len, u16_t offset, u8_t flags)
+{
+    const struct climate_cp_measure_now *req = buf;
+    u8_t fields;
+    u8_t started;
+
+    if (offset) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    if (len != sizeof(*req)) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    if (req->opcode != CLIMATE_CP_MEASURE_NOW ||
+        !(req->fields & CLIMATE_CYCLE_FIELDS)) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+
+    if (!notify_ccc_enabled(_cp_ccc_cfg, conn)) {
+        return BT_GATT_ERR(BT_ATT_ERR_CCC_IMPROPER_CONF);
+    }
+
+    fields = req->fields & CLIMATE_CYCLE_FIELDS;
+
+    if (!atomic_cas(&_measure_pending, 0, fields)) {
+        return BT_GATT_ERR(BT_ATT_ERR_PROCEDURE_IN_PROGRESS);
+    }
+
+    _measure_conn = bt_conn_ref(conn);
+    _measure_start = k_uptime_get();
+
+    started = readings_refresh(fields);
+    if (!started) {
+        bt_conn_unref(_measure_conn);
+        _measure_conn = NULL;
+        atomic_set(&_measure_pending, 0);
+        return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+    }
+
+    /* Sensors that cannot be started are left out of the response */
+    _measure_fields = started;
+    if (atomic_and(&_measure_pending, started) & started) {
+        k_delayed_work_submit(&_measure_timeout_work, CLIMATE_MEASURE_TIMEOUT);
+    } else {
+        /* Everything reported before the request was fully set up */
+        k_delayed_work_submit(&_measure_timeout_work, K_NO_WAIT);
+    }
+
+    SYS_LOG_DBG("Measure now, fields:0x%02x", started);
+
+    return len;
+}
+
+/**
+* @private
+* @brief Answers the pending measure now request
+*/
+static void climate_measure_complete(u8_t status)
+{
+    struct climate_cp_rsp rsp;
+    u32_t latency = k_uptime_get() - _measure_start;
+
+    k_delayed_work_cancel(&_measure_timeout_work);
+
+    rsp.opcode     = CLIMATE_CP_RESPONSE;
+    rsp.req_opcode = CLIMATE_CP_MEASURE_NOW;
+    rsp.status     = status;
+    rsp.fields     = _measure_fields & ~atomic_get(&_measure_pending);
+    rsp.latency    = sys_cpu_to_le16(min(latency, 0xffff));
+
+    notify_submit(_measure_conn, &climate_attrs[6], &rsp, sizeof(rsp));
+    bt_conn_unref(_measure_conn);
+    _measure_conn = NULL;
+
+    _measure_stats.count++;
+    _measure_stats.last_latency_ms = latency;
+    if (latency > _measure_stats.max_latency_ms) {
+        _measure_stats.max_latency_ms = latency;
+    }
+    if (status != CLIMATE_CP_SUCCESS) {
+        _measure_stats.timeouts++;
+    }
+
+    SYS_LOG_INF("Measure now done in %u ms, status %u", latency, status);
+
+    atomic_set(&_measure_pending, 0);
+}
+
+static void measure_timeout_work_handler(struct k_work *work)
+{
+    if (_measure_conn == NULL) {
+        return;
+    }
+
+    climate_measure_complete(atomic_get(&_measure_pending) ?
+                 CLIMATE_CP_TIMEOUT : CLIMATE_CP_SUCCESS);
+}
+
+static void notify_work_handler(struct k_work *work)
+{
+    struct climate_meas rsp;
+
+    _cycle_open = false;
+    _meas.timestamp = k_uptime_get_32() / MSEC_PER_SEC;
+
+    if (_is_notify_enabled) {
+        climate_meas_encode(&rsp);
+        notify_submit_all(&climate_attrs[2], _ccc_cfg, &rsp, sizeof(rsp));
+    }
+
+    SYS_LOG_DBG("Cycle closed, updated:0x%02x", _meas.updated);
+
+    _meas.updated = 0;
+}
+
+/**
+* @private
+* @brief Records an updated field and schedules the cycle notification
+*
+* The first update of a cycle opens a coalescing window. The notification
+* goes out when all periodic fields have been reported, or when the window
+* expires, whichever comes first.
+*/
+static void climate_field_updated(u8_t field)
+{
+    _meas.updated |= field;
+
+    if (!_is_initialized) {
+        return;
+    }
+
+    /* A completed measure now request is notified without waiting */
+    if ((atomic_and(&_measure_pending, ~field) & ~field) == 0 &&
+        _measure_conn != NULL) {
+        k_delayed_work_cancel(&_notify_work);
+        k_delayed_work_submit(&_notify_work, K_NO_WAIT);
+        _cycle_open = true;
+        climate_measure_complete(CLIMATE_CP_SUCCESS);
+        return;
+    }
+
+    if ((_meas.updated & CLIMATE_CYCLE_FIELDS) == CLIMATE_CYCLE_FIELDS) {
+        k_delayed_work_cancel(&_notify_work);
+        k_delayed_work_submit(&_notify_work, K_NO_WAIT);
+        _cycle_open = true;
+        return;
+    }
+
+    if (!_cycle_open) {
+        k_delayed_work_submit(&_notify_work,
+                      K_MSEC(CLIMATE_COALESCE_WINDOW_MS));
+        _cycle_open = true;
+    }
+}
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+void climate_init(void)
+{
+    k_delayed_work_init(&_notify_work, notify_work_handler);
+    k_delayed_work_init(&_measure_timeout_work, measure_timeout_work_handler);
+    _is_initialized = true;
+
+    bt_gatt_service_register(&climate_svc);
+    ccc_store_register("clim", _ccc_cfg, ARRAY_SIZE(_ccc_cfg));
+    ccc_store_register("clim_cp", _cp_ccc_cfg, ARRAY_SIZE(_cp_ccc_cfg));
+}
+
+void climate_temperature_update(s16_t temperature)
+{
+    _meas.temperature = temperature;
+    climate_field_updated(CLIMATE_TEMPERATURE);
+}
+
+void climate_humidity_update(u16_t humidity)
+{
+    _meas.humidity = humidity;
+    climate_field_updated(CLIMATE_HUMIDITY);
+}
+
+void climate_als_update(u16_t ambient_light)
+{
+    _meas.ambient_light = ambient_light;
+    climate_field_updated(CLIMATE_AMBIENT_LIGHT);
+}
+
+void climate_baro_press_update(u32_t pressure)
+{
+    _meas.pressure = pressure;
+    climate_field_updated(CLIMATE_BARO_PRESSURE);
+}
+
+void climate_battery_update(u8_t battery)
+{
+    /* Battery changes ride along with the next cycle notification */
+    _meas.battery = battery;
+    _meas.updated |= CLIMATE_BATTERY;
+}
+
+void climate_measure_stats_get(climate_measure_stats_t *stats)
+{
+    memcpy(stats, &_measure_stats, sizeof(*stats));
+}
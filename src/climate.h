@@ -0,0 +1,44 @@
+/** @file
+ *  @brief Walnut Climate Service
+ *
+ *  Vendor service with a single compact characteristic carrying every
+ *  climate reading of one measurement cycle, so that a subscribed central
+ *  receives one notification per cycle instead of one per ESS
+ *  characteristic.
+ *
+ *  A control point starts an immediate measurement of selected sensors;
+ *  the measurement is notified as soon as they have all reported.
+ */
+
+#ifndef CLIMATE_H
+#define CLIMATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+/* Time to wait for the remaining sensors of a cycle before notifying */
+#define CLIMATE_COALESCE_WINDOW_MS  2000
+
+typedef struct {
+    u32_t count;            /* Measure now requests answered */
+    u32_t timeouts;         /* Answered before every sensor reported */
+    u32_t last_latency_ms;  /* Request to notification */
+    u32_t max_latency_ms;
+} climate_measure_stats_t;
+
+void climate_init(void);
+void climate_temperature_update(s16_t temperature);
+void climate_humidity_update(u16_t humidity);
+void climate_als_update(u16_t ambient_light);
+void climate_baro_press_update(u32_t pressure);
+void climate_battery_update(u8_t battery);
+void climate_measure_stats_get(climate_measure_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLIMATE_H */
@@ -0,0 +1,332 @@
+/** @file
+ *  @brief Connection parameter policy
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+
+#include "conn_param.h"
+
+#ifndef CONFIG_SYS_LOG_CONN_PARAM_LEVEL
+#define CONFIG_SYS_LOG_CONN_PARAM_LEVEL 0
+#endif
+
+#define SYS_LOG_DOMAIN "conn_param"
+#define SYS_LOG_LEVEL CONFIG_SYS_LOG_CONN_PARAM_LEVEL
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Let the central finish service discovery before slowing the link down */
+#define CONN_PARAM_IDLE_DELAY       K_SECONDS(5)
+
+/* Idle: 400-500 ms interval, skip up to 9 events, 12 s supervision timeout */
+#define CONN_PARAM_IDLE_INT_MIN     320
+#define CONN_PARAM_IDLE_INT_MAX     400
+#define CONN_PARAM_IDLE_LATENCY     9
+#define CONN_PARAM_IDLE_TIMEOUT     1200
+
+/* Bulk: 7.5-15 ms interval, no latency, 4 s supervision timeout */
+#define CONN_PARAM_BULK_INT_MIN     6
+#define CONN_PARAM_BULK_INT_MAX     12
+#define CONN_PARAM_BULK_LATENCY     0
+#define CONN_PARAM_BULK_TIMEOUT     400
+
+/* Connection interval unit, us */
+#define CONN_PARAM_INTERVAL_UNIT    1250
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+typedef enum {
+    CONN_PARAM_NONE,
+    CONN_PARAM_IDLE,
+    CONN_PARAM_BULK,
+} conn_param_profile_t;
+
+struct conn_param_slot {
+    struct bt_conn *conn;
+    struct k_delayed_work work;
+    conn_param_profile_t requested;
+    u16_t interval;
+    u16_t latency;
+    u16_t timeout;
+    s64_t since;            /* Uptime the events were last counted at */
+    u32_t rem_us;           /* Time not yet covered by a whole event */
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static const struct bt_le_conn_param _idle_param = {
+    .interval_min = CONN_PARAM_IDLE_INT_MIN,
+    .interval_max = CONN_PARAM_IDLE_INT_MAX,
+    .latency      = CONN_PARAM_IDLE_LATENCY,
+    .timeout      = CONN_PARAM_IDLE_TIMEOUT,
+};
+
+static const struct bt_le_conn_param _bulk_param = {
+    .interval_min = CONN_PARAM_BULK_INT_MIN,
+    .interval_max = CONN_PARAM_BULK_INT_MAX,
+    .latency      = CONN_PARAM_BULK_LATENCY,
+    .timeout      = CONN_PARAM_BULK_TIMEOUT,
+};
+
+static struct conn_param_slot _slots[CONFIG_BT_MAX_CONN];
+
+/* Number of bulk transfers in progress */
+static atomic_t _bulk_users;
+
+/* Connection events counted so far, see conn_param_events() */
+static u32_t _events;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static struct conn_param_slot *slot_find(struct bt_conn *conn)
+{
+    for (int i = 0; i < ARRAY_SIZE(_slots); i++) {
+        if (_slots[i].conn == conn) {
+            return &_slots[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+* @private
+* @brief Counts the connection events of a link since it was last counted
+*
+* With peripheral latency the controller skips events while it has nothing
+* to send, which is assumed to be always. The time short of a whole event
+* is carried over to the next count. Called with interrupts locked.
+*/
+static void slot_account(struct conn_param_slot *slot, s64_t now)
+{
+    u32_t period_us = slot->interval * CONN_PARAM_INTERVAL_UNIT *
+                      (slot->latency + 1);
+    u64_t elapsed_us = (u64_t)(now - slot->since) * USEC_PER_MSEC +
+                       slot->rem_us;
+
+    slot->since = now;
+
+    if (period_us == 0) {
+        slot->rem_us = 0;
+        return;
+    }
+
+    _events += elapsed_us / period_us;
+    slot->rem_us = elapsed_us % period_us;
+}
+
+static void slot_request(struct conn_param_slot *slot,
+                 conn_param_profile_t profile)
+{
+    const struct bt_le_conn_param *param;
+    int err;
+
+    if (slot->conn == NULL || slot->requested == profile) {
+        return;
+    }
+
+    param = (profile == CONN_PARAM_BULK) ? &_bulk_param : &_idle_param;
+
+    err = bt_conn_le_param_update(slot->conn, param);
+    if (err) {
+        SYS_LOG_ERR("Param update request failed (err %d)", err);
+        return;
+    }
+
+    SYS_LOG_DBG("Requested %s interval %u-%u latency %u",
+            (profile == CONN_PARAM_BULK) ? "bulk" : "idle",
+            param->interval_min, param->interval_max, param->latency);
+
+    slot->requested = profile;
+}
+
+static conn_param_profile_t current_profile(void)
+{
+    return atomic_get(&_bulk_users) ? CONN_PARAM_BULK : CONN_PARAM_IDLE;
+}
+
+static void slot_work_handler(struct k_work *work)
+{
+    struct conn_param_slot *slot =
+        CONTAINER_OF(work, struct conn_param_slot, work);
+
+    slot_request(slot, current_profile());
+}
+
+static void apply_all(void)
+{
+    for (int i = 0; i < ARRAY_SIZE(_slots); i++) {
+        if (_slots[i].conn != NULL) {
+            k_delayed_work_submit(&_slots[i].work, K_NO_WAIT);
+        }
+    }
+}
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+void conn_param_init(void)
+{
+    for (int i = 0; i < ARRAY_SIZE(_slots); i++) {
+        k_delayed_work_init(&_slots[i].work, slot_work_handler);
+    }
+}
+
+void conn_param_connected(struct bt_conn *conn)
+{
+    struct conn_param_slot *slot = slot_find(NULL);
+    struct bt_conn_info info;
+    unsigned int key;
+
+    if (slot == NULL) {
+        SYS_LOG_ERR("No free connection slot");
+        return;
+    }
+
+    bt_conn_get_info(conn, &info);
+
+    key = irq_lock();
+    slot->conn = bt_conn_ref(conn);
+    slot->requested = CONN_PARAM_NONE;
+    slot->interval = info.le.interval;
+    slot->latency = info.le.latency;
+    slot->timeout = info.le.timeout;
+    slot->since = k_uptime_get();
+    slot->rem_us = 0;
+    irq_unlock(key);
+
+    SYS_LOG_INF("Interval %u latency %u timeout %u", slot->interval,
+                slot->latency, slot->timeout);
+
+    /* Bulk transfers cannot wait for discovery to finish */
+    k_delayed_work_submit(&slot->work,
+                  atomic_get(&_bulk_users) ? K_NO_WAIT :
+                  CONN_PARAM_IDLE_DELAY);
+}
+
+void conn_param_disconnected(struct bt_conn *conn)
+{
+    struct conn_param_slot *slot = slot_find(conn);
+    unsigned int key;
+
+    if (slot == NULL) {
+        return;
+    }
+
+    k_delayed_work_cancel(&slot->work);
+
+    key = irq_lock();
+    slot_account(slot, k_uptime_get());
+    slot->conn = NULL;
+    irq_unlock(key);
+
+    bt_conn_unref(conn);
+}
+
+void conn_param_updated(struct bt_conn *conn, u16_t interval,
+                        u16_t latency, u16_t timeout)
+{
+    struct conn_param_slot *slot = slot_find(conn);
+    const struct bt_le_conn_param *param;
+    unsigned int key;
+
+    SYS_LOG_INF("Updated interval %u latency %u timeout %u", interval,
+                latency, timeout);
+
+    if (slot == NULL) {
+        return;
+    }
+
+    /* The events so far ran at the old parameters */
+    key = irq_lock();
+    slot_account(slot, k_uptime_get());
+    slot->interval = interval;
+    slot->latency = latency;
+    slot->timeout = timeout;
+    irq_unlock(key);
+
+    if (slot->requested == CONN_PARAM_NONE) {
+        return;
+    }
+
+    param = (slot->requested == CONN_PARAM_BULK) ? &_bulk_param :
+                                                   &_idle_param;
+
+    if (interval < param->interval_min || interval > param->interval_max ||
+        latency != param->latency) {
+        SYS_LOG_WRN("Central did not accept %s parameters",
+                (slot->requested == CONN_PARAM_BULK) ? "bulk" : "idle");
+    }
+}
+
+/**
+* @brief Requests short connection intervals until conn_param_bulk_end()
+*
+* Calls nest; the links return to idle parameters when the last bulk
+* transfer has ended.
+*/
+void conn_param_bulk_begin(void)
+{
+    if (atomic_inc(&_bulk_users) == 0) {
+        apply_all();
+    }
+}
+
+void conn_param_bulk_end(void)
+{
+    if (atomic_dec(&_bulk_users) == 1) {
+        apply_all();
+    }
+}
+
+/**
+* @brief Gets the estimated connection events of all links since boot
+*
+* Counted from the interval and latency of every link and the time it
+* spent at them. Safe from any thread.
+*/
+u32_t conn_param_events(void)
+{
+    unsigned int key = irq_lock();
+    s64_t now = k_uptime_get();
+    u32_t events;
+
+    for (int i = 0; i < ARRAY_SIZE(_slots); i++) {
+        if (_slots[i].conn != NULL) {
+            slot_account(&_slots[i], now);
+        }
+    }
+
+    events = _events;
+    irq_unlock(key);
+
+    return events;
+}
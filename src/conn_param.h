@@ -0,0 +1,34 @@
+/** @file
+ *  @brief Connection parameter policy
+ *
+ *  Requests a long connection interval with high peripheral latency while
+ *  a link is idle, and a short interval while a bulk transfer is running.
+ */
+
+#ifndef CONN_PARAM_H
+#define CONN_PARAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+struct bt_conn;
+
+void conn_param_init(void);
+void conn_param_connected(struct bt_conn *conn);
+void conn_param_disconnected(struct bt_conn *conn);
+void conn_param_updated(struct bt_conn *conn, u16_t interval,
+                        u16_t latency, u16_t timeout);
+
+void conn_param_bulk_begin(void);
+void conn_param_bulk_end(void);
+
+u32_t conn_param_events(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_PARAM_H */
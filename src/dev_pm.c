@@ -0,0 +1,177 @@
+/** @file
+ *  @brief Usage counted device power management
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <errno.h>
+#include <zephyr.h>
+#include <device.h>
+
+#include "dev_pm.h"
+
+#define SYS_LOG_DOMAIN "dev_pm"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+struct dev_pm_slot {
+    struct device *dev;
+    struct device *parent;
+    u8_t users;
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static struct dev_pm_slot _slots[DEV_PM_MAX];
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static struct dev_pm_slot *slot_find(struct device *dev)
+{
+    for (int i = 0; i < ARRAY_SIZE(_slots); i++) {
+        if (_slots[i].dev == dev) {
+            return &_slots[i];
+        }
+    }
+
+    return NULL;
+}
+
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+static int set_state(struct device *dev, u32_t state)
+{
+    int err = device_set_power_state(dev, state);
+
+    if (err) {
+        SYS_LOG_ERR("%s: state %u failed (err %d)", dev->config->name,
+                    state, err);
+    }
+
+    return err;
+}
+#endif
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Puts a device under usage counting and suspends it
+*
+* @param parent Device that has to be active while @p dev is, e.g. the
+*               rail it is powered from, or NULL. Must be added first.
+*/
+int dev_pm_add(struct device *dev, struct device *parent)
+{
+    struct dev_pm_slot *slot;
+
+    if (dev == NULL) {
+        return -EINVAL;
+    }
+
+    if (slot_find(dev) != NULL) {
+        return 0;
+    }
+
+    if (parent != NULL && slot_find(parent) == NULL) {
+        return -EINVAL;
+    }
+
+    slot = slot_find(NULL);
+    if (slot == NULL) {
+        return -ENOMEM;
+    }
+
+    slot->dev = dev;
+    slot->parent = parent;
+    slot->users = 0;
+
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    return set_state(dev, DEVICE_PM_SUSPEND_STATE);
+#else
+    return 0;
+#endif
+}
+
+/**
+* @brief Resumes a device for a user
+*
+* Must be called from the system workqueue, where the sensors are sampled.
+*/
+int dev_pm_get(struct device *dev)
+{
+    struct dev_pm_slot *slot = slot_find(dev);
+    int err;
+
+    if (dev == NULL || slot == NULL) {
+        return -EINVAL;
+    }
+
+    if (slot->users++ > 0) {
+        return 0;
+    }
+
+    if (slot->parent != NULL) {
+        err = dev_pm_get(slot->parent);
+        if (err) {
+            slot->users--;
+            return err;
+        }
+    }
+
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    err = set_state(dev, DEVICE_PM_ACTIVE_STATE);
+    if (err) {
+        slot->users--;
+        if (slot->parent != NULL) {
+            dev_pm_put(slot->parent);
+        }
+        return err;
+    }
+#endif
+
+    return 0;
+}
+
+/**
+* @brief Releases a device, suspending it when it was the last user
+*/
+int dev_pm_put(struct device *dev)
+{
+    struct dev_pm_slot *slot = slot_find(dev);
+    int err = 0;
+
+    if (dev == NULL || slot == NULL || slot->users == 0) {
+        return -EINVAL;
+    }
+
+    if (--slot->users > 0) {
+        return 0;
+    }
+
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+    err = set_state(dev, DEVICE_PM_SUSPEND_STATE);
+#endif
+
+    if (slot->parent != NULL) {
+        dev_pm_put(slot->parent);
+    }
+
+    return err;
+}
@@ -0,0 +1,32 @@
+/** @file
+ *  @brief Usage counted device power management
+ *
+ *  Sensors are shared between the periodic measurements and the burst
+ *  service. A device is resumed when its first user calls dev_pm_get() and
+ *  suspended when the last one calls dev_pm_put(); a device on the sensor
+ *  rail keeps the rail up while it is in use.
+ */
+
+#ifndef DEV_PM_H
+#define DEV_PM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+/* Devices that can be managed */
+#define DEV_PM_MAX              4
+
+struct device;
+
+int dev_pm_add(struct device *dev, struct device *parent);
+int dev_pm_get(struct device *dev);
+int dev_pm_put(struct device *dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEV_PM_H */
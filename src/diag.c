@@ -0,0 +1,347 @@
+/** @file
+ *  @brief Walnut Diagnostic Service
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <zephyr.h>
+#include <misc/byteorder.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "diag.h"
+#include "energy.h"
+#include "probe.h"
+#include "metrics.h"
+#include "ram.h"
+
+#define SYS_LOG_DOMAIN "diag"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+#define DIAG_ENERGY_NAME        "Energy Report"
+#define DIAG_MODEL_NAME         "Energy Model"
+#define DIAG_LATENCY_NAME       "Latency Histograms"
+#define DIAG_METRICS_NAME       "Metrics"
+#define DIAG_STACKS_NAME        "Stack Usage"
+
+/* Window, total and one average per consumer, all u32 */
+#define DIAG_ENERGY_LEN         ((2 + ENERGY_COUNT) * sizeof(u32_t))
+
+/* Current and charge per consumer, all u32 */
+#define DIAG_MODEL_LEN          (ENERGY_COUNT * 2 * sizeof(u32_t))
+
+/* Count, max and total as u32, then the u16 buckets, per probe */
+#define DIAG_PROBE_LEN          (3 * sizeof(u32_t) + \
+                                 PROBE_BUCKETS * sizeof(u16_t))
+#define DIAG_LATENCY_LEN        (PROBE_COUNT * DIAG_PROBE_LEN)
+
+/* Thread, size, used and suggested size per stack */
+#define DIAG_STACK_LEN          (sizeof(u32_t) + 3 * sizeof(u16_t))
+
+/* Latency write: clears every histogram */
+#define DIAG_LATENCY_RESET      0x01
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+/* Model write: replaces the figures of one consumer */
+struct diag_model_write {
+    u8_t consumer;
+    u32_t current_na;
+    u32_t charge_nc;
+} __packed;
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static struct bt_uuid_128 diag_svc_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x00, 0x04, 0xa1, 0x57);
+
+static struct bt_uuid_128 diag_energy_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x01, 0x04, 0xa1, 0x57);
+
+static struct bt_uuid_128 diag_model_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x02, 0x04, 0xa1, 0x57);
+
+static struct bt_uuid_128 diag_latency_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x03, 0x04, 0xa1, 0x57);
+
+static struct bt_uuid_128 diag_metrics_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x04, 0x04, 0xa1, 0x57);
+
+static struct bt_uuid_128 diag_stacks_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x05, 0x04, 0xa1, 0x57);
+
+/* Encoded at offset 0, so a long read returns one consistent report */
+static u8_t _energy_buf[DIAG_ENERGY_LEN];
+static u8_t _latency_buf[DIAG_LATENCY_LEN];
+static u8_t _stacks_buf[RAM_STACKS_MAX * DIAG_STACK_LEN];
+static u16_t _stacks_len;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+/**
+* @private
+* @brief Reads the energy report
+*
+* Little endian: window in s, total average current in nA, then the
+* average current in nA of every consumer in energy_consumer_t order.
+* The average current in nA equals the charge in nAh used per hour.
+*/
+static ssize_t read_energy(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, void *buf,
+                 u16_t len, u16_t offset)
+{
+    energy_report_t report;
+    u8_t *p = _energy_buf;
+
+    if (offset == 0) {
+        energy_report_get(&report);
+
+        sys_put_le32(report.window_s, p);
+        sys_put_le32(report.total_na, p + 4);
+        p += 8;
+
+        for (int i = 0; i < ENERGY_COUNT; i++) {
+            sys_put_le32(report.avg_na[i], p);
+            p += 4;
+        }
+    }
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, _energy_buf,
+                 sizeof(_energy_buf));
+}
+
+static ssize_t read_model(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, void *buf,
+                 u16_t len, u16_t offset)
+{
+    energy_model_t model[ENERGY_COUNT];
+    u8_t rsp[DIAG_MODEL_LEN];
+    u8_t *p = rsp;
+
+    energy_model_get(model);
+
+    for (int i = 0; i < ENERGY_COUNT; i++) {
+        sys_put_le32(model[i].current_na, p);
+        sys_put_le32(model[i].charge_nc, p + 4);
+        p += 8;
+    }
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, rsp, sizeof(rsp));
+}
+
+/**
+* @private
+* @brief Replaces the model figures of one consumer, e.g. after calibration
+*
+* The model is not stored; it reverts to the defaults on reset.
+*/
+static ssize_t write_model(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, const void *buf,
+                 u16_t len, u16_t offset, u8_t flags)
+{
+    const struct diag_model_write *req = buf;
+    energy_model_t model;
+
+    if (offset) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    if (len != sizeof(*req)) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    model.current_na = sys_le32_to_cpu(req->current_na);
+    model.charge_nc = sys_le32_to_cpu(req->charge_nc);
+
+    if (energy_model_set(req->consumer, &model)) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+
+    SYS_LOG_INF("Model %u: %u nA, %u nC", req->consumer,
+            model.current_na, model.charge_nc);
+
+    return len;
+}
+
+/**
+* @private
+* @brief Reads the latency histograms
+*
+* Per probe in probe_id_t order, little endian: count, max in us and total
+* in us as u32, then PROBE_BUCKETS u16 counts. All zero when the probes
+* are compiled out.
+*/
+static ssize_t read_latency(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, void *buf,
+                 u16_t len, u16_t offset)
+{
+    probe_hist_t hist;
+    u8_t *p = _latency_buf;
+
+    if (offset == 0) {
+        memset(_latency_buf, 0, sizeof(_latency_buf));
+
+        for (int i = 0; i < PROBE_COUNT; i++) {
+            probe_hist_get(i, &hist);
+
+            sys_put_le32(hist.count, p);
+            sys_put_le32(hist.max_us, p + 4);
+            sys_put_le32((u32_t)hist.total_us, p + 8);
+            p += 12;
+
+            for (int b = 0; b < PROBE_BUCKETS; b++) {
+                sys_put_le16(hist.buckets[b], p);
+                p += 2;
+            }
+        }
+    }
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, _latency_buf,
+                 sizeof(_latency_buf));
+}
+
+static ssize_t write_latency(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, const void *buf,
+                 u16_t len, u16_t offset, u8_t flags)
+{
+    if (offset) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    if (len != 1) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    if (*(u8_t *)buf != DIAG_LATENCY_RESET) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+
+    probe_reset();
+
+    return len;
+}
+
+/**
+* @private
+* @brief Reads every metric in one packet, see metrics_encode()
+*/
+static ssize_t read_metrics(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, void *buf,
+                 u16_t len, u16_t offset)
+{
+    u8_t rsp[METRICS_ENCODED_LEN];
+    u8_t rsp_len;
+
+    rsp_len = metrics_encode(rsp, sizeof(rsp));
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, rsp, rsp_len);
+}
+
+/**
+* @private
+* @brief Reads the stack high-water marks, the interrupt stack first
+*
+* Per stack, little endian: thread structure address as u32 (0 for the
+* interrupt stack, look the others up in the ELF file), then size, bytes
+* used and suggested size as u16.
+*/
+static ssize_t read_stacks(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, void *buf,
+                 u16_t len, u16_t offset)
+{
+    ram_stack_t stacks[RAM_STACKS_MAX];
+    u8_t *p = _stacks_buf;
+    int count;
+
+    if (offset == 0) {
+        count = ram_stacks_get(stacks, ARRAY_SIZE(stacks));
+
+        for (int i = 0; i < count; i++) {
+            sys_put_le32(stacks[i].thread, p);
+            sys_put_le16(stacks[i].size, p + 4);
+            sys_put_le16(stacks[i].used, p + 6);
+            sys_put_le16(ram_stack_suggest(&stacks[i]), p + 8);
+            p += DIAG_STACK_LEN;
+        }
+
+        _stacks_len = p - _stacks_buf;
+    }
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, _stacks_buf,
+                 _stacks_len);
+}
+
+static struct bt_gatt_attr diag_attrs[] = {
+    BT_GATT_PRIMARY_SERVICE(&diag_svc_uuid),
+
+    BT_GATT_CHARACTERISTIC(&diag_energy_uuid.uuid, BT_GATT_CHRC_READ,
+                    BT_GATT_PERM_READ,
+                    read_energy, NULL, NULL),
+    BT_GATT_CUD(DIAG_ENERGY_NAME, BT_GATT_PERM_READ),
+
+    BT_GATT_CHARACTERISTIC(&diag_model_uuid.uuid,
+                    BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+                    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE_ENCRYPT,
+                    read_model, write_model, NULL),
+    BT_GATT_CUD(DIAG_MODEL_NAME, BT_GATT_PERM_READ),
+
+    BT_GATT_CHARACTERISTIC(&diag_latency_uuid.uuid,
+                    BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+                    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+                    read_latency, write_latency, NULL),
+    BT_GATT_CUD(DIAG_LATENCY_NAME, BT_GATT_PERM_READ),
+
+    BT_GATT_CHARACTERISTIC(&diag_metrics_uuid.uuid, BT_GATT_CHRC_READ,
+                    BT_GATT_PERM_READ,
+                    read_metrics, NULL, NULL),
+    BT_GATT_CUD(DIAG_METRICS_NAME, BT_GATT_PERM_READ),
+
+    BT_GATT_CHARACTERISTIC(&diag_stacks_uuid.uuid, BT_GATT_CHRC_READ,
+                    BT_GATT_PERM_READ,
+                    read_stacks, NULL, NULL),
+    BT_GATT_CUD(DIAG_STACKS_NAME, BT_GATT_PERM_READ),
+};
+
+static struct bt_gatt_service diag_svc = BT_GATT_SERVICE(diag_attrs);
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+void diag_init(void)
+{
+    bt_gatt_service_register(&diag_svc);
+}
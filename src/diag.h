@@ -0,0 +1,25 @@
+/** @file
+ *  @brief Walnut Diagnostic Service
+ *
+ *  Insight into the running node for field debugging. The energy
+ *  report gives the estimated average current of every consumer since boot;
+ *  the energy model it is computed with can be read and replaced. The
+ *  latency histograms of the probes can be read and cleared, and the
+ *  runtime metrics are read in a single packet. Stack usage shows how far
+ *  each stack could be shrunk.
+ */
+
+#ifndef DIAG_H
+#define DIAG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void diag_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DIAG_H */
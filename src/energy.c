@@ -0,0 +1,245 @@
+/** @file
+ *  @brief Energy accounting
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <zephyr.h>
+#include <device.h>
+#include <power.h>
+
+#ifdef CONFIG_SYS_POWER_MANAGEMENT
+#include "nrf.h"
+#endif
+
+#ifdef CONFIG_I2C_WRAP
+#include "i2c_wrap.h"
+#endif
+
+#include "energy.h"
+#include "adv.h"
+#include "conn_param.h"
+#include "notify.h"
+
+#define SYS_LOG_DOMAIN "energy"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+#define CYCLES_TO_US(c)     (SYS_CLOCK_HW_CYCLES_TO_NS64(c) / NSEC_PER_USEC)
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+/*
+ * Typical figures from the nRF51822, Si7020, TSL4531 and BMP280 datasheets
+ * at 3 V. They are a starting point, not a measurement.
+ */
+static energy_model_t _model[ENERGY_COUNT] = {
+    [ENERGY_CPU]         = { .current_na = 4400000 },
+    [ENERGY_IDLE]        = { .current_na = 2600 },
+    [ENERGY_ADV]         = { .charge_nc = 15000 },
+    [ENERGY_CONN]        = { .charge_nc = 6000 },
+    [ENERGY_TX]          = { .charge_nc = 1000 },
+    [ENERGY_RAIL]        = { .current_na = 10000 },
+    [ENERGY_SI7020]      = { .current_na = 150000 },
+    [ENERGY_TSL4531]     = { .current_na = 110000 },
+    [ENERGY_BMP280]      = { .current_na = 720000 },
+    [ENERGY_ADC]         = { .current_na = 260000 },
+    [ENERGY_FLASH_WRITE] = { .charge_nc = 3000 },
+    [ENERGY_FLASH_ERASE] = { .charge_nc = 165000 },
+};
+
+/* Pushed by the consumers */
+static u64_t _time_us[ENERGY_COUNT];
+static u32_t _events[ENERGY_COUNT];
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+/**
+* @private
+* @brief Collects the counters kept by other modules
+*/
+static void collect(u64_t time_us[ENERGY_COUNT], u32_t events[ENERGY_COUNT])
+{
+    unsigned int key;
+
+    key = irq_lock();
+    memcpy(time_us, _time_us, sizeof(_time_us));
+    memcpy(events, _events, sizeof(_events));
+    irq_unlock(key);
+
+#if defined(CONFIG_BT) || defined(CONFIG_WALNUT_BT_STUB)
+    {
+        adv_stats_t adv_stats;
+        notify_stats_t notify_stats;
+
+        adv_stats_get(&adv_stats);
+        events[ENERGY_ADV] += adv_stats.events;
+
+        events[ENERGY_CONN] += conn_param_events();
+
+        notify_stats_get(&notify_stats);
+        events[ENERGY_TX] += notify_stats.sent;
+    }
+#endif
+
+#ifdef CONFIG_I2C_WRAP
+    {
+        struct device *rail = device_get_binding(CONFIG_I2C_WRAP_NAME);
+
+        if (rail != NULL) {
+            time_us[ENERGY_RAIL] += i2c_wrap_rail_time_get(rail);
+        }
+    }
+#endif
+}
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Adds active time of a consumer
+*
+* @param cycles Hardware cycles, as from differences of k_cycle_get_32()
+*/
+void energy_time_add(energy_consumer_t consumer, u32_t cycles)
+{
+    u64_t us = CYCLES_TO_US(cycles);
+    unsigned int key;
+
+    if (consumer >= ENERGY_COUNT) {
+        return;
+    }
+
+    key = irq_lock();
+    _time_us[consumer] += us;
+    irq_unlock(key);
+}
+
+void energy_event_add(energy_consumer_t consumer, u32_t count)
+{
+    unsigned int key;
+
+    if (consumer >= ENERGY_COUNT) {
+        return;
+    }
+
+    key = irq_lock();
+    _events[consumer] += count;
+    irq_unlock(key);
+}
+
+int energy_model_set(energy_consumer_t consumer, const energy_model_t *model)
+{
+    if (consumer >= ENERGY_COUNT) {
+        return -EINVAL;
+    }
+
+    _model[consumer] = *model;
+
+    return 0;
+}
+
+void energy_model_get(energy_model_t model[ENERGY_COUNT])
+{
+    memcpy(model, _model, sizeof(_model));
+}
+
+/**
+* @brief Gets the raw active time and event counts since boot
+*/
+void energy_counts_get(u64_t time_us[ENERGY_COUNT],
+                       u32_t events[ENERGY_COUNT])
+{
+    collect(time_us, events);
+}
+
+/**
+* @brief Estimates the average current of every consumer since boot
+*
+* The CPU counts as running whenever it is not idle. Idle time is measured
+* by the kernel idle hook below, which needs CONFIG_SYS_POWER_MANAGEMENT;
+* without it (native_posix) the idle floor is charged over the whole
+* window, CPU reads 0 and the CPU time spent on radio events is covered by
+* their charge per event.
+*/
+void energy_report_get(energy_report_t *report)
+{
+    u64_t time_us[ENERGY_COUNT];
+    u32_t events[ENERGY_COUNT];
+    u64_t window_us = (u64_t)k_uptime_get() * USEC_PER_MSEC;
+    u64_t charge_nc;
+
+    collect(time_us, events);
+
+#ifdef CONFIG_SYS_POWER_MANAGEMENT
+    if (window_us > time_us[ENERGY_IDLE]) {
+        time_us[ENERGY_CPU] = window_us - time_us[ENERGY_IDLE];
+    }
+#else
+    time_us[ENERGY_IDLE] = window_us;
+#endif
+
+    memset(report, 0, sizeof(*report));
+    report->window_s = window_us / USEC_PER_SEC;
+
+    if (window_us == 0) {
+        return;
+    }
+
+    for (int i = 0; i < ENERGY_COUNT; i++) {
+        /* nA * us = 1e-6 nC */
+        charge_nc = time_us[i] * _model[i].current_na / USEC_PER_SEC +
+                    (u64_t)events[i] * _model[i].charge_nc;
+
+        /* nC / s = nA */
+        report->avg_na[i] = charge_nc * USEC_PER_SEC / window_us;
+        report->total_na += report->avg_na[i];
+    }
+}
+
+#ifdef CONFIG_SYS_POWER_MANAGEMENT
+/*
+ * Kernel idle hook, entered with interrupts locked. With interrupts still
+ * locked the WFI wakes on a pending interrupt without taking it, so the
+ * handler and any thread it readies are not counted as idle. The nRF51
+ * has no deeper state in this kernel, the WFI is the System ON idle the
+ * idle thread would enter itself; reporting the low power state keeps the
+ * kernel from idling again.
+ */
+int _sys_soc_suspend(s32_t ticks)
+{
+    u32_t start = k_cycle_get_32();
+
+    __WFI();
+
+    _time_us[ENERGY_IDLE] += CYCLES_TO_US(k_cycle_get_32() - start);
+
+    irq_unlock(0);
+
+    return SYS_PM_LOW_POWER_STATE;
+}
+
+void _sys_soc_resume(void)
+{
+}
+#endif
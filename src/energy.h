@@ -0,0 +1,58 @@
+/** @file
+ *  @brief Energy accounting
+ *
+ *  Counts active time and events for every consumer on the board and turns
+ *  them into an estimated average current with a per-consumer model. The
+ *  model holds typical datasheet figures and can be replaced at runtime,
+ *  e.g. with values calibrated on a power analyser.
+ */
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+typedef enum {
+    ENERGY_CPU,             /* Time: CPU running */
+    ENERGY_IDLE,            /* Time: System ON idle */
+    ENERGY_ADV,             /* Events: advertising events */
+    ENERGY_CONN,            /* Events: connection events */
+    ENERGY_TX,              /* Events: notifications sent */
+    ENERGY_RAIL,            /* Time: ambient light sensor rail on */
+    ENERGY_SI7020,          /* Time: Si7020 sampling */
+    ENERGY_TSL4531,         /* Time: TSL4531 sampling */
+    ENERGY_BMP280,          /* Time: BMP280 sampling */
+    ENERGY_ADC,             /* Time: battery ADC conversion */
+    ENERGY_FLASH_WRITE,     /* Events: flash records written */
+    ENERGY_FLASH_ERASE,     /* Events: flash pages erased */
+    ENERGY_COUNT
+} energy_consumer_t;
+
+typedef struct {
+    u32_t current_na;       /* Current while active */
+    u32_t charge_nc;        /* Charge per event */
+} energy_model_t;
+
+typedef struct {
+    u32_t window_s;                 /* Time since boot */
+    u32_t total_na;                 /* Sum of all consumers */
+    u32_t avg_na[ENERGY_COUNT];     /* Average current, nA = nAh per hour */
+} energy_report_t;
+
+void energy_time_add(energy_consumer_t consumer, u32_t cycles);
+void energy_event_add(energy_consumer_t consumer, u32_t count);
+int energy_model_set(energy_consumer_t consumer, const energy_model_t *model);
+void energy_model_get(energy_model_t model[ENERGY_COUNT]);
+void energy_counts_get(u64_t time_us[ENERGY_COUNT],
+                       u32_t events[ENERGY_COUNT]);
+void energy_report_get(energy_report_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ENERGY_H */
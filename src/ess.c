@@ -22,6 +22,10 @@
 
 #include "ess.h"
 #include "nv.h"
+#include "notify.h"
+#include "readings.h"
+#include "ccc_store.h"
+#include "adv.h"
 
 #define SYS_LOG_DOMAIN "ESS"
 #define SYS_LOG_LEVEL 1
@@ -37,23 +41,36 @@
 #define AMBIENT_LIGHT_SENSOR_NAME   "Ambient Light Sensor"
 #define BARO_PRESSURE_SENSOR_NAME   "Barometric Pressure Sensor"
 
-/* ESS Trigger Setting conditions */
-#define ESS_TRIGGER_INACTIVE                0x00
-#define ESS_FIXED_TIME_INTERVAL             0x01
-#define ESS_NO_LESS_THAN_SPECIFIED_TIME     0x02
-#define ESS_VALUE_CHANGED                   0x03
-#define ESS_LESS_THAN_REF_VALUE             0x04
-#define ESS_LESS_OR_EQUAL_TO_REF_VALUE      0x05
-#define ESS_GREATER_THAN_REF_VALUE          0x06
-#define ESS_GREATER_OR_EQUAL_TO_REF_VALUE   0x07
-#define ESS_EQUAL_TO_REF_VALUE              0x08
-#define ESS_NOT_EQUAL_TO_REF_VALUE          0x09
+/* ESS application error for a trigger condition the server does not take */
+#define ESS_ERR_CONDITION_NOT_SUPPORTED 0x81
 
 
 /****************************************************************************
 * Private Type Declarations
 ***************************************************************************/
 
+typedef enum {
+    ESS_TEMPERATURE,
+    ESS_HUMIDITY,
+    ESS_AMBIENT_LIGHT,
+    ESS_BARO_PRESSURE,
+    ESS_SENSOR_COUNT,
+} ess_sensor_id_t;
+
+/* Trigger state of one connected central */
+struct ess_conn {
+    struct bt_conn *conn;
+    s32_t notified_value[ESS_SENSOR_COUNT];
+    u8_t notified;      /* Bit per sensor with a valid notified_value */
+    atomic_t refresh;   /* Bit per sensor read stale, notified when refreshed */
+};
+
+/* Read-through cache settings of a value characteristic */
+struct ess_reading {
+    readings_ch_t ch;
+    u32_t max_age_ms;   /* Older values are re-measured before a read */
+};
+
 struct ess_meas_desc {
     u16_t flags; /* Reserved for Future Use */
     u8_t sampling_func;
@@ -118,6 +135,11 @@ struct es_trigger_setting_reference {
     s16_t ref_val;
 } __packed;
 
+struct es_trigger_setting_reference_32 {
+    u8_t condition;
+    u32_t ref_val;
+} __packed;
+
 
 /****************************************************************************
 * Private Data Definitions
@@ -128,14 +150,37 @@ static struct ess_sensor            _humidity;
 static struct ess_sensor            _ambient_light;
 static struct ess_pressure_sensor   _baro_pressure;
 
+static struct ess_conn _conns[CONFIG_BT_MAX_CONN];
+
+/* Descriptor of a sensor whose module has not stored its own yet */
+static const nv_sensor_data_t _default_sensor_data = {
+    .sampling_func    = ESS_SAMPL_FUNC_INSTANTANEOUS,
+    .meas_period      = ESS_MEAS_PERIOD_NOT_IN_USE,
+    .update_interval  = 60,
+    .application      = ESS_APPL_Air,
+    .meas_uncertainty = 0,
+    .max_age          = 30,
+};
+
+/* Snapshot channel served by each value characteristic */
+static struct ess_reading _readings[ESS_SENSOR_COUNT] = {
+    [ESS_TEMPERATURE]   = { .ch = READINGS_CH_TEMPERATURE },
+    [ESS_HUMIDITY]      = { .ch = READINGS_CH_HUMIDITY },
+    [ESS_AMBIENT_LIGHT] = { .ch = READINGS_CH_AMBIENT_LIGHT },
+    [ESS_BARO_PRESSURE] = { .ch = READINGS_CH_BARO_PRESSURE },
+};
+
+/* Set while at least one central is subscribed */
 static u8_t _is_temp_notify_enabled;
 static u8_t _is_humidity_notify_enabled;
 static u8_t _is_ambient_light_notify_enabled;
 static u8_t _is_baro_pressure_notify_enabled;
 
-static ssize_t read_u16_value(struct bt_conn *conn, const struct bt_gatt_attr *attr,
-            void *buf, u16_t len, u16_t offset);
-static ssize_t read_u32_value(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+/* Bit per sensor whose value meets its reference value condition */
+static u8_t _alarms;
+
+static struct ess_conn *ess_conn_find(struct bt_conn *conn);
+static ssize_t read_reading(struct bt_conn *conn, const struct bt_gatt_attr *attr,
             void *buf, u16_t len, u16_t offset);
 static ssize_t read_es_measurement(struct bt_conn *conn,
                    const struct bt_gatt_attr *attr, void *buf,
@@ -162,6 +207,14 @@ static ssize_t read_trigger_setting_32(struct bt_conn *conn,
                      const struct bt_gatt_attr *attr,
                      void *buf, u16_t len,
                      u16_t offset);
+static ssize_t write_trigger_setting(struct bt_conn *conn,
+                     const struct bt_gatt_attr *attr,
+                     const void *buf, u16_t len,
+                     u16_t offset, u8_t flags);
+static ssize_t write_trigger_setting_32(struct bt_conn *conn,
+                     const struct bt_gatt_attr *attr,
+                     const void *buf, u16_t len,
+                     u16_t offset, u8_t flags);
 
 
 static struct bt_gatt_attr ess_attrs[] = {
@@ -171,7 +224,7 @@ static struct bt_gatt_attr ess_attrs[] = {
     BT_GATT_CHARACTERISTIC(BT_UUID_TEMPERATURE,
                     BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
                     BT_GATT_PERM_READ,
-                    read_u16_value, NULL, &_temperature.value),
+                    read_reading, NULL, &_readings[ESS_TEMPERATURE]),
     BT_GATT_CUD(TEMPERATURE_SENSOR_NAME, BT_GATT_PERM_READ),
     BT_GATT_DESCRIPTOR(BT_UUID_ES_MEASUREMENT, BT_GATT_PERM_READ,
                     read_es_measurement, NULL, &_temperature.meas_desc),
@@ -179,15 +232,15 @@ static struct bt_gatt_attr ess_attrs[] = {
                     BT_GATT_PERM_READ,
                     read_valid_range, NULL, &_temperature),
     BT_GATT_DESCRIPTOR(BT_UUID_ES_TRIGGER_SETTING,
-               BT_GATT_PERM_READ, read_trigger_setting,
-               NULL, &_temperature),
+               BT_GATT_PERM_READ | BT_GATT_PERM_WRITE_ENCRYPT,
+               read_trigger_setting, write_trigger_setting, &_temperature),
     BT_GATT_CCC(_temperature.ccc_cfg, temp_ccc_cfg_changed),
 
     /* Humidity Sensor */
     BT_GATT_CHARACTERISTIC(BT_UUID_HUMIDITY,
                     BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
                     BT_GATT_PERM_READ,
-                    read_u16_value, NULL, &_humidity.value),
+                    read_reading, NULL, &_readings[ESS_HUMIDITY]),
     BT_GATT_CUD(HUMIDITY_SENSOR_NAME, BT_GATT_PERM_READ),
     BT_GATT_DESCRIPTOR(BT_UUID_ES_MEASUREMENT, BT_GATT_PERM_READ,
                read_es_measurement, NULL, &_humidity.meas_desc),
@@ -195,15 +248,15 @@ static struct bt_gatt_attr ess_attrs[] = {
                     BT_GATT_PERM_READ,
                     read_valid_range, NULL, &_humidity),
     BT_GATT_DESCRIPTOR(BT_UUID_ES_TRIGGER_SETTING,
-               BT_GATT_PERM_READ, read_trigger_setting,
-               NULL, &_humidity),
+               BT_GATT_PERM_READ | BT_GATT_PERM_WRITE_ENCRYPT,
+               read_trigger_setting, write_trigger_setting, &_humidity),
     BT_GATT_CCC(_humidity.ccc_cfg, rh_ccc_cfg_changed),
 
     /* Ambient Light Sensor */
     BT_GATT_CHARACTERISTIC(BT_UUID_IRRADIANCE,
                     BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
                     BT_GATT_PERM_READ,
-                    read_u16_value, NULL, &_ambient_light.value),
+                    read_reading, NULL, &_readings[ESS_AMBIENT_LIGHT]),
     BT_GATT_CUD(AMBIENT_LIGHT_SENSOR_NAME, BT_GATT_PERM_READ),
     BT_GATT_DESCRIPTOR(BT_UUID_ES_MEASUREMENT, BT_GATT_PERM_READ,
                read_es_measurement, NULL, &_ambient_light.meas_desc),
@@ -211,15 +264,15 @@ static struct bt_gatt_attr ess_attrs[] = {
                     BT_GATT_PERM_READ,
                     read_valid_range, NULL, &_ambient_light),
     BT_GATT_DESCRIPTOR(BT_UUID_ES_TRIGGER_SETTING,
-               BT_GATT_PERM_READ, read_trigger_setting,
-               NULL, &_ambient_light),
+               BT_GATT_PERM_READ | BT_GATT_PERM_WRITE_ENCRYPT,
+               read_trigger_setting, write_trigger_setting, &_ambient_light),
     BT_GATT_CCC(_ambient_light.ccc_cfg, al_ccc_cfg_changed),
 
     /* Barometric Pressure Sensor */
     BT_GATT_CHARACTERISTIC(BT_UUID_PRESSURE,
                     BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
                     BT_GATT_PERM_READ,
-                    read_u32_value, NULL, &_baro_pressure.value),
+                    read_reading, NULL, &_readings[ESS_BARO_PRESSURE]),
     BT_GATT_CUD(BARO_PRESSURE_SENSOR_NAME, BT_GATT_PERM_READ),
     BT_GATT_DESCRIPTOR(BT_UUID_ES_MEASUREMENT, BT_GATT_PERM_READ,
                read_es_measurement, NULL, &_baro_pressure.meas_desc),
@@ -227,8 +280,9 @@ static struct bt_gatt_attr ess_attrs[] = {
                     BT_GATT_PERM_READ,
                     read_valid_range_32, NULL, &_baro_pressure),
     BT_GATT_DESCRIPTOR(BT_UUID_ES_TRIGGER_SETTING,
-               BT_GATT_PERM_READ, read_trigger_setting_32,
-               NULL, &_baro_pressure),
+               BT_GATT_PERM_READ | BT_GATT_PERM_WRITE_ENCRYPT,
+               read_trigger_setting_32, write_trigger_setting_32,
+               &_baro_pressure),
     BT_GATT_CCC(_baro_pressure.ccc_cfg, bp_ccc_cfg_changed),
 };
 
@@ -259,24 +313,59 @@ static inline u32_t le24_to_int(const u8_t *u24)
 }
 
 
-static ssize_t read_u16_value(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+/**
+* @private
+* @brief Serves a value characteristic from the readings snapshot
+*
+* Called from the Bluetooth RX thread, so it never waits: the snapshot copy
+* does not wait for a sensor update in progress, and a value older than the
+* characteristic's max age is answered from the cache while it is measured
+* again. A subscribed central is notified of the new value when it is
+* published, whatever its trigger condition.
+*/
+static ssize_t read_reading(struct bt_conn *conn, const struct bt_gatt_attr *attr,
             void *buf, u16_t len, u16_t offset)
 {
-    const u16_t *u16 = attr->user_data;
-    u16_t value = sys_cpu_to_le16(*u16);
-
-    return bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
-                 sizeof(value));
-}
+    const struct ess_reading *reading = attr->user_data;
+    struct ess_conn *ec;
+    readings_t snapshot;
+    u16_t u16;
+    u32_t u32;
+
+    /* Only the first chunk of a long read may start a measurement */
+    if (offset == 0) {
+        if (readings_read_cached(&snapshot, reading->ch,
+                                 reading->max_age_ms) == -EAGAIN) {
+            SYS_LOG_DBG("Serving stale value of channel %d", reading->ch);
+            ec = ess_conn_find(conn);
+            if (ec != NULL) {
+                atomic_set_bit(&ec->refresh, reading - _readings);
+            }
+        }
+    } else {
+        readings_read(&snapshot);
+    }
 
-static ssize_t read_u32_value(struct bt_conn *conn, const struct bt_gatt_attr *attr,
-            void *buf, u16_t len, u16_t offset)
-{
-    const u32_t *u32 = attr->user_data;
-    u32_t value = sys_cpu_to_le32(*u32);
+    switch (reading->ch) {
+    case READINGS_CH_TEMPERATURE:
+        u16 = sys_cpu_to_le16(snapshot.temperature);
+        break;
+    case READINGS_CH_HUMIDITY:
+        u16 = sys_cpu_to_le16(snapshot.humidity);
+        break;
+    case READINGS_CH_AMBIENT_LIGHT:
+        u16 = sys_cpu_to_le16(snapshot.ambient_light);
+        break;
+    case READINGS_CH_BARO_PRESSURE:
+        u32 = sys_cpu_to_le32(snapshot.pressure);
+        return bt_gatt_attr_read(conn, attr, buf, len, offset, &u32,
+                     sizeof(u32));
+    default:
+        return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+    }
 
-    return bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
-                 sizeof(value));
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &u16,
+                 sizeof(u16));
 }
 
 
@@ -284,24 +373,28 @@ static void temp_ccc_cfg_changed(const struct bt_gatt_attr *attr,
                  u16_t value)
 {
     _is_temp_notify_enabled = (value == BT_GATT_CCC_NOTIFY) ? 1 : 0;
+    ccc_store_changed();
 }
 
 static void rh_ccc_cfg_changed(const struct bt_gatt_attr *attr,
                  u16_t value)
 {
     _is_humidity_notify_enabled = (value == BT_GATT_CCC_NOTIFY) ? 1 : 0;
+    ccc_store_changed();
 }
 
 static void al_ccc_cfg_changed(const struct bt_gatt_attr *attr,
                  u16_t value)
 {
     _is_ambient_light_notify_enabled = (value == BT_GATT_CCC_NOTIFY) ? 1 : 0;
+    ccc_store_changed();
 }
 
 static void bp_ccc_cfg_changed(const struct bt_gatt_attr *attr,
                  u16_t value)
 {
     _is_baro_pressure_notify_enabled = (value == BT_GATT_CCC_NOTIFY) ? 1 : 0;
+    ccc_store_changed();
 }
 
 
@@ -416,10 +509,10 @@ static ssize_t read_trigger_setting_32(struct bt_conn *conn,
         }
     /* Reference value */
     default: {
-            struct es_trigger_setting_reference rp;
+            struct es_trigger_setting_reference_32 rp;
 
             rp.condition = sensor->condition;
-            rp.ref_val = sys_cpu_to_le16(sensor->ref_val);
+            rp.ref_val = sys_cpu_to_le32(sensor->ref_val);
 
             return bt_gatt_attr_read(conn, attr, buf, len, offset,
                          &rp, sizeof(rp));
@@ -427,100 +520,292 @@ static ssize_t read_trigger_setting_32(struct bt_conn *conn,
     }
 }
 
-static bool check_condition(u8_t condition, s16_t old_val, s16_t new_val,
-                s16_t ref_val)
+/**
+* @private
+* @brief Parses an ES Trigger Setting written by a central
+*
+* The reference value has the format of the characteristic, @p ref_len
+* bytes.
+*
+* @return 0 with the condition and its operand, or an ATT error
+*/
+static ssize_t trigger_setting_parse(const void *buf, u16_t len,
+                     u16_t offset, u16_t ref_len,
+                     u8_t *condition, u32_t *operand)
 {
-    switch (condition) {
+    const u8_t *value = buf;
+
+    if (offset) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    if (len < 1) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    switch (value[0]) {
+    /* Operand N/A */
     case ESS_TRIGGER_INACTIVE:
-        return false;
+        /* fallthrough */
+    case ESS_VALUE_CHANGED:
+        if (len != 1) {
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        }
+        *operand = 0;
+        break;
+    /* Seconds */
     case ESS_FIXED_TIME_INTERVAL:
+        /* fallthrough */
     case ESS_NO_LESS_THAN_SPECIFIED_TIME:
-        /* TODO: Check time requirements */
-        return false;
-    case ESS_VALUE_CHANGED:
-        return new_val != old_val;
-    case ESS_LESS_THAN_REF_VALUE:
-        return new_val < ref_val;
-    case ESS_LESS_OR_EQUAL_TO_REF_VALUE:
-        return new_val <= ref_val;
-    case ESS_GREATER_THAN_REF_VALUE:
-        return new_val > ref_val;
-    case ESS_GREATER_OR_EQUAL_TO_REF_VALUE:
-        return new_val >= ref_val;
-    case ESS_EQUAL_TO_REF_VALUE:
-        return new_val == ref_val;
-    case ESS_NOT_EQUAL_TO_REF_VALUE:
-        return new_val != ref_val;
+        if (len != 1 + 3) {
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        }
+        *operand = le24_to_int(&value[1]);
+        break;
+    /* Reference value */
     default:
-        return false;
+        if (value[0] > ESS_NOT_EQUAL_TO_REF_VALUE) {
+            return BT_GATT_ERR(ESS_ERR_CONDITION_NOT_SUPPORTED);
+        }
+        if (len != 1 + ref_len) {
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        }
+        *operand = (ref_len == sizeof(u16_t)) ? sys_get_le16(&value[1]) :
+                                                sys_get_le32(&value[1]);
+        break;
     }
+
+    *condition = value[0];
+
+    return 0;
 }
 
+/**
+* @private
+* @brief Sets the trigger condition of a sensor
+*
+* Called from the Bluetooth RX thread. The condition applies to every
+* central from the next value on.
+*/
+static ssize_t write_trigger_setting(struct bt_conn *conn,
+                     const struct bt_gatt_attr *attr,
+                     const void *buf, u16_t len,
+                     u16_t offset, u8_t flags)
+{
+    struct ess_sensor *sensor = attr->user_data;
+    u8_t condition;
+    u32_t operand;
+    ssize_t err;
 
-static void ess_temperature_sensor_init()
+    err = trigger_setting_parse(buf, len, offset, sizeof(sensor->ref_val),
+                                &condition, &operand);
+    if (err) {
+        return err;
+    }
+
+    if (condition == ESS_FIXED_TIME_INTERVAL ||
+        condition == ESS_NO_LESS_THAN_SPECIFIED_TIME) {
+        sensor->seconds = operand;
+    } else {
+        sensor->ref_val = (s16_t)operand;
+    }
+    sensor->condition = condition;
+
+    return len;
+}
+
+static ssize_t write_trigger_setting_32(struct bt_conn *conn,
+                     const struct bt_gatt_attr *attr,
+                     const void *buf, u16_t len,
+                     u16_t offset, u8_t flags)
 {
-    int err;
-    nv_sensor_data_t sensor_data;
-    struct ess_meas_desc *meas_desc = &_temperature.meas_desc;
+    struct ess_pressure_sensor *sensor = attr->user_data;
+    u8_t condition;
+    u32_t operand;
+    ssize_t err;
 
-    err = nv_get_sensor_data(NV_SENSOR_TEMPERATURE, &sensor_data);
+    err = trigger_setting_parse(buf, len, offset, sizeof(sensor->ref_val),
+                                &condition, &operand);
     if (err) {
-        SYS_LOG_ERR("Failed to get temperature NV data");
-        return;
+        return err;
     }
 
-    meas_desc->sampling_func    = sensor_data.sampling_func;
-    meas_desc->meas_period      = sensor_data.meas_period;
-    meas_desc->update_interval  = sensor_data.update_interval;
-    meas_desc->application      = sensor_data.application;
-    meas_desc->meas_uncertainty = sensor_data.meas_uncertainty;
+    if (condition == ESS_FIXED_TIME_INTERVAL ||
+        condition == ESS_NO_LESS_THAN_SPECIFIED_TIME) {
+        sensor->seconds = operand;
+    } else {
+        sensor->ref_val = operand;
+    }
+    sensor->condition = condition;
 
-    _temperature.condition = ESS_VALUE_CHANGED;
-    _temperature.lower_limit = -4000;
-    _temperature.upper_limit = 8500;
+    return len;
 }
 
-static void ess_humidity_sensor_init()
+static struct ess_conn *ess_conn_find(struct bt_conn *conn)
 {
-    int err;
-    nv_sensor_data_t sensor_data;
-    struct ess_meas_desc *meas_desc = &_humidity.meas_desc;
+    for (int i = 0; i < ARRAY_SIZE(_conns); i++) {
+        if (_conns[i].conn == conn) {
+            return &_conns[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+* @private
+* @brief Notifies every subscribed central whose trigger condition is met
+*
+* The condition is evaluated against the value last notified to that
+* central, so one central's notifications do not affect another's
+* "value changed" trigger.
+*/
+static void ess_notify_conns(ess_sensor_id_t id, const struct bt_gatt_attr *attr,
+                 const struct bt_gatt_ccc_cfg *ccc_cfg, u8_t condition,
+                 s32_t ref_val, s32_t new_value,
+                 const void *data, u16_t len)
+{
+    struct ess_conn *ec;
+    bool refresh;
+    bool notify;
+
+    for (int i = 0; i < ARRAY_SIZE(_conns); i++) {
+        ec = &_conns[i];
+
+        /* Set by read_reading() on the RX thread */
+        refresh = atomic_test_and_clear_bit(&ec->refresh, id);
+
+        if (ec->conn == NULL || !notify_ccc_enabled(ccc_cfg, ec->conn)) {
+            continue;
+        }
+
+        if (refresh) {
+            /* Read stale, the central waits for the refreshed value */
+            notify = true;
+        } else {
+            notify = ess_should_notify(condition, ec->notified & BIT(id),
+                                       ec->notified_value[id], new_value,
+                                       ref_val);
+        }
+
+        if (notify) {
+            notify_submit(ec->conn, attr, data, len);
+            ec->notified_value[id] = new_value;
+            ec->notified |= BIT(id);
+        }
+    }
+}
+
+/**
+* @private
+* @brief Brings gateways back quickly when a value raises an alarm
+*
+* A reference value trigger condition is an alarm. A value that starts
+* meeting it switches advertising back to the fast interval, whether or
+* not anyone is subscribed, so a gateway that is not connected finds the
+* node soon.
+*/
+static void ess_alarm_check(ess_sensor_id_t id, u8_t condition,
+                s32_t ref_val, s32_t new_value)
+{
+    bool alarm = condition >= ESS_LESS_THAN_REF_VALUE &&
+                 ess_check_condition(condition, 0, new_value, ref_val);
+
+    if (alarm && !(_alarms & BIT(id))) {
+        SYS_LOG_INF("Alarm on sensor %d", id);
+        adv_alarm();
+    }
+
+    WRITE_BIT(_alarms, id, alarm);
+}
+
+static void connected(struct bt_conn *conn, u8_t err)
+{
+    struct ess_conn *ec;
 
-    err = nv_get_sensor_data(NV_SENSOR_HUMIDITY, &sensor_data);
     if (err) {
-        SYS_LOG_ERR("Failed to get humidity NV data");
         return;
     }
 
-    meas_desc->sampling_func    = sensor_data.sampling_func;
-    meas_desc->meas_period      = sensor_data.meas_period;
-    meas_desc->update_interval  = sensor_data.update_interval;
-    meas_desc->application      = sensor_data.application;
-    meas_desc->meas_uncertainty = sensor_data.meas_uncertainty;
+    ec = ess_conn_find(NULL);
+    if (ec == NULL) {
+        return;
+    }
 
-    _humidity.condition = ESS_VALUE_CHANGED;
-    _humidity.lower_limit = 0;
-    _humidity.upper_limit = 10000;
+    ec->conn = bt_conn_ref(conn);
+    ec->notified = 0;
+    atomic_clear(&ec->refresh);
 }
 
-static void ess_ambient_light_sensor_init()
+static void disconnected(struct bt_conn *conn, u8_t reason)
 {
-    int err;
-    nv_sensor_data_t sensor_data;
-    struct ess_meas_desc *meas_desc = &_ambient_light.meas_desc;
+    struct ess_conn *ec = ess_conn_find(conn);
 
-    err = nv_get_sensor_data(NV_SENSOR_AMBIENT_LIGHT, &sensor_data);
-    if (err) {
-        SYS_LOG_ERR("Failed to get ambient light NV data");
+    if (ec == NULL) {
         return;
     }
 
+    bt_conn_unref(ec->conn);
+    ec->conn = NULL;
+}
+
+static struct bt_conn_cb conn_callbacks = {
+    .connected = connected,
+    .disconnected = disconnected,
+};
+
+
+/**
+* @private
+* @brief Loads the Measurement descriptor and max age of a sensor from NV
+*
+* Bluetooth comes up before the sensor modules store their defaults, so on
+* the first boot there is no record yet and the defaults below are used.
+*/
+static void ess_sensor_data_load(nv_types_t sensor, ess_sensor_id_t id,
+                 struct ess_meas_desc *meas_desc)
+{
+    nv_sensor_data_t sensor_data;
+
+    if (nv_get_sensor_data(sensor, &sensor_data)) {
+        SYS_LOG_WRN("No sensor%02d NV data, using defaults", sensor);
+        sensor_data = _default_sensor_data;
+    }
+
     meas_desc->sampling_func    = sensor_data.sampling_func;
     meas_desc->meas_period      = sensor_data.meas_period;
     meas_desc->update_interval  = sensor_data.update_interval;
     meas_desc->application      = sensor_data.application;
     meas_desc->meas_uncertainty = sensor_data.meas_uncertainty;
 
+    _readings[id].max_age_ms = sensor_data.max_age * MSEC_PER_SEC;
+}
+
+static void ess_temperature_sensor_init()
+{
+    ess_sensor_data_load(NV_SENSOR_TEMPERATURE, ESS_TEMPERATURE,
+                         &_temperature.meas_desc);
+
+    _temperature.condition = ESS_VALUE_CHANGED;
+    _temperature.lower_limit = -4000;
+    _temperature.upper_limit = 8500;
+}
+
+static void ess_humidity_sensor_init()
+{
+    ess_sensor_data_load(NV_SENSOR_HUMIDITY, ESS_HUMIDITY,
+                         &_humidity.meas_desc);
+
+    _humidity.condition = ESS_VALUE_CHANGED;
+    _humidity.lower_limit = 0;
+    _humidity.upper_limit = 10000;
+}
+
+static void ess_ambient_light_sensor_init()
+{
+    ess_sensor_data_load(NV_SENSOR_AMBIENT_LIGHT, ESS_AMBIENT_LIGHT,
+                         &_ambient_light.meas_desc);
+
     _ambient_light.condition = ESS_VALUE_CHANGED;
     _ambient_light.lower_limit = 0;
     // _ambient_light.upper_limit = 655350;
@@ -529,21 +814,8 @@ static void ess_ambient_light_sensor_init()
 
 static void ess_baro_pressure_sensor_init()
 {
-    int err;
-    nv_sensor_data_t sensor_data;
-    struct ess_meas_desc *meas_desc = &_baro_pressure.meas_desc;
-
-    err = nv_get_sensor_data(NV_SENSOR_BARO_PRESSURE, &sensor_data);
-    if (err) {
-        SYS_LOG_ERR("Failed to get barometric pressure NV data");
-        return;
-    }
-
-    meas_desc->sampling_func    = sensor_data.sampling_func;
-    meas_desc->meas_period      = sensor_data.meas_period;
-    meas_desc->update_interval  = sensor_data.update_interval;
-    meas_desc->application      = sensor_data.application;
-    meas_desc->meas_uncertainty = sensor_data.meas_uncertainty;
+    ess_sensor_data_load(NV_SENSOR_BARO_PRESSURE, ESS_BARO_PRESSURE,
+                         &_baro_pressure.meas_desc);
 
     _baro_pressure.condition = ESS_VALUE_CHANGED;
     _baro_pressure.lower_limit = 950000;
@@ -558,6 +830,16 @@ static void ess_baro_pressure_sensor_init()
 void ess_init(void)
 {
     bt_gatt_service_register(&ess_svc);
+    bt_conn_cb_register(&conn_callbacks);
+
+    ccc_store_register("ess_t", _temperature.ccc_cfg,
+                       ARRAY_SIZE(_temperature.ccc_cfg));
+    ccc_store_register("ess_rh", _humidity.ccc_cfg,
+                       ARRAY_SIZE(_humidity.ccc_cfg));
+    ccc_store_register("ess_al", _ambient_light.ccc_cfg,
+                       ARRAY_SIZE(_ambient_light.ccc_cfg));
+    ccc_store_register("ess_bp", _baro_pressure.ccc_cfg,
+                       ARRAY_SIZE(_baro_pressure.ccc_cfg));
 
     ess_temperature_sensor_init();
     ess_humidity_sensor_init();
@@ -567,80 +849,72 @@ void ess_init(void)
 
 void ess_temperature_update(s16_t new_value)
 {
-    bool notify = check_condition(_temperature.condition,
-                    _temperature.value, new_value,
-                    _temperature.ref_val);
-
     /* Update temperature value */
     _temperature.value = new_value;
 
+    ess_alarm_check(ESS_TEMPERATURE, _temperature.condition,
+            _temperature.ref_val, new_value);
+
     if (!_is_temp_notify_enabled) {
         return;
     }
 
-    /* Trigger notification if conditions are met */
-    if (notify) {
-        bt_gatt_notify(NULL, &ess_attrs[2], &_temperature.value, sizeof(_temperature.value));
-    }
-
+    /* Trigger notifications where conditions are met */
+    ess_notify_conns(ESS_TEMPERATURE, &ess_attrs[2], _temperature.ccc_cfg,
+             _temperature.condition, _temperature.ref_val, new_value,
+             &_temperature.value, sizeof(_temperature.value));
 }
 
 void ess_humidity_update(s16_t new_value)
 {
-    bool notify = check_condition(_humidity.condition,
-                      _humidity.value, new_value,
-                      _humidity.ref_val);
-
     /* Update humidity value */
     _humidity.value = new_value;
 
+    ess_alarm_check(ESS_HUMIDITY, _humidity.condition,
+            _humidity.ref_val, new_value);
+
     if (!_is_humidity_notify_enabled) {
         return;
     }
 
-    /* Trigger notification if conditions are met */
-    if (notify) {
-        bt_gatt_notify(NULL, &ess_attrs[9], &_humidity.value, sizeof(_humidity.value));
-    }
-
+    /* Trigger notifications where conditions are met */
+    ess_notify_conns(ESS_HUMIDITY, &ess_attrs[9], _humidity.ccc_cfg,
+             _humidity.condition, _humidity.ref_val, new_value,
+             &_humidity.value, sizeof(_humidity.value));
 }
 
-void ess_als_update(s16_t new_value)
+void ess_als_update(u16_t new_value)
 {
-    bool notify = check_condition(_ambient_light.condition,
-                      _ambient_light.value, new_value,
-                      _ambient_light.ref_val);
-
     /* Update ambient light value */
     _ambient_light.value = new_value;
 
+    ess_alarm_check(ESS_AMBIENT_LIGHT, _ambient_light.condition,
+            _ambient_light.ref_val, new_value);
+
     if (!_is_ambient_light_notify_enabled) {
         return;
     }
 
-    /* Trigger notification if conditions are met */
-    if (notify) {
-        bt_gatt_notify(NULL, &ess_attrs[16], &_ambient_light.value, sizeof(_ambient_light.value));
-    }
-
+    /* Trigger notifications where conditions are met */
+    ess_notify_conns(ESS_AMBIENT_LIGHT, &ess_attrs[16], _ambient_light.ccc_cfg,
+             _ambient_light.condition, _ambient_light.ref_val, new_value,
+             &_ambient_light.value, sizeof(_ambient_light.value));
 }
 
 void ess_baro_press_update(u32_t new_value)
 {
-    bool notify = check_condition(_baro_pressure.condition,
-                      _baro_pressure.value, new_value,
-                      _baro_pressure.ref_val);
-
     /* Update barometric pressure value */
     _baro_pressure.value = new_value;
 
+    ess_alarm_check(ESS_BARO_PRESSURE, _baro_pressure.condition,
+            _baro_pressure.ref_val, new_value);
+
     if (!_is_baro_pressure_notify_enabled) {
         return;
     }
 
-    /* Trigger notification if conditions are met */
-    if (notify) {
-        bt_gatt_notify(NULL, &ess_attrs[23], &_baro_pressure.value, sizeof(_baro_pressure.value));
-    }
-
+    /* Trigger notifications where conditions are met */
+    ess_notify_conns(ESS_BARO_PRESSURE, &ess_attrs[23], _baro_pressure.ccc_cfg,
+             _baro_pressure.condition, _baro_pressure.ref_val, new_value,
+             &_baro_pressure.value, sizeof(_baro_pressure.value));
 }
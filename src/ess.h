@@ -9,11 +9,24 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #define ESS_MEAS_PERIOD_NOT_IN_USE              0
 #define ESS_INTERNAL_UPDATE_INTERVAL_NOT_IN_USE 0
 
+/* ESS Trigger Setting conditions */
+#define ESS_TRIGGER_INACTIVE                0x00
+#define ESS_FIXED_TIME_INTERVAL             0x01
+#define ESS_NO_LESS_THAN_SPECIFIED_TIME     0x02
+#define ESS_VALUE_CHANGED                   0x03
+#define ESS_LESS_THAN_REF_VALUE             0x04
+#define ESS_LESS_OR_EQUAL_TO_REF_VALUE      0x05
+#define ESS_GREATER_THAN_REF_VALUE          0x06
+#define ESS_GREATER_OR_EQUAL_TO_REF_VALUE   0x07
+#define ESS_EQUAL_TO_REF_VALUE              0x08
+#define ESS_NOT_EQUAL_TO_REF_VALUE          0x09
+
 typedef enum {
     ESS_SAMPL_FUNC_UNSPECIFIED,
     ESS_SAMPL_FUNC_INSTANTANEOUS,
@@ -66,8 +79,12 @@ typedef enum {
 void ess_init(void);
 void ess_temperature_update(int16_t new_value);
 void ess_humidity_update(int16_t new_value);
-void ess_als_update(int16_t new_value);
+void ess_als_update(uint16_t new_value);
 void ess_baro_press_update(uint32_t new_value);
+bool ess_check_condition(uint8_t condition, int32_t old_val, int32_t new_val,
+                         int32_t ref_val);
+bool ess_should_notify(uint8_t condition, bool notified, int32_t old_val,
+                       int32_t new_val, int32_t ref_val);
 
 #ifdef __cplusplus
 }
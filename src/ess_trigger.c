@@ -0,0 +1,74 @@
+/** @file
+ *  @brief ESS trigger conditions
+ *
+ *  Kept apart from the service so that it builds without the Bluetooth
+ *  host, for the native variant and the host-side tools.
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ess.h"
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Evaluates an ESS Trigger Setting condition for a new value
+*
+* @param old_val Value last notified
+* @param ref_val Operand of the reference value conditions
+*/
+bool ess_check_condition(uint8_t condition, int32_t old_val, int32_t new_val,
+                         int32_t ref_val)
+{
+    switch (condition) {
+    case ESS_TRIGGER_INACTIVE:
+        return false;
+    case ESS_FIXED_TIME_INTERVAL:
+    case ESS_NO_LESS_THAN_SPECIFIED_TIME:
+        /* TODO: Check time requirements */
+        return false;
+    case ESS_VALUE_CHANGED:
+        return new_val != old_val;
+    case ESS_LESS_THAN_REF_VALUE:
+        return new_val < ref_val;
+    case ESS_LESS_OR_EQUAL_TO_REF_VALUE:
+        return new_val <= ref_val;
+    case ESS_GREATER_THAN_REF_VALUE:
+        return new_val > ref_val;
+    case ESS_GREATER_OR_EQUAL_TO_REF_VALUE:
+        return new_val >= ref_val;
+    case ESS_EQUAL_TO_REF_VALUE:
+        return new_val == ref_val;
+    case ESS_NOT_EQUAL_TO_REF_VALUE:
+        return new_val != ref_val;
+    default:
+        return false;
+    }
+}
+
+/**
+* @brief Decides whether a new value is notified to one central
+*
+* Until a value has been notified to the central any triggering condition
+* applies; after that the condition is evaluated against the value last
+* notified.
+*
+* @param notified Whether @p old_val has been notified to the central
+*/
+bool ess_should_notify(uint8_t condition, bool notified, int32_t old_val,
+                       int32_t new_val, int32_t ref_val)
+{
+    if (!notified) {
+        return condition != ESS_TRIGGER_INACTIVE;
+    }
+
+    return ess_check_condition(condition, old_val, new_val, ref_val);
+}
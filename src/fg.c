@@ -6,8 +6,18 @@
 
 #include <kernel.h>
 
+#ifdef CONFIG_EMUL
+#include "emul.h"
+#else
 #include "nrf.h"
+#endif
+
 #include "fg.h"
+#include "retained.h"
+#include "energy.h"
+#include "probe.h"
+#include "trace.h"
+#include "metrics.h"
 
 #define CONFIG_SYS_LOG_FG_LEVEL 1
 
@@ -18,7 +28,6 @@
 #define FG_MEAS_INTERVAL 120
 #define FG_VBG         1200
 #define FG_PRESCALER   3
-#define FG_NUM_VBAT_SAMPLES 30
 
 static fg_update_cb_t fg_cb;
 static struct k_timer meas_timer;
@@ -28,16 +37,21 @@ static struct k_work meas_work;
 // const uint16_t c_bat_levels_cr2032[BAT_LEVELS_CR2023] = {2800, 2700, 2600, 2500};
 const uint8_t temperature_compensation = 5;    // 5 mA * 1 Ohm @ 25 degC
 
-static uint16_t vbat_avg[FG_NUM_VBAT_SAMPLES];
-static uint8_t  vbat_idx;
+// Averaging state lives in retained RAM, see retained.h
+static retained_t *retained;
 
 static void meas_work_handler(struct k_work *work);
 static void meas_timer_handler(struct k_timer *timer);
 
-static uint16_t adc_acquire(void)
+#ifdef CONFIG_EMUL
+static uint16_t adc_convert(void)
+{
+    return adc_emul_convert();
+}
+#else
+static uint16_t adc_convert(void)
 {
     uint16_t adc_raw;
-    uint16_t vbat;
 
     // Configure ADC
     NRF_ADC->CONFIG = (ADC_CONFIG_RES_10bit << ADC_CONFIG_RES_Pos)
@@ -60,11 +74,31 @@ static uint16_t adc_acquire(void)
     NRF_ADC->EVENTS_END = 0;
     NRF_ADC->TASKS_STOP = 1;
 
+    // Keep the input and reference off between samples
+    NRF_ADC->ENABLE = ADC_ENABLE_ENABLE_Disabled;
+
+    return adc_raw;
+}
+#endif
+
+static uint16_t adc_acquire(void)
+{
+    uint16_t adc_raw;
+    uint16_t vbat;
+    u32_t start = k_cycle_get_32();
+
+    adc_raw = adc_convert();
+
+    energy_time_add(ENERGY_ADC, k_cycle_get_32() - start);
+
     vbat = adc_raw * FG_PRESCALER * FG_VBG / 1024;
     vbat += temperature_compensation;
 
-    vbat_avg[vbat_idx++] = vbat;
-    vbat_idx %= FG_NUM_VBAT_SAMPLES;
+    metrics_min(METRIC_VBAT_MIN_MV, vbat);
+
+    retained->vbat_avg[retained->vbat_idx++] = vbat;
+    retained->vbat_idx %= FG_NUM_VBAT_SAMPLES;
+    retained_update();
 
     SYS_LOG_DBG("ADC:%d", adc_raw);
     SYS_LOG_DBG("VBAT:%d", vbat);
@@ -79,8 +113,8 @@ static uint16_t vbat_avg_get(void)
     uint8_t num_samples = 0;
 
     for (int i = 0; i < FG_NUM_VBAT_SAMPLES; i++) {
-        if (vbat_avg[i] != 0) {
-            vbat_tot += vbat_avg[i];
+        if (retained->vbat_avg[i] != 0) {
+            vbat_tot += retained->vbat_avg[i];
             num_samples++;
         }
     }
@@ -113,14 +147,11 @@ static uint8_t convert_vbat_to_capacity(uint32_t vbat)
     return (uint8_t)(capacity + 0.5);
 }
 
-static void meas_work_handler(struct k_work *work)
+static void fg_report(void)
 {
     uint16_t vbat;
     uint8_t capacity;
 
-    SYS_LOG_DBG("Periodic FG measurement");
-
-    adc_acquire();
     vbat = vbat_avg_get();
     capacity = convert_vbat_to_capacity(vbat);
 
@@ -131,18 +162,40 @@ static void meas_work_handler(struct k_work *work)
     }
 }
 
+static void meas_work_handler(struct k_work *work)
+{
+    u32_t start = probe_start();
+
+    metrics_wakeup();
+
+    SYS_LOG_DBG("Periodic FG measurement");
+
+    adc_acquire();
+    fg_report();
+
+    probe_end(PROBE_FG_WORK, start);
+}
+
 static void meas_timer_handler(struct k_timer *timer)
 {
+    trace_event(TRACE_TIMER, PROBE_FG_WORK, 0);
     k_work_submit(&meas_work);
 }
 
 void fg_init(fg_update_cb_t cb)
 {
     fg_cb = cb;
-
-    adc_acquire();
+    retained = retained_get();
 
     k_work_init(&meas_work, meas_work_handler);
+
+    // The average continues from before a warm start
+    k_work_submit(&meas_work);
+
     k_timer_init(&meas_timer, meas_timer_handler, NULL);
-    k_timer_start(&meas_timer, K_SECONDS(5), K_SECONDS(FG_MEAS_INTERVAL));
+    k_timer_start(&meas_timer,
+                  retained_first_delay(READINGS_CH_BATTERY,
+                                       K_SECONDS(FG_MEAS_INTERVAL),
+                                       K_SECONDS(5)),
+                  K_SECONDS(FG_MEAS_INTERVAL));
 }
\ No newline at end of file
@@ -8,6 +8,9 @@
 
 #include <stdint.h>
 
+/* Battery voltage samples in the moving average */
+#define FG_NUM_VBAT_SAMPLES 30
+
 typedef void (*fg_update_cb_t)(uint8_t battery_capacity);
 
 void fg_init(fg_update_cb_t cb);
@@ -0,0 +1,453 @@
+/** @file
+ *  @brief GATT database layout and caching
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <zephyr.h>
+#include <misc/byteorder.h>
+#include <settings/settings.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include <tinycrypt/constants.h>
+#include <tinycrypt/aes.h>
+#include <tinycrypt/cmac_mode.h>
+
+#include "gatt_db.h"
+#include "ccc_store.h"
+#include "nv.h"
+
+#define SYS_LOG_DOMAIN "gatt_db"
+#define SYS_LOG_LEVEL 3
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Settings subtree, keys "gatt/hash" and "gatt/pend" */
+#define GATT_DB_SUBTREE         "gatt"
+
+/* Database Hash, not yet defined by this host */
+#define GATT_DB_UUID_HASH       BT_UUID_DECLARE_16(0x2b2a)
+
+/* Attribute types covered by the hash, Core 5.1 Vol 3 Part G 7.3 */
+#define GATT_DB_UUID_PRIMARY    0x2800
+#define GATT_DB_UUID_SECONDARY  0x2801
+#define GATT_DB_UUID_INCLUDE    0x2802
+#define GATT_DB_UUID_CHRC       0x2803
+#define GATT_DB_UUID_CEP        0x2900
+#define GATT_DB_UUID_CUD        0x2901
+#define GATT_DB_UUID_CCC        0x2902
+#define GATT_DB_UUID_SCC        0x2903
+#define GATT_DB_UUID_CPF        0x2904
+#define GATT_DB_UUID_CAF        0x2905
+
+/* Largest declaration value: characteristic with a 128-bit UUID */
+#define GATT_DB_DECL_MAX        19
+
+#define GATT_DB_PENDING_MAX     CONFIG_BT_MAX_PAIRED
+
+/* Base64 encoding of the pending list, including the terminator */
+#define GATT_DB_PENDING_STR_LEN \
+    ((sizeof(bt_addr_le_t) * GATT_DB_PENDING_MAX + 2) / 3 * 4 + 1)
+#define GATT_DB_HASH_STR_LEN    ((GATT_DB_HASH_LEN + 2) / 3 * 4 + 1)
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+struct gatt_db_sc {
+    struct bt_conn *conn;
+    struct bt_gatt_indicate_params params;
+    u16_t range[2];
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static struct bt_uuid_128 gatt_db_svc_uuid = BT_UUID_INIT_128(
+    0x00, 0x00, 0x74, 0x75, 0x6e, 0x6c, 0x61, 0x57,
+    0x00, 0x10, 0x00, 0x00, 0x00, 0x03, 0xa1, 0x57);
+
+static u8_t _hash[GATT_DB_HASH_LEN];
+
+/* Hash of the layout the bonded centrals last saw, from the settings */
+static u8_t _stored_hash[GATT_DB_HASH_LEN];
+static bool _has_stored_hash;
+
+/* Bonded centrals that have not been told about a layout change */
+static bt_addr_le_t _pending[GATT_DB_PENDING_MAX];
+static u8_t _num_pending;
+
+/* Service Changed value and its CCC, owned by the host */
+static const struct bt_gatt_attr *_sc_attr;
+static struct _bt_gatt_ccc *_sc_ccc;
+
+static struct gatt_db_sc _sc[CONFIG_BT_MAX_CONN];
+
+static ssize_t read_hash(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                         void *buf, u16_t len, u16_t offset)
+{
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, _hash,
+                 sizeof(_hash));
+}
+
+/* Registered before every other application service, handles never move */
+static struct bt_gatt_attr gatt_db_attrs[] = {
+    BT_GATT_PRIMARY_SERVICE(&gatt_db_svc_uuid),
+    BT_GATT_CHARACTERISTIC(GATT_DB_UUID_HASH, BT_GATT_CHRC_READ,
+                   BT_GATT_PERM_READ, read_hash, NULL, NULL),
+};
+
+static struct bt_gatt_service gatt_db_svc = BT_GATT_SERVICE(gatt_db_attrs);
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static u8_t hash_attr(const struct bt_gatt_attr *attr, void *user_data)
+{
+    struct tc_cmac_struct *cmac = user_data;
+    u8_t value[GATT_DB_DECL_MAX];
+    u16_t handle = sys_cpu_to_le16(attr->handle);
+    u16_t type;
+    ssize_t len;
+
+    /* Every type the hash covers is a 16-bit UUID */
+    if (attr->uuid->type != BT_UUID_TYPE_16) {
+        return BT_GATT_ITER_CONTINUE;
+    }
+
+    type = BT_UUID_16(attr->uuid)->val;
+
+    switch (type) {
+    case GATT_DB_UUID_PRIMARY:
+    case GATT_DB_UUID_SECONDARY:
+    case GATT_DB_UUID_INCLUDE:
+    case GATT_DB_UUID_CHRC:
+    case GATT_DB_UUID_CEP:
+        /* Handle, type and value */
+        len = attr->read(NULL, attr, value, sizeof(value), 0);
+        if (len < 0) {
+            SYS_LOG_ERR("Cannot read handle 0x%04x (err %d)", attr->handle,
+                        len);
+            len = 0;
+        }
+        break;
+    case GATT_DB_UUID_CUD:
+    case GATT_DB_UUID_CCC:
+    case GATT_DB_UUID_SCC:
+    case GATT_DB_UUID_CPF:
+    case GATT_DB_UUID_CAF:
+        /* Handle and type */
+        len = 0;
+        break;
+    default:
+        return BT_GATT_ITER_CONTINUE;
+    }
+
+    if (type == GATT_DB_UUID_PRIMARY) {
+        SYS_LOG_DBG("Service at 0x%04x", attr->handle);
+    }
+
+    type = sys_cpu_to_le16(type);
+    tc_cmac_update(cmac, (u8_t *)&handle, sizeof(handle));
+    tc_cmac_update(cmac, (u8_t *)&type, sizeof(type));
+    tc_cmac_update(cmac, value, len);
+
+    return BT_GATT_ITER_CONTINUE;
+}
+
+/**
+* @private
+* @brief Computes the database hash, AES-CMAC with a zero key
+*/
+static void hash_compute(void)
+{
+    static const u8_t key[16];
+    struct tc_aes_key_sched_struct sched;
+    struct tc_cmac_struct cmac;
+    u8_t tag[GATT_DB_HASH_LEN];
+
+    tc_cmac_setup(&cmac, key, &sched);
+    tc_cmac_init(&cmac);
+
+    bt_gatt_foreach_attr(0x0001, 0xffff, hash_attr, &cmac);
+
+    tc_cmac_final(tag, &cmac);
+
+    /* The characteristic value is little endian, CMAC output big endian */
+    sys_memcpy_swap(_hash, tag, sizeof(_hash));
+}
+
+static u8_t find_sc(const struct bt_gatt_attr *attr, void *user_data)
+{
+    if (_sc_attr == NULL) {
+        if (!bt_uuid_cmp(attr->uuid, BT_UUID_GATT_SC)) {
+            _sc_attr = attr;
+        }
+        return BT_GATT_ITER_CONTINUE;
+    }
+
+    /* The CCC follows the value */
+    if (!bt_uuid_cmp(attr->uuid, BT_UUID_GATT_CCC)) {
+        _sc_ccc = attr->user_data;
+    }
+
+    return BT_GATT_ITER_STOP;
+}
+
+static int pending_find(const bt_addr_le_t *addr)
+{
+    for (int i = 0; i < _num_pending; i++) {
+        if (!bt_addr_le_cmp(&_pending[i], addr)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void pending_save(void)
+{
+    char str[GATT_DB_PENDING_STR_LEN];
+    char *val = NULL;
+    int err;
+
+    if (_num_pending) {
+        val = settings_str_from_bytes(_pending,
+                          _num_pending * sizeof(_pending[0]),
+                          str, sizeof(str));
+    }
+
+    err = nv_settings_save(GATT_DB_SUBTREE "/pend", val);
+    if (err) {
+        SYS_LOG_ERR("Failed to store pending centrals (err %d)", err);
+    }
+}
+
+static void pending_remove(const bt_addr_le_t *addr)
+{
+    int i = pending_find(addr);
+
+    if (i < 0) {
+        return;
+    }
+
+    _pending[i] = _pending[--_num_pending];
+    pending_save();
+}
+
+static void sc_indicated(struct bt_conn *conn,
+                 const struct bt_gatt_attr *attr, u8_t err)
+{
+    if (!err) {
+        SYS_LOG_INF("Central acknowledged the layout change");
+        pending_remove(bt_conn_get_dst(conn));
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(_sc); i++) {
+        if (_sc[i].conn == conn) {
+            bt_conn_unref(_sc[i].conn);
+            _sc[i].conn = NULL;
+        }
+    }
+}
+
+static void connected(struct bt_conn *conn, u8_t conn_err)
+{
+    struct gatt_db_sc *sc = NULL;
+    int err;
+
+    if (conn_err || _sc_attr == NULL ||
+        pending_find(bt_conn_get_dst(conn)) < 0) {
+        return;
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(_sc); i++) {
+        if (_sc[i].conn == NULL) {
+            sc = &_sc[i];
+            break;
+        }
+    }
+
+    if (sc == NULL) {
+        return;
+    }
+
+    /* Everything may have moved */
+    sc->range[0] = sys_cpu_to_le16(0x0001);
+    sc->range[1] = sys_cpu_to_le16(0xffff);
+    sc->params.attr = _sc_attr;
+    sc->params.func = sc_indicated;
+    sc->params.data = sc->range;
+    sc->params.len = sizeof(sc->range);
+    sc->conn = bt_conn_ref(conn);
+
+    err = bt_gatt_indicate(conn, &sc->params);
+    if (err) {
+        SYS_LOG_ERR("Service Changed indication failed (err %d)", err);
+        bt_conn_unref(sc->conn);
+        sc->conn = NULL;
+    }
+}
+
+static void disconnected(struct bt_conn *conn, u8_t reason)
+{
+    for (int i = 0; i < ARRAY_SIZE(_sc); i++) {
+        if (_sc[i].conn == conn) {
+            bt_conn_unref(_sc[i].conn);
+            _sc[i].conn = NULL;
+        }
+    }
+}
+
+static struct bt_conn_cb conn_callbacks = {
+    .connected = connected,
+    .disconnected = disconnected,
+};
+
+static int gatt_db_set(int argc, char **argv, char *val)
+{
+    int len;
+    int err;
+
+    if (argc != 1 || val == NULL) {
+        return 0;
+    }
+
+    if (!strcmp(argv[0], "hash")) {
+        len = sizeof(_stored_hash);
+        err = settings_bytes_from_str(val, _stored_hash, &len);
+        _has_stored_hash = !err && len == sizeof(_stored_hash);
+        return err;
+    }
+
+    if (!strcmp(argv[0], "pend")) {
+        len = sizeof(_pending);
+        err = settings_bytes_from_str(val, _pending, &len);
+        _num_pending = err ? 0 : len / sizeof(_pending[0]);
+        return err;
+    }
+
+    return -ENOENT;
+}
+
+/**
+* @private
+* @brief Compares the layout with the one the bonded centrals know
+*
+* Runs once all settings have been loaded, so the bond keys and the
+* restored Service Changed subscriptions are in place.
+*/
+static int gatt_db_commit(void)
+{
+    char str[GATT_DB_HASH_STR_LEN];
+    int err;
+
+    hash_compute();
+
+    if (_has_stored_hash && !memcmp(_hash, _stored_hash, sizeof(_hash))) {
+        return 0;
+    }
+
+    /*
+     * Only subscribed centrals can be told, the others rediscover. With no
+     * stored hash a bonded subscriber was bonded by firmware that did not
+     * store one, and its layout is unknown, so it is told as well.
+     */
+    if (_sc_ccc != NULL) {
+        for (size_t i = 0; i < _sc_ccc->cfg_len; i++) {
+            const struct bt_gatt_ccc_cfg *cfg = &_sc_ccc->cfg[i];
+
+            if (!(cfg->value & BT_GATT_CCC_INDICATE) ||
+                !bt_addr_le_is_bonded(&cfg->peer) ||
+                pending_find(&cfg->peer) >= 0 ||
+                _num_pending >= GATT_DB_PENDING_MAX) {
+                continue;
+            }
+
+            bt_addr_le_copy(&_pending[_num_pending++], &cfg->peer);
+        }
+    }
+
+    SYS_LOG_INF("Layout changed, %u centrals to notify", _num_pending);
+
+    pending_save();
+
+    err = nv_settings_save(GATT_DB_SUBTREE "/hash",
+                           settings_str_from_bytes(_hash, sizeof(_hash), str,
+                                                   sizeof(str)));
+    if (err) {
+        SYS_LOG_ERR("Failed to store hash (err %d)", err);
+        return err;
+    }
+
+    memcpy(_stored_hash, _hash, sizeof(_stored_hash));
+    _has_stored_hash = true;
+
+    return 0;
+}
+
+static struct settings_handler gatt_db_handler = {
+    .h_name = GATT_DB_SUBTREE,
+    .h_set = gatt_db_set,
+    .h_commit = gatt_db_commit,
+};
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Registers the layout service and hooks into the settings
+*
+* Has to be called after ccc_store_init() and before any other application
+* service is registered. The hash is computed when the settings have been
+* loaded.
+*/
+void gatt_db_init(void)
+{
+    int err;
+
+    bt_gatt_service_register(&gatt_db_svc);
+
+    bt_gatt_foreach_attr(0x0001, 0xffff, find_sc, NULL);
+    if (_sc_ccc != NULL) {
+        /* Lets a bonded central stay subscribed across resets */
+        ccc_store_register("gatt_sc", _sc_ccc->cfg, _sc_ccc->cfg_len);
+    } else {
+        SYS_LOG_WRN("No Service Changed characteristic");
+    }
+
+    bt_conn_cb_register(&conn_callbacks);
+
+    err = settings_register(&gatt_db_handler);
+    if (err) {
+        SYS_LOG_ERR("Failed to register settings handler (err %d)", err);
+    }
+}
+
+void gatt_db_hash_get(u8_t hash[GATT_DB_HASH_LEN])
+{
+    memcpy(hash, _hash, GATT_DB_HASH_LEN);
+}
@@ -0,0 +1,29 @@
+/** @file
+ *  @brief GATT database layout and caching
+ *
+ *  Services are registered in a fixed order at boot, so attribute handles
+ *  only change with the firmware. A database hash computed over the layout
+ *  lets centrals keep their discovery results across connections, and
+ *  bonded centrals get a Service Changed indication when a firmware update
+ *  changed the hash.
+ */
+
+#ifndef GATT_DB_H
+#define GATT_DB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+#define GATT_DB_HASH_LEN        16
+
+void gatt_db_init(void);
+void gatt_db_hash_get(u8_t hash[GATT_DB_HASH_LEN]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GATT_DB_H */
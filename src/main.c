@@ -17,17 +17,27 @@
 #include "t_rh_sens.h"
 #include "als.h"
 #include "bp_sens.h"
+#include "readings.h"
+#include "retained.h"
+#include "boot.h"
+#include "probe.h"
+#include "ram.h"
+#include "capture.h"
 
 #define CONFIG_SYS_LOG_MAIN_LEVEL 4
 
 #define SYS_LOG_DOMAIN "app"
 #define SYS_LOG_LEVEL CONFIG_SYS_LOG_MAIN_LEVEL
 #include <logging/sys_log.h>
+#include "blog.h"
 
 
 static void fg_update_cb(uint8_t battery_capacity)
 {
-    SYS_LOG_INF("Battery_capacity=%d", battery_capacity);
+    struct sensor_value capacity = { .val1 = battery_capacity };
+
+    BLOG_INF("Battery_capacity=%d", battery_capacity);
+    capture_sample(READINGS_CH_BATTERY, &capacity);
     ble_update_battery(battery_capacity);
 }
 
@@ -35,42 +45,77 @@ static void t_rh_meas_cb(t_rh_meas_t *measurement)
 {
     if (measurement->temperature_updated) {
         struct sensor_value *temperature = (struct sensor_value *)measurement->temperature;
-        SYS_LOG_INF("T:%d.%06d", temperature->val1, temperature->val2);
+        BLOG_INF("T:%d.%06d", temperature->val1, temperature->val2);
+        capture_sample(READINGS_CH_TEMPERATURE, temperature);
         ble_update_temp(sensor_value_to_double(temperature));
+        boot_mark(BOOT_FIRST_SAMPLE);
     }
 
     if (measurement->humidity_updated) {
         struct sensor_value *humidity = (struct sensor_value *)measurement->humidity;
-        SYS_LOG_INF("RH:%d.%06d", humidity->val1, humidity->val2);
+        BLOG_INF("RH:%d.%06d", humidity->val1, humidity->val2);
+        capture_sample(READINGS_CH_HUMIDITY, humidity);
         ble_update_humidity(sensor_value_to_double(humidity));
     }
 }
 
 static void al_meas_cb(struct sensor_value *ambient_light)
 {
-    SYS_LOG_INF("AL:%d.%06d", ambient_light->val1, ambient_light->val2);
+    BLOG_INF("AL:%d.%06d", ambient_light->val1, ambient_light->val2);
+    capture_sample(READINGS_CH_AMBIENT_LIGHT, ambient_light);
     ble_update_ambient_light(sensor_value_to_double(ambient_light));
 }
 
 static void bp_meas_cb(struct sensor_value *baro_pressure)
 {
-    SYS_LOG_INF("AL:%d.%06d", baro_pressure->val1, baro_pressure->val2);
+    BLOG_INF("BP:%d.%06d", baro_pressure->val1, baro_pressure->val2);
+    capture_sample(READINGS_CH_BARO_PRESSURE, baro_pressure);
     ble_update_baro_pressure(sensor_value_to_double(baro_pressure));
 }
 
 
 void main(void)
 {
+    readings_t readings;
+
+    boot_mark(BOOT_MAIN);
     SYS_LOG_INF("Starting app");
 
-    fg_init(fg_update_cb);
+    if (retained_init()) {
+        /* Services and beacon start out with the values from before */
+        readings_read(&readings);
+        ble_restore(&readings);
+    }
+    boot_mark(BOOT_RETAINED);
+
     nv_init();
+    boot_mark(BOOT_NV);
+
+    /*
+     * Bluetooth comes up before the sensors; the controller and host start
+     * in parallel with the rest of main(), and the sensor modules only
+     * schedule their first measurement on the system workqueue.
+     */
+    ble_init();
+    boot_mark(BOOT_BT_ENABLE);
+
+    fg_init(fg_update_cb);
     t_rh_sens_init(t_rh_meas_cb);
     als_init(al_meas_cb);
     bp_sens_init(bp_meas_cb);
-    ble_init();
+    boot_mark(BOOT_SENSORS);
+
+    /* Stale GATT reads trigger a measurement through these */
+    readings_refresh_set(READINGS_CH_TEMPERATURE, t_rh_sens_request);
+    readings_refresh_set(READINGS_CH_HUMIDITY, t_rh_sens_request);
+    readings_refresh_set(READINGS_CH_AMBIENT_LIGHT, als_request);
+    readings_refresh_set(READINGS_CH_BARO_PRESSURE, bp_sens_request);
 
     while (1) {
         k_sleep(10 * MSEC_PER_SEC);
+        retained_update();
+        boot_report();
+        probe_report();
+        ram_report();
     }
 }
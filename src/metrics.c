@@ -0,0 +1,197 @@
+/** @file
+ *  @brief Runtime metrics
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <zephyr.h>
+#include <misc/byteorder.h>
+
+#include "metrics.h"
+#include "notify.h"
+#include "energy.h"
+
+#define SYS_LOG_DOMAIN "metrics"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* One read fits the 22 bytes of a default ATT MTU */
+BUILD_ASSERT(METRICS_ENCODED_LEN <= 22);
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static u32_t _values[METRIC_COUNT] = {
+#define METRICS_INIT(name, kind, init) [METRIC_##name] = init,
+    METRICS_LIST(METRICS_INIT)
+#undef METRICS_INIT
+};
+
+static const u8_t _kinds[METRIC_COUNT] = {
+#define METRICS_KIND(name, kind, init) [METRIC_##name] = kind,
+    METRICS_LIST(METRICS_KIND)
+#undef METRICS_KIND
+};
+
+/* Application work items that woke the CPU */
+static u32_t _wakeups;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+/**
+* @private
+* @brief Updates the metrics that are derived from other modules
+*/
+static void collect(void)
+{
+    u64_t time_us[ENERGY_COUNT];
+    u32_t events[ENERGY_COUNT];
+    u32_t uptime_s = k_uptime_get() / MSEC_PER_SEC;
+    u32_t wakeups;
+
+#if defined(CONFIG_BT) || defined(CONFIG_WALNUT_BT_STUB)
+    {
+        notify_stats_t notify_stats;
+
+        notify_stats_get(&notify_stats);
+        metrics_set(METRIC_NOTIFY_SENT, notify_stats.sent);
+        metrics_set(METRIC_NOTIFY_COALESCED, notify_stats.coalesced);
+        metrics_set(METRIC_NOTIFY_DROPPED, notify_stats.dropped);
+    }
+#endif
+
+    /* Every advertising or connection event wakes the CPU as well */
+    energy_counts_get(time_us, events);
+    wakeups = events[ENERGY_ADV] + events[ENERGY_CONN] + _wakeups;
+
+    if (uptime_s) {
+        metrics_set(METRIC_WAKEUPS_PER_HOUR,
+                (u64_t)wakeups * 3600 / uptime_s);
+    }
+
+    metrics_set(METRIC_UPTIME_HOURS, uptime_s / 3600);
+}
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+void metrics_inc(metric_id_t id)
+{
+    metrics_add(id, 1);
+}
+
+void metrics_add(metric_id_t id, u32_t value)
+{
+    unsigned int key;
+
+    if (id >= METRIC_COUNT) {
+        return;
+    }
+
+    key = irq_lock();
+    _values[id] += value;
+    irq_unlock(key);
+}
+
+void metrics_set(metric_id_t id, u32_t value)
+{
+    if (id >= METRIC_COUNT) {
+        return;
+    }
+
+    _values[id] = value;
+}
+
+/**
+* @brief Keeps the lowest value seen, for minimum gauges
+*/
+void metrics_min(metric_id_t id, u32_t value)
+{
+    unsigned int key;
+
+    if (id >= METRIC_COUNT) {
+        return;
+    }
+
+    key = irq_lock();
+    if (value < _values[id]) {
+        _values[id] = value;
+    }
+    irq_unlock(key);
+}
+
+/**
+* @brief Counts a work item that woke the CPU from idle
+*/
+void metrics_wakeup(void)
+{
+    unsigned int key = irq_lock();
+
+    _wakeups++;
+    irq_unlock(key);
+}
+
+/**
+* @brief Gets the current value of one metric
+*/
+u32_t metrics_get(metric_id_t id)
+{
+    if (id >= METRIC_COUNT) {
+        return 0;
+    }
+
+    collect();
+
+    return _values[id];
+}
+
+/**
+* @brief Encodes every metric, little endian u16 in METRICS_LIST order
+*        after a version byte
+*
+* Counters keep their low 16 bits, so a collector that reads more often
+* than every 65536 counts still gets every increment from the difference
+* modulo 2^16. Gauges saturate at 0xffff.
+*
+* @return Bytes written, 0 if @p len is too short
+*/
+u8_t metrics_encode(u8_t *buf, u8_t len)
+{
+    u8_t *p = buf;
+
+    if (len < METRICS_ENCODED_LEN) {
+        return 0;
+    }
+
+    collect();
+
+    *p++ = METRICS_VERSION;
+
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        if (_kinds[i] == METRIC_COUNTER) {
+            sys_put_le16(_values[i] & 0xffff, p);
+        } else {
+            sys_put_le16(min(_values[i], 0xffff), p);
+        }
+        p += sizeof(u16_t);
+    }
+
+    return p - buf;
+}
@@ -0,0 +1,63 @@
+/** @file
+ *  @brief Runtime metrics
+ *
+ *  Counters and gauges registered at compile time in METRICS_LIST. The
+ *  whole set is encoded into one value that fits a default ATT MTU, so a
+ *  gateway collects it with a single read per connection.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+/* Bump when the list or the encoding changes */
+#define METRICS_VERSION         2
+
+/* How a metric is squeezed into its u16 on the wire */
+#define METRIC_COUNTER          0   /* Wraps, read the difference mod 2^16 */
+#define METRIC_GAUGE            1   /* Saturates at 0xffff */
+
+/*
+ * X(name, kind, initial value). Append only, the position is the wire
+ * format.
+ */
+#define METRICS_LIST(X)                                                     \
+    X(I2C_ERRORS,       METRIC_COUNTER, 0)      /* Failed bus transfers */  \
+    X(I2C_RETRIES,      METRIC_COUNTER, 0)      /* Fetches retried */       \
+    X(NOTIFY_SENT,      METRIC_COUNTER, 0)      /* Notifications sent */    \
+    X(NOTIFY_COALESCED, METRIC_COUNTER, 0)      /* Values replaced */       \
+    X(NOTIFY_DROPPED,   METRIC_COUNTER, 0)      /* Values discarded */      \
+    X(WAKEUPS_PER_HOUR, METRIC_GAUGE,   0)      /* Radio events, work */    \
+    X(NVS_GC,           METRIC_COUNTER, 0)      /* NVS sector rotations */  \
+    X(RECONNECTS,       METRIC_COUNTER, 0)      /* Connections after 1st */ \
+    X(VBAT_MIN_MV,      METRIC_GAUGE,   0xffff) /* Lowest battery, mV */    \
+    X(UPTIME_HOURS,     METRIC_GAUGE,   0)      /* Time since reset */
+
+typedef enum {
+#define METRICS_ID(name, kind, init) METRIC_##name,
+    METRICS_LIST(METRICS_ID)
+#undef METRICS_ID
+    METRIC_COUNT
+} metric_id_t;
+
+/* Version byte and one u16 per metric */
+#define METRICS_ENCODED_LEN     (1 + METRIC_COUNT * sizeof(u16_t))
+
+void metrics_inc(metric_id_t id);
+void metrics_add(metric_id_t id, u32_t value);
+void metrics_set(metric_id_t id, u32_t value);
+void metrics_min(metric_id_t id, u32_t value);
+void metrics_wakeup(void);
+u32_t metrics_get(metric_id_t id);
+u8_t metrics_encode(u8_t *buf, u8_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* METRICS_H */
@@ -0,0 +1,338 @@
+/** @file
+ *  @brief Notification scheduler
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "notify.h"
+#include "probe.h"
+
+#define SYS_LOG_DOMAIN "notify"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+struct notify_slot {
+    const struct bt_gatt_attr *attr;
+    u8_t len;
+    u8_t data[NOTIFY_MAX_LEN];
+};
+
+/*
+ * Only the system workqueue touches the slots and the stats. The host
+ * reports a disconnection on its RX thread, which just marks the
+ * connection closed; the flush work releases it.
+ */
+struct notify_conn {
+    struct bt_conn *conn;
+    bool closed;
+    struct notify_slot slots[NOTIFY_MAX_CHRC];
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static struct notify_conn _conns[CONFIG_BT_MAX_CONN];
+static notify_stats_t _stats;
+
+static struct k_work _flush_work;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static struct notify_conn *conn_find(struct bt_conn *conn)
+{
+    for (int i = 0; i < ARRAY_SIZE(_conns); i++) {
+        if (_conns[i].conn == conn) {
+            return &_conns[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int slot_store(struct notify_conn *nc, const struct bt_gatt_attr *attr,
+              const void *data, u16_t len)
+{
+    struct notify_slot *free_slot = NULL;
+    struct notify_slot *slot;
+
+    for (int i = 0; i < NOTIFY_MAX_CHRC; i++) {
+        slot = &nc->slots[i];
+
+        if (slot->attr == attr) {
+            /* Latest value wins */
+            memcpy(slot->data, data, len);
+            slot->len = len;
+            _stats.coalesced++;
+            return 0;
+        }
+
+        if (slot->attr == NULL && free_slot == NULL) {
+            free_slot = slot;
+        }
+    }
+
+    if (free_slot == NULL) {
+        _stats.dropped++;
+        return -ENOMEM;
+    }
+
+    memcpy(free_slot->data, data, len);
+    free_slot->len = len;
+    free_slot->attr = attr;
+
+    _stats.depth++;
+    if (_stats.depth > _stats.max_depth) {
+        _stats.max_depth = _stats.depth;
+    }
+
+    return 0;
+}
+
+static void slot_release(struct notify_slot *slot)
+{
+    slot->attr = NULL;
+    _stats.depth--;
+}
+
+/**
+* @private
+* @brief Hands all pending values of a connection to the host in one go
+*
+* bt_gatt_notify() in this host version waits for a TX buffer without a
+* timeout, so a flush holds the system workqueue while the controller is
+* behind. It only fails for a value the connection cannot take, such as
+* one longer than the ATT MTU, which retrying would not help; the value
+* is dropped.
+*/
+static void conn_flush(struct notify_conn *nc)
+{
+    struct bt_conn *conn = bt_conn_ref(nc->conn);
+    struct notify_slot *slot;
+    u32_t start;
+    int err;
+
+    for (int i = 0; i < NOTIFY_MAX_CHRC; i++) {
+        slot = &nc->slots[i];
+
+        if (slot->attr == NULL) {
+            continue;
+        }
+
+        start = probe_start();
+        err = bt_gatt_notify(conn, slot->attr, slot->data, slot->len);
+        probe_end(PROBE_NOTIFY, start);
+
+        if (err) {
+            SYS_LOG_ERR("Notification failed (err %d)", err);
+            _stats.dropped++;
+        } else {
+            _stats.sent++;
+        }
+
+        slot_release(slot);
+    }
+
+    bt_conn_unref(conn);
+}
+
+/* Drops what is still pending and frees the entry for a new connection */
+static void conn_release(struct notify_conn *nc)
+{
+    struct bt_conn *conn = nc->conn;
+    unsigned int key;
+
+    for (int i = 0; i < NOTIFY_MAX_CHRC; i++) {
+        if (nc->slots[i].attr != NULL) {
+            slot_release(&nc->slots[i]);
+            _stats.dropped++;
+        }
+    }
+
+    key = irq_lock();
+    nc->closed = false;
+    nc->conn = NULL;
+    irq_unlock(key);
+
+    bt_conn_unref(conn);
+}
+
+static void flush_work_handler(struct k_work *work)
+{
+    struct notify_conn *nc;
+
+    for (int i = 0; i < ARRAY_SIZE(_conns); i++) {
+        nc = &_conns[i];
+
+        if (nc->conn == NULL) {
+            continue;
+        }
+
+        if (nc->closed) {
+            conn_release(nc);
+        } else {
+            conn_flush(nc);
+        }
+    }
+}
+
+static void connected(struct bt_conn *conn, u8_t err)
+{
+    struct notify_conn *nc;
+    unsigned int key;
+
+    if (err) {
+        return;
+    }
+
+    key = irq_lock();
+    nc = conn_find(NULL);
+    if (nc != NULL) {
+        nc->conn = bt_conn_ref(conn);
+    }
+    irq_unlock(key);
+
+    if (nc == NULL) {
+        SYS_LOG_ERR("No free notification slot");
+    }
+}
+
+static void disconnected(struct bt_conn *conn, u8_t reason)
+{
+    struct notify_conn *nc;
+    unsigned int key;
+
+    key = irq_lock();
+    nc = conn_find(conn);
+    if (nc != NULL) {
+        nc->closed = true;
+    }
+    irq_unlock(key);
+
+    if (nc != NULL) {
+        k_work_submit(&_flush_work);
+    }
+}
+
+static struct bt_conn_cb conn_callbacks = {
+    .connected = connected,
+    .disconnected = disconnected,
+};
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+void notify_init(void)
+{
+    k_work_init(&_flush_work, flush_work_handler);
+
+    bt_conn_cb_register(&conn_callbacks);
+}
+
+/**
+* @brief Checks whether a central has enabled notifications in a CCC
+*/
+bool notify_ccc_enabled(const struct bt_gatt_ccc_cfg *ccc_cfg,
+                        struct bt_conn *conn)
+{
+    const bt_addr_le_t *dst = bt_conn_get_dst(conn);
+
+    for (int i = 0; i < BT_GATT_CCC_MAX; i++) {
+        if (!bt_addr_le_cmp(&ccc_cfg[i].peer, dst)) {
+            return (ccc_cfg[i].value & BT_GATT_CCC_NOTIFY) != 0;
+        }
+    }
+
+    return false;
+}
+
+/**
+* @brief Queues a notification for a connection
+*
+* The value is copied; it is sent from the system workqueue together with
+* the other values pending for the same connection. Called from the
+* system workqueue; the caller is responsible for checking that @p conn is
+* subscribed.
+*/
+int notify_submit(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                  const void *data, u16_t len)
+{
+    struct notify_conn *nc;
+    int err;
+
+    if (len > NOTIFY_MAX_LEN || conn == NULL) {
+        return -EINVAL;
+    }
+
+    nc = conn_find(conn);
+    if (nc == NULL || nc->closed) {
+        return -ENOTCONN;
+    }
+
+    err = slot_store(nc, attr, data, len);
+
+    /* A flush already queued sends this value too */
+    k_work_submit(&_flush_work);
+
+    return err;
+}
+
+/**
+* @brief Queues a notification for every connection subscribed in @p ccc_cfg
+*/
+int notify_submit_all(const struct bt_gatt_attr *attr,
+                      const struct bt_gatt_ccc_cfg *ccc_cfg,
+                      const void *data, u16_t len)
+{
+    int err = 0;
+
+    if (len > NOTIFY_MAX_LEN) {
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(_conns); i++) {
+        if (_conns[i].conn == NULL || _conns[i].closed ||
+            !notify_ccc_enabled(ccc_cfg, _conns[i].conn)) {
+            continue;
+        }
+
+        if (slot_store(&_conns[i], attr, data, len)) {
+            err = -ENOMEM;
+        }
+    }
+
+    k_work_submit(&_flush_work);
+
+    return err;
+}
+
+void notify_stats_get(notify_stats_t *stats)
+{
+    memcpy(stats, &_stats, sizeof(*stats));
+}
@@ -0,0 +1,53 @@
+/** @file
+ *  @brief Notification scheduler
+ *
+ *  Sits between the GATT services and the host. Every connection has one
+ *  pending slot per characteristic; a newer value overwrites a queued
+ *  older one, and all pending slots of a connection are flushed together
+ *  from the system workqueue. The host waits for TX buffers there, which
+ *  holds the workqueue while the controller is behind.
+ */
+
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+/* Characteristics that can be pending at the same time per connection */
+#define NOTIFY_MAX_CHRC         6
+
+/* Largest notification value, fits the default ATT MTU */
+#define NOTIFY_MAX_LEN          20
+
+typedef struct {
+    u32_t sent;         /* Notifications handed to the host */
+    u32_t coalesced;    /* Queued values replaced by a newer one */
+    u32_t dropped;      /* Values discarded without being sent */
+    u8_t depth;         /* Values currently pending */
+    u8_t max_depth;     /* Most values pending at once */
+} notify_stats_t;
+
+struct bt_conn;
+struct bt_gatt_attr;
+struct bt_gatt_ccc_cfg;
+
+void notify_init(void);
+bool notify_ccc_enabled(const struct bt_gatt_ccc_cfg *ccc_cfg,
+                        struct bt_conn *conn);
+int notify_submit(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                  const void *data, u16_t len);
+int notify_submit_all(const struct bt_gatt_attr *attr,
+                      const struct bt_gatt_ccc_cfg *ccc_cfg,
+                      const void *data, u16_t len);
+void notify_stats_get(notify_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NOTIFY_H */
@@ -7,11 +7,17 @@
 * Include Directives
 ***************************************************************************/
 
+#include <stdbool.h>
 #include <zephyr.h>
+#include <string.h>
 #include <board.h>
 #include <nvs/nvs.h>
+#include <settings/settings.h>
 
 #include "nv.h"
+#include "energy.h"
+#include "probe.h"
+#include "metrics.h"
 
 #define CONFIG_SYS_LOG_NV_LEVEL 1
 #define SYS_LOG_DOMAIN "nv"
@@ -27,13 +33,25 @@
 
 #define STORAGE_MAGIC 0xefbeadde // 0xdeadbeef
 
+// Bump when a record changes size; storage is wiped once on mismatch
+#define NV_LAYOUT 1
+
 #define NVS_SECTOR_SIZE 1024 /* Multiple of FLASH_PAGE_SIZE */
 #define NVS_SECTOR_COUNT 2 /* At least 2 sectors */
-#define NVS_STORAGE_OFFSET FLASH_AREA_STORAGE_OFFSET /* Start address of the
-                              * filesystem in flash
+#define NVS_STORAGE_OFFSET FLASH_AREA_NV_OFFSET /* Start address of the
+                              * filesystem in flash, the storage
+                              * partition holds the settings
                               */
 #define NVS_MAX_ELEM_SIZE 256 /* Largest item that can be stored */
 
+/*
+ * The settings FCB in the storage partition: a sector is a flash page,
+ * records are "name=value" behind a length byte, padded to the flash
+ * write block
+ */
+#define SETTINGS_SECTOR_SIZE 1024
+#define SETTINGS_WRITE_BLOCK 4
+
 
 /****************************************************************************
 * Private Type Declarations
@@ -57,10 +75,42 @@ static struct nvs_fs fs = {
 ***************************************************************************/
 
 
+/* Settings bytes written since the last estimated sector erase */
+static u32_t _settings_fill;
+
+
 /****************************************************************************
 * Private Function Definitions
 ***************************************************************************/
 
+/**
+* @private
+* @brief Writes a record and accounts for its cost
+*
+* NVS garbage collects the oldest sector when the write location moves to
+* the next one, which erases a page.
+*/
+static int record_write(uint16_t id, const void *data, int len)
+{
+    u32_t sector = fs.write_location / NVS_SECTOR_SIZE;
+    u32_t start = probe_start();
+    int write_len;
+
+    write_len = nvs_write(&fs, id, data, len);
+    probe_end(PROBE_NVS_WRITE, start);
+
+    if (write_len == len) {
+        energy_event_add(ENERGY_FLASH_WRITE, 1);
+    }
+
+    if (fs.write_location / NVS_SECTOR_SIZE != sector) {
+        metrics_inc(METRIC_NVS_GC);
+        energy_event_add(ENERGY_FLASH_ERASE, 1);
+    }
+
+    return write_len;
+}
+
 
 /****************************************************************************
 * Public Function Definitions
@@ -105,7 +155,7 @@ int nv_set_device_data(const nv_device_data_t *data)
 
     SYS_LOG_INF("Write device data");
 
-    write_len = nvs_write(&fs, NV_DEVICE_DATA, buf, buf_len);
+    write_len = record_write(NV_DEVICE_DATA, buf, buf_len);
     if (write_len == buf_len) {
         SYS_LOG_DBG("Write device data success");
     } else if (write_len < 0) {
@@ -156,7 +206,7 @@ int nv_set_sensor_data(nv_types_t sensor, const nv_sensor_data_t *data)
 
     SYS_LOG_INF("Write sensor%02d data", sensor);
 
-    write_len = nvs_write(&fs, (uint16_t)sensor, buf, buf_len);
+    write_len = record_write((uint16_t)sensor, buf, buf_len);
     if (write_len == buf_len) {
         SYS_LOG_DBG("Write sensor%02d data success", sensor);
     } else if (write_len < 0) {
@@ -192,16 +242,65 @@ static void nv_test(void) {
 int nv_init(void)
 {
     int err = 0;
+    u32_t layout = 0;
 
     err = nvs_init(&fs, FLASH_DEV_NAME, STORAGE_MAGIC);
     if (err) {
         SYS_LOG_ERR("Flash Init failed");
     }
 
-    nvs_clear(&fs);
-    nvs_init(&fs, FLASH_DEV_NAME, STORAGE_MAGIC);
+    // Records survive resets; only a layout change clears them
+    if (nvs_read(&fs, NV_LAYOUT_VERSION, &layout, sizeof(layout)) !=
+        sizeof(layout) || layout != NV_LAYOUT) {
+        SYS_LOG_WRN("Layout %u, expected %u, clearing", layout, NV_LAYOUT);
+        nvs_clear(&fs);
+        energy_event_add(ENERGY_FLASH_ERASE, NVS_SECTOR_COUNT);
+        nvs_init(&fs, FLASH_DEV_NAME, STORAGE_MAGIC);
+
+        layout = NV_LAYOUT;
+        nvs_write(&fs, NV_LAYOUT_VERSION, &layout, sizeof(layout));
+    }
 
     nv_test();
 
     return 0;
 }
+
+/**
+* @brief Saves a settings record and accounts for its cost
+*
+* The FCB erases its oldest sector every time the records written have
+* filled one, once it has wrapped. The erases are estimated from the bytes
+* written, so they are charged from the first sector on.
+*
+* @param name  Settings key
+* @param value Value string, NULL deletes the key
+*/
+int nv_settings_save(const char *name, char *value)
+{
+    u32_t len = 1 + strlen(name) + 1 + (value != NULL ? strlen(value) : 0);
+    unsigned int key;
+    bool erased;
+    int err;
+
+    err = settings_save_one(name, value);
+    if (err) {
+        return err;
+    }
+
+    energy_event_add(ENERGY_FLASH_WRITE, 1);
+
+    key = irq_lock();
+    _settings_fill += ROUND_UP(len, SETTINGS_WRITE_BLOCK);
+    erased = _settings_fill >= SETTINGS_SECTOR_SIZE;
+    if (erased) {
+        _settings_fill -= SETTINGS_SECTOR_SIZE;
+    }
+    irq_unlock(key);
+
+    if (erased) {
+        energy_event_add(ENERGY_FLASH_ERASE, 1);
+    }
+
+    return 0;
+}
@@ -25,6 +25,7 @@ typedef enum {
     NV_SENSOR_HUMIDITY,
     NV_SENSOR_AMBIENT_LIGHT,
     NV_SENSOR_BARO_PRESSURE,
+    NV_LAYOUT_VERSION,
 } nv_types_t;
 
 typedef struct {
@@ -33,10 +34,20 @@ typedef struct {
     u32_t update_interval;
     u8_t application;
     u8_t meas_uncertainty;
+    u32_t max_age;      /* Oldest value served to a GATT read, s, 0 = any */
 } nv_sensor_data_t;
 
+typedef enum {
+    NV_ADV_MODE_CONNECTABLE,
+    NV_ADV_MODE_BEACON,
+    NV_ADV_MODE_BEACON_SCANNABLE,
+} nv_adv_mode_t;
+
 typedef struct {
     u32_t adv_interval;
+    u8_t adv_mode;
+    u16_t beacon_update_interval;
+    u8_t beacon_replay_counter;
 } nv_device_data_t;
 
 
@@ -49,5 +60,6 @@ int nv_get_device_data(nv_device_data_t *data);
 int nv_set_device_data(const nv_device_data_t *data);
 int nv_get_sensor_data(nv_types_t sensor, nv_sensor_data_t *data);
 int nv_set_sensor_data(nv_types_t sensor, const nv_sensor_data_t *data);
+int nv_settings_save(const char *name, char *value);
 
 #endif /* _NV_H_ */
@@ -0,0 +1,168 @@
+/** @file
+ *  @brief Latency probes
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <zephyr.h>
+#include <misc/printk.h>
+
+#include "probe.h"
+#include "trace.h"
+
+#ifdef CONFIG_WALNUT_PROBES
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Time between two console reports, ms */
+#define PROBE_REPORT_INTERVAL   K_MINUTES(10)
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static probe_hist_t _hist[PROBE_COUNT];
+
+static s64_t _last_report;
+
+static const char * const _names[PROBE_COUNT] = {
+    [PROBE_SI7020_FETCH]  = "si7020_fetch",
+    [PROBE_TSL4531_FETCH] = "tsl4531_fetch",
+    [PROBE_BMP280_FETCH]  = "bmp280_fetch",
+    [PROBE_NOTIFY]        = "gatt_notify",
+    [PROBE_NVS_WRITE]     = "nvs_write",
+    [PROBE_T_RH_WORK]     = "t_rh_work",
+    [PROBE_ALS_WORK]      = "als_work",
+    [PROBE_BP_WORK]       = "bp_work",
+    [PROBE_FG_WORK]       = "fg_work",
+};
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static u8_t bucket_get(u32_t us)
+{
+    u8_t bucket;
+
+    if (us < PROBE_BUCKET_MIN_US) {
+        return 0;
+    }
+
+    /* log2(us) - log2(PROBE_BUCKET_MIN_US) + 1 */
+    bucket = (31 - __builtin_clz(us)) - 5;
+
+    return min(bucket, PROBE_BUCKETS - 1);
+}
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Records the time since @p start, as returned by probe_start()
+*
+* Cheap enough for any thread; the counters are updated with interrupts
+* locked. The span is also recorded in the trace.
+*/
+void probe_end(probe_id_t id, u32_t start)
+{
+    u32_t end = k_cycle_get_32();
+    u32_t us = SYS_CLOCK_HW_CYCLES_TO_NS64(end - start) / NSEC_PER_USEC;
+    probe_hist_t *hist;
+    unsigned int key;
+    u8_t bucket;
+
+    if (id >= PROBE_COUNT) {
+        return;
+    }
+
+    trace_span(id, start, end);
+
+    hist = &_hist[id];
+    bucket = bucket_get(us);
+
+    key = irq_lock();
+
+    if (hist->buckets[bucket] != 0xffff) {
+        hist->buckets[bucket]++;
+    }
+
+    hist->count++;
+    hist->total_us += us;
+
+    if (us > hist->max_us) {
+        hist->max_us = us;
+    }
+
+    irq_unlock(key);
+}
+
+void probe_hist_get(probe_id_t id, probe_hist_t *hist)
+{
+    unsigned int key;
+
+    if (id >= PROBE_COUNT) {
+        memset(hist, 0, sizeof(*hist));
+        return;
+    }
+
+    key = irq_lock();
+    memcpy(hist, &_hist[id], sizeof(*hist));
+    irq_unlock(key);
+}
+
+void probe_reset(void)
+{
+    unsigned int key = irq_lock();
+
+    memset(_hist, 0, sizeof(_hist));
+    irq_unlock(key);
+}
+
+/**
+* @brief Prints every probe that has fired to the console
+*
+* Rate limited, meant to be called from the main loop.
+*/
+void probe_report(void)
+{
+    probe_hist_t hist;
+    s64_t now = k_uptime_get();
+
+    if (now - _last_report < PROBE_REPORT_INTERVAL) {
+        return;
+    }
+
+    _last_report = now;
+
+    for (int i = 0; i < PROBE_COUNT; i++) {
+        probe_hist_get(i, &hist);
+
+        if (hist.count == 0) {
+            continue;
+        }
+
+        printk("probe %s: n %u avg %u max %u us |", _names[i], hist.count,
+               (u32_t)(hist.total_us / hist.count), hist.max_us);
+
+        for (int b = 0; b < PROBE_BUCKETS; b++) {
+            printk(" %u", hist.buckets[b]);
+        }
+
+        printk("\n");
+    }
+}
+
+#endif /* CONFIG_WALNUT_PROBES */
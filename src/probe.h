@@ -0,0 +1,76 @@
+/** @file
+ *  @brief Latency probes
+ *
+ *  Times hot paths on the hardware cycle counter and keeps a log2
+ *  histogram per probe in RAM. The histograms are printed to the console
+ *  periodically and can be read from the diagnostic service, so a change
+ *  can be checked on the device itself.
+ *
+ *  On the nRF51 the cycle counter is the 32768 Hz RTC; anything shorter
+ *  than one tick (30.5 us) lands in the first bucket.
+ */
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+#include <kernel.h>
+
+/*
+ * Bucket 0 holds durations below 64 us, bucket n [2^(n+5), 2^(n+6)) us,
+ * the last bucket everything from about 1 s.
+ */
+#define PROBE_BUCKETS           16
+#define PROBE_BUCKET_MIN_US     64
+
+typedef enum {
+    PROBE_SI7020_FETCH,
+    PROBE_TSL4531_FETCH,
+    PROBE_BMP280_FETCH,
+    PROBE_NOTIFY,
+    PROBE_NVS_WRITE,
+    PROBE_T_RH_WORK,
+    PROBE_ALS_WORK,
+    PROBE_BP_WORK,
+    PROBE_FG_WORK,
+    PROBE_COUNT
+} probe_id_t;
+
+typedef struct {
+    u16_t buckets[PROBE_BUCKETS];   /* Saturating counts */
+    u32_t count;
+    u32_t max_us;
+    u64_t total_us;
+} probe_hist_t;
+
+#ifdef CONFIG_WALNUT_PROBES
+static inline u32_t probe_start(void)
+{
+    return k_cycle_get_32();
+}
+
+void probe_end(probe_id_t id, u32_t start);
+void probe_hist_get(probe_id_t id, probe_hist_t *hist);
+void probe_reset(void);
+void probe_report(void);
+#else
+static inline u32_t probe_start(void)
+{
+    return 0;
+}
+
+static inline void probe_end(probe_id_t id, u32_t start) {}
+static inline void probe_hist_get(probe_id_t id, probe_hist_t *hist) {}
+static inline void probe_reset(void) {}
+static inline void probe_report(void) {}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROBE_H */
@@ -0,0 +1,214 @@
+/** @file
+ *  @brief RAM and stack usage
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <zephyr.h>
+#include <misc/printk.h>
+#include <misc/util.h>
+
+#include "ram.h"
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Time between two console reports */
+#define RAM_REPORT_INTERVAL     K_HOURS(1)
+
+/* Written to every stack at thread creation by CONFIG_INIT_STACKS */
+#define RAM_STACK_FILL          0xaa
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+struct stacks_ctx {
+    ram_stack_t *stacks;
+    int max;
+    int count;
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+/* From the linker script, the native_posix image is a host process */
+#ifdef CONFIG_ARM
+extern char __data_ram_start[];
+extern char __data_ram_end[];
+extern char __bss_start[];
+extern char __bss_end[];
+extern char _image_ram_end[];
+
+extern char _interrupt_stack[];
+#endif
+
+static s64_t _last_report;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+/**
+* @private
+* @brief Counts the stack bytes ever written, stacks grow down
+*/
+static u16_t stack_used(const u8_t *start, size_t size)
+{
+    size_t unused = 0;
+
+    while (unused < size && start[unused] == RAM_STACK_FILL) {
+        unused++;
+    }
+
+    return size - unused;
+}
+
+#if defined(CONFIG_THREAD_MONITOR) && defined(CONFIG_THREAD_STACK_INFO)
+static void thread_cb(const struct k_thread *thread, void *user_data)
+{
+    struct stacks_ctx *ctx = user_data;
+    ram_stack_t *stack;
+
+    if (ctx->count >= ctx->max) {
+        return;
+    }
+
+    stack = &ctx->stacks[ctx->count++];
+    stack->thread = (u32_t)thread;
+    stack->size = thread->stack_info.size;
+    stack->used = stack_used((const u8_t *)thread->stack_info.start,
+                             thread->stack_info.size);
+}
+#endif
+
+static void bt_pools_report(void)
+{
+#ifdef CONFIG_BT_RX_BUF_COUNT
+    printk("ram: bt host rx %u x %u\n", CONFIG_BT_RX_BUF_COUNT,
+           CONFIG_BT_RX_BUF_LEN);
+#endif
+#ifdef CONFIG_BT_HCI_CMD_COUNT
+    printk("ram: bt host cmd %u\n", CONFIG_BT_HCI_CMD_COUNT);
+#endif
+#ifdef CONFIG_BT_L2CAP_TX_BUF_COUNT
+    printk("ram: bt host l2cap tx %u x %u\n", CONFIG_BT_L2CAP_TX_BUF_COUNT,
+           CONFIG_BT_L2CAP_TX_MTU);
+#endif
+#ifdef CONFIG_BT_CTLR_RX_BUFFERS
+    printk("ram: bt ctlr rx %u\n", CONFIG_BT_CTLR_RX_BUFFERS);
+#endif
+#ifdef CONFIG_BT_CTLR_TX_BUFFERS
+    printk("ram: bt ctlr tx %u x %u\n", CONFIG_BT_CTLR_TX_BUFFERS,
+           CONFIG_BT_CTLR_TX_BUFFER_SIZE);
+#endif
+}
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Gets the stack usage of every thread and, on the nRF51, of the
+*        interrupt stack
+*
+* Threads are only listed with CONFIG_THREAD_MONITOR and
+* CONFIG_THREAD_STACK_INFO. Without CONFIG_INIT_STACKS every stack reads
+* as fully used.
+*
+* @return Number of stacks written to @p stacks
+*/
+int ram_stacks_get(ram_stack_t *stacks, int max)
+{
+    struct stacks_ctx ctx = {
+        .stacks = stacks,
+        .max = max,
+    };
+
+    if (max < 1) {
+        return 0;
+    }
+
+#ifdef CONFIG_ARM
+    stacks[0].thread = 0;
+    stacks[0].size = CONFIG_ISR_STACK_SIZE;
+    stacks[0].used = stack_used((const u8_t *)_interrupt_stack,
+                                CONFIG_ISR_STACK_SIZE);
+    ctx.count = 1;
+#endif
+
+#if defined(CONFIG_THREAD_MONITOR) && defined(CONFIG_THREAD_STACK_INFO)
+    k_thread_foreach(thread_cb, &ctx);
+#endif
+
+    return ctx.count;
+}
+
+/**
+* @brief Suggests a stack size: the high-water mark plus a margin
+*/
+u16_t ram_stack_suggest(const ram_stack_t *stack)
+{
+    u16_t size = ROUND_UP(stack->used + RAM_STACK_MARGIN, STACK_ALIGN);
+
+    return min(size, stack->size);
+}
+
+/**
+* @brief Prints the RAM budget and the stack high-water marks
+*
+* Rate limited, meant to be called from the main loop. The high-water
+* marks only cover what has run so far; take them after a connection, a
+* burst and a settings write have happened at least once.
+*/
+void ram_report(void)
+{
+    ram_stack_t stacks[RAM_STACKS_MAX];
+    s64_t now = k_uptime_get();
+    u32_t reclaim = 0;
+    u16_t suggest;
+    int count;
+
+    if (now - _last_report < RAM_REPORT_INTERVAL) {
+        return;
+    }
+
+    _last_report = now;
+
+#ifdef CONFIG_ARM
+    {
+        u32_t ram_end = CONFIG_SRAM_BASE_ADDRESS + CONFIG_SRAM_SIZE * 1024;
+
+        printk("ram: data %u bss %u noinit %u free %u\n",
+               __data_ram_end - __data_ram_start, __bss_end - __bss_start,
+               (u32_t)_image_ram_end - (u32_t)__bss_end,
+               ram_end - (u32_t)_image_ram_end);
+    }
+#endif
+
+    bt_pools_report();
+
+    count = ram_stacks_get(stacks, ARRAY_SIZE(stacks));
+
+    for (int i = 0; i < count; i++) {
+        suggest = ram_stack_suggest(&stacks[i]);
+        reclaim += stacks[i].size - suggest;
+
+        printk("ram: stack %08x size %u used %u suggest %u\n",
+               stacks[i].thread, stacks[i].size, stacks[i].used, suggest);
+    }
+
+    printk("ram: stacks reclaimable %u\n", reclaim);
+}
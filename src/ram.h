@@ -0,0 +1,39 @@
+/** @file
+ *  @brief RAM and stack usage
+ *
+ *  Measures the stack high-water mark of every thread and of the interrupt
+ *  stack from the fill pattern left by CONFIG_INIT_STACKS, and reports the
+ *  static RAM, stack and Bluetooth buffer budget together with how far
+ *  each stack could be shrunk.
+ */
+
+#ifndef RAM_H
+#define RAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+/* Stacks reported, threads and the interrupt stack */
+#define RAM_STACKS_MAX          10
+
+/* Headroom kept above the high-water mark when suggesting a size */
+#define RAM_STACK_MARGIN        64
+
+typedef struct {
+    u32_t thread;       /* Thread structure address, 0 for interrupts */
+    u16_t size;
+    u16_t used;         /* High-water mark */
+} ram_stack_t;
+
+int ram_stacks_get(ram_stack_t *stacks, int max);
+u16_t ram_stack_suggest(const ram_stack_t *stack);
+void ram_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAM_H */
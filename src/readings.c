@@ -0,0 +1,186 @@
+/** @file
+ *  @brief Snapshot of the current sensor readings
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <zephyr.h>
+
+#include "readings.h"
+
+#define SYS_LOG_DOMAIN "readings"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Keeps the compiler from moving buffer accesses across the sequence load */
+#define READINGS_BARRIER()  __asm__ __volatile__ ("" ::: "memory")
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static readings_t _buf[2];
+
+/* Sequence number of the published buffer, _buf[_seq & 1] */
+static volatile u32_t _seq;
+
+static readings_refresh_t _refresh[READINGS_CH_COUNT];
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Starts a publication
+*
+* Returns the unpublished buffer, initialised with the current snapshot, for
+* the caller to update before handing it to readings_commit(). There is a
+* single writer: all publications come from the system workqueue.
+*/
+readings_t *readings_begin(void)
+{
+    u32_t seq = _seq;
+    readings_t *next = &_buf[(seq + 1) & 1];
+
+    memcpy(next, &_buf[seq & 1], sizeof(*next));
+
+    return next;
+}
+
+/**
+* @brief Publishes the buffer returned by readings_begin()
+*
+* @param channels READINGS_* channels updated in @p next
+*/
+void readings_commit(readings_t *next, u8_t channels)
+{
+    next->valid |= channels;
+    next->timestamp = k_uptime_get_32();
+    next->seq = _seq + 1;
+
+    for (int ch = 0; ch < READINGS_CH_COUNT; ch++) {
+        if (channels & BIT(ch)) {
+            next->sampled[ch] = next->timestamp;
+        }
+    }
+
+    READINGS_BARRIER();
+    _seq = next->seq;
+}
+
+/**
+* @brief Publishes a snapshot saved before a reset
+*
+* Only valid before the first publication.
+*/
+void readings_restore(const readings_t *snapshot)
+{
+    memcpy(&_buf[0], snapshot, sizeof(_buf[0]));
+    _buf[0].seq = 0;
+
+    READINGS_BARRIER();
+    _seq = 0;
+}
+
+/**
+* @brief Copies the latest published snapshot
+*
+* Safe from any context. The copy is repeated only if the writer completed
+* a publication while it was being taken.
+*/
+void readings_read(readings_t *snapshot)
+{
+    u32_t seq;
+
+    do {
+        seq = _seq;
+        READINGS_BARRIER();
+        memcpy(snapshot, &_buf[seq & 1], sizeof(*snapshot));
+        READINGS_BARRIER();
+    } while (seq != _seq);
+}
+
+/**
+* @brief Registers the function that starts a measurement of a channel
+*/
+void readings_refresh_set(readings_ch_t ch, readings_refresh_t refresh)
+{
+    _refresh[ch] = refresh;
+}
+
+/**
+* @brief Starts measurements of the given channels
+*
+* Channels sharing a sensor start it once.
+*
+* @return The channels a measurement was started for
+*/
+u8_t readings_refresh(u8_t channels)
+{
+    readings_refresh_t started[READINGS_CH_COUNT];
+    int num_started = 0;
+    u8_t result = 0;
+    int i;
+
+    for (int ch = 0; ch < READINGS_CH_COUNT; ch++) {
+        if (!(channels & BIT(ch)) || _refresh[ch] == NULL) {
+            continue;
+        }
+
+        for (i = 0; i < num_started; i++) {
+            if (started[i] == _refresh[ch]) {
+                break;
+            }
+        }
+
+        if (i == num_started) {
+            if (_refresh[ch]()) {
+                continue;
+            }
+            started[num_started++] = _refresh[ch];
+        }
+
+        result |= BIT(ch);
+    }
+
+    return result;
+}
+
+/**
+* @brief Copies the latest snapshot, refreshing @p ch when it is stale
+*
+* Never blocks. When the published value of @p ch is older than
+* @p max_age_ms a measurement is started and @p snapshot holds the cached
+* value; the new one is published when the measurement completes.
+*
+* @return 0 if the channel is fresh, -EAGAIN if @p snapshot holds the stale
+*         value and a measurement was started, -EBUSY if none could be
+*/
+int readings_read_cached(readings_t *snapshot, readings_ch_t ch,
+                         u32_t max_age_ms)
+{
+    readings_read(snapshot);
+
+    if (max_age_ms == 0 ||
+        ((snapshot->valid & BIT(ch)) &&
+         k_uptime_get_32() - snapshot->sampled[ch] <= max_age_ms)) {
+        return 0;
+    }
+
+    SYS_LOG_DBG("Channel %d stale, refreshing", ch);
+
+    return readings_refresh(BIT(ch)) ? -EAGAIN : -EBUSY;
+}
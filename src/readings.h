@@ -0,0 +1,81 @@
+/** @file
+ *  @brief Snapshot of the current sensor readings
+ *
+ *  The sensor callbacks publish into one of two buffers while readers copy
+ *  the other one. A sequence number tells a reader whether the buffer it
+ *  copied was reused by the writer meanwhile, in which case it copies
+ *  again. Readers never block and never wait for the writer to finish.
+ */
+
+#ifndef READINGS_H
+#define READINGS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+typedef enum {
+    READINGS_CH_TEMPERATURE,
+    READINGS_CH_HUMIDITY,
+    READINGS_CH_AMBIENT_LIGHT,
+    READINGS_CH_BARO_PRESSURE,
+    READINGS_CH_BATTERY,
+    READINGS_CH_COUNT,
+} readings_ch_t;
+
+/* Channel masks */
+#define READINGS_TEMPERATURE    (1 << READINGS_CH_TEMPERATURE)
+#define READINGS_HUMIDITY       (1 << READINGS_CH_HUMIDITY)
+#define READINGS_AMBIENT_LIGHT  (1 << READINGS_CH_AMBIENT_LIGHT)
+#define READINGS_BARO_PRESSURE  (1 << READINGS_CH_BARO_PRESSURE)
+#define READINGS_BATTERY        (1 << READINGS_CH_BATTERY)
+
+/* Units as in the corresponding ESS/BAS characteristics */
+typedef struct {
+    u32_t seq;              /* Incremented by every publication */
+    u32_t timestamp;        /* Uptime of the last publication, ms */
+    u32_t sampled[READINGS_CH_COUNT]; /* Uptime of each channel's update */
+    s16_t temperature;      /* 0.01 degC */
+    u16_t humidity;         /* 0.01 % */
+    u16_t ambient_light;    /* 0.01 lux */
+    u32_t pressure;         /* 0.1 Pa */
+    u8_t battery;           /* % */
+    u8_t valid;             /* Channels published at least once */
+} readings_t;
+
+/* Brightest ambient light the 0.01 lux fields hold, 655.35 lux */
+#define READINGS_ALS_MAX        0xffff
+
+/* Starts a measurement that eventually publishes the channel */
+typedef int (*readings_refresh_t)(void);
+
+readings_t *readings_begin(void);
+void readings_commit(readings_t *next, u8_t channels);
+void readings_read(readings_t *snapshot);
+void readings_restore(const readings_t *snapshot);
+void readings_refresh_set(readings_ch_t ch, readings_refresh_t refresh);
+u8_t readings_refresh(u8_t channels);
+int readings_read_cached(readings_t *snapshot, readings_ch_t ch,
+                         u32_t max_age_ms);
+
+/* Converts lux to 0.01 lux, saturating instead of wrapping */
+static inline u16_t readings_als_from_lux(double lux)
+{
+    if (lux <= 0) {
+        return 0;
+    }
+
+    if (lux >= READINGS_ALS_MAX / 100.0) {
+        return READINGS_ALS_MAX;
+    }
+
+    return (u16_t)(100 * lux);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* READINGS_H */
@@ -0,0 +1,165 @@
+/** @file
+ *  @brief State retained across resets
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <zephyr.h>
+
+#include "retained.h"
+
+#define SYS_LOG_DOMAIN "retained"
+#define SYS_LOG_LEVEL 3
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Changes whenever the layout of retained_t changes */
+#define RETAINED_MAGIC      0x57a10001
+
+#define FNV_OFFSET_BASIS    0x811c9dc5
+#define FNV_PRIME           0x01000193
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static __noinit retained_t _retained;
+
+static bool _is_warm;
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+static u32_t checksum(const retained_t *r)
+{
+    const u8_t *p = (const u8_t *)r;
+    u32_t hash = FNV_OFFSET_BASIS;
+
+    for (int i = 0; i < offsetof(retained_t, checksum); i++) {
+        hash = (hash ^ p[i]) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/**
+* @private
+* @brief Moves the restored snapshot to the current uptime base
+*
+* Ages are kept: a value that was 20 s old at the last update is 20 s old
+* now. Time spent in reset is not known and counts as zero.
+*/
+static void readings_rebase(readings_t *readings, u32_t old_now)
+{
+    u32_t now = k_uptime_get_32();
+
+    readings->timestamp = now - (old_now - readings->timestamp);
+
+    for (int ch = 0; ch < READINGS_CH_COUNT; ch++) {
+        readings->sampled[ch] = now - (old_now - readings->sampled[ch]);
+    }
+}
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Validates the retained state and restores the readings snapshot
+*
+* Must run before any module that uses the retained state is initialised.
+*
+* @return true on a warm start
+*/
+bool retained_init(void)
+{
+    readings_t readings;
+
+    if (_retained.magic == RETAINED_MAGIC &&
+        _retained.checksum == checksum(&_retained)) {
+        _is_warm = true;
+        _retained.boot_count++;
+
+        memcpy(&readings, &_retained.readings, sizeof(readings));
+        readings_rebase(&readings, _retained.uptime);
+        readings_restore(&readings);
+
+        SYS_LOG_INF("Warm start %u", _retained.boot_count);
+    } else {
+        memset(&_retained, 0, sizeof(_retained));
+        _retained.magic = RETAINED_MAGIC;
+
+        SYS_LOG_INF("Cold start");
+    }
+
+    retained_update();
+
+    return _is_warm;
+}
+
+retained_t *retained_get(void)
+{
+    return &_retained;
+}
+
+/**
+* @brief Saves the current snapshot and seals the retained state
+*
+* Call after modifying the state returned by retained_get().
+*/
+void retained_update(void)
+{
+    unsigned int key;
+    readings_t readings;
+
+    readings_read(&readings);
+
+    key = irq_lock();
+    memcpy(&_retained.readings, &readings, sizeof(readings));
+    _retained.uptime = k_uptime_get_32();
+    _retained.checksum = checksum(&_retained);
+    irq_unlock(key);
+}
+
+/**
+* @brief Returns the delay before the first periodic measurement
+*
+* After a warm start the schedule continues where it was: the first
+* measurement is due one interval after the channel was last sampled.
+*/
+s32_t retained_first_delay(readings_ch_t ch, s32_t interval,
+                           s32_t cold_delay)
+{
+    readings_t readings;
+    u32_t age;
+
+    if (!_is_warm) {
+        return cold_delay;
+    }
+
+    readings_read(&readings);
+    if (!(readings.valid & BIT(ch))) {
+        return cold_delay;
+    }
+
+    age = k_uptime_get_32() - readings.sampled[ch];
+    if (age >= (u32_t)interval) {
+        return K_NO_WAIT;
+    }
+
+    return interval - age;
+}
@@ -0,0 +1,44 @@
+/** @file
+ *  @brief State retained across resets
+ *
+ *  Keeps the latest readings snapshot and the fuel gauge averaging state in
+ *  RAM that is not cleared at boot. After a reset that preserved RAM
+ *  (watchdog, fault, soft or pin reset) the node resumes with valid values
+ *  and its measurement schedule in phase. A checksum rejects the contents
+ *  after a power-on reset.
+ */
+
+#ifndef RETAINED_H
+#define RETAINED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+#include "fg.h"
+#include "readings.h"
+
+typedef struct {
+    u32_t magic;
+    u32_t boot_count;           /* Warm starts since the last cold start */
+    u32_t uptime;               /* Uptime of the last update, ms */
+    readings_t readings;        /* Snapshot at the last update */
+    u16_t vbat_avg[FG_NUM_VBAT_SAMPLES];
+    u8_t vbat_idx;
+    u32_t checksum;
+} retained_t;
+
+bool retained_init(void);
+retained_t *retained_get(void);
+void retained_update(void);
+s32_t retained_first_delay(readings_ch_t ch, s32_t interval,
+                           s32_t cold_delay);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RETAINED_H */
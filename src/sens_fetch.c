@@ -0,0 +1,75 @@
+/** @file
+ *  @brief Sensor fetches with the device resumed
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <errno.h>
+#include <zephyr.h>
+#include <device.h>
+#include <sensor.h>
+
+#include "sens_fetch.h"
+#include "dev_pm.h"
+#include "metrics.h"
+
+#define SYS_LOG_DOMAIN "sens_fetch"
+#define SYS_LOG_LEVEL 1
+#include <logging/sys_log.h>
+
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+/* Time for a disturbed bus to settle before the next attempt */
+#define SENS_FETCH_BACKOFF      K_MSEC(10)
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+/**
+* @brief Fetches a sensor sample with the device resumed
+*
+* Only -EIO, a failed bus transfer, counts as an I2C error and is retried.
+* A device that could not be resumed is not fetched at all.
+*
+* @param attempts Fetches to try, at least 1
+*/
+int sens_fetch(struct device *dev, u8_t attempts)
+{
+    int err;
+
+    err = dev_pm_get(dev);
+    if (err) {
+        return err;
+    }
+
+    while (true) {
+        err = sensor_sample_fetch(dev);
+        if (err != -EIO) {
+            break;
+        }
+
+        metrics_inc(METRIC_I2C_ERRORS);
+
+        if (--attempts == 0) {
+            break;
+        }
+
+        SYS_LOG_DBG("%s: bus error, retrying", dev->config->name);
+        metrics_inc(METRIC_I2C_RETRIES);
+        k_sleep(SENS_FETCH_BACKOFF);
+    }
+
+    dev_pm_put(dev);
+
+    return err;
+}
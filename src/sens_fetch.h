@@ -0,0 +1,27 @@
+/** @file
+ *  @brief Sensor fetches with the device resumed
+ *
+ *  Wraps sensor_sample_fetch() in dev_pm_get()/dev_pm_put() and counts bus
+ *  errors in the metrics. A fetch that failed on the bus is retried after
+ *  a short back off when the caller allows it; parts whose fetch waits out
+ *  a long conversion are better left for the next measurement period.
+ */
+
+#ifndef SENS_FETCH_H
+#define SENS_FETCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+struct device;
+
+int sens_fetch(struct device *dev, u8_t attempts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SENS_FETCH_H */
@@ -19,12 +19,20 @@
 #include "ble.h"
 #include "nv.h"
 #include "ess.h"
+#include "retained.h"
+#include "dev_pm.h"
+#include "sens_fetch.h"
+#include "energy.h"
+#include "probe.h"
+#include "trace.h"
+#include "metrics.h"
 
 #define CONFIG_SYS_LOG_T_RH_SENSOR_LEVEL 1
 
 #define SYS_LOG_DOMAIN "t_rh_sens"
 #define SYS_LOG_LEVEL CONFIG_SYS_LOG_T_RH_SENSOR_LEVEL
 #include <logging/sys_log.h>
+#include "blog.h"
 
 
 static struct device *si7020_dev;
@@ -32,6 +40,7 @@ static struct sensor_value rh_val;
 static struct sensor_value t_val;
 static struct k_timer meas_timer;
 static struct k_work meas_work;
+static bool _is_initialized;
 static t_rh_meas_cb_t meas_cb;
 
 
@@ -41,6 +50,7 @@ static nv_sensor_data_t default_sensor_data = {
     .update_interval  = 60,
     .application      = ESS_APPL_Air,
     .meas_uncertainty = 2,
+    .max_age          = 30,
 };
 
 static void meas_work_handler(struct k_work *work);
@@ -49,10 +59,14 @@ static void meas_timer_handler(struct k_timer *timer);
 
 static void meas_work_handler(struct k_work *work)
 {
+    u32_t start = probe_start();
+
+    metrics_wakeup();
+
     SYS_LOG_DBG("Periodic t and rh measurement");
-    t_rh_sens_meas();
 
-    if (meas_cb != NULL) {
+    /* A failed sample is not published, the readings keep the last one */
+    if (t_rh_sens_meas() == 0 && meas_cb != NULL) {
         t_rh_meas_t meas;
         meas.temperature = &t_val;
         meas.humidity = &rh_val;
@@ -60,28 +74,60 @@ static void meas_work_handler(struct k_work *work)
         meas.humidity_updated = true;
         meas_cb(&meas);
     }
+
+    probe_end(PROBE_T_RH_WORK, start);
 }
 
 static void meas_timer_handler(struct k_timer *timer)
 {
+    trace_event(TRACE_TIMER, PROBE_T_RH_WORK, 0);
     k_work_submit(&meas_work);
 }
 
-void t_rh_sens_meas(void)
+/**
+* @brief Starts a measurement outside the periodic schedule
+*
+* The result is delivered through the measurement callback.
+*/
+int t_rh_sens_request(void)
 {
-    sensor_sample_fetch(si7020_dev);
+    if (!_is_initialized) {
+        return -ENODEV;
+    }
+
+    k_work_submit(&meas_work);
+
+    return 0;
+}
+
+int t_rh_sens_meas(void)
+{
+    u32_t start = k_cycle_get_32();
+    int err;
+
+    err = sens_fetch(si7020_dev, 2);
+
+    energy_time_add(ENERGY_SI7020, k_cycle_get_32() - start);
+    probe_end(PROBE_SI7020_FETCH, start);
+
+    if (err) {
+        SYS_LOG_ERR("Error fetching si7020 sample (err %d)", err);
+        return err;
+    }
 
     if (sensor_channel_get(si7020_dev, SENSOR_CHAN_HUMIDITY, &rh_val)) {
         SYS_LOG_ERR("Error reading si7020 data");
-    } else {
-        SYS_LOG_INF("RH:%d.%06d", rh_val.val1, rh_val.val2);
+        return -EIO;
     }
+    BLOG_INF("RH:%d.%06d", rh_val.val1, rh_val.val2);
 
     if (sensor_channel_get(si7020_dev, SENSOR_CHAN_AMBIENT_TEMP, &t_val)) {
         SYS_LOG_ERR("Error reading si7020 data");
-    } else {
-        SYS_LOG_INF("T:%d.%06d", t_val.val1, t_val.val2);
+        return -EIO;
     }
+    BLOG_INF("T:%d.%06d", t_val.val1, t_val.val2);
+
+    return 0;
 }
 
 void t_rh_sens_init(t_rh_meas_cb_t callback)
@@ -89,6 +135,7 @@ void t_rh_sens_init(t_rh_meas_cb_t callback)
     int err = 0;
     nv_sensor_data_t rh_sensor_data;
     nv_sensor_data_t t_sensor_data;
+    struct device *rail_dev;
 
     meas_cb = callback;
 
@@ -98,8 +145,10 @@ void t_rh_sens_init(t_rh_meas_cb_t callback)
         return;
     }
 
-    // Needs to make one initial measurement for the device to enter sleep
-    sensor_sample_fetch(si7020_dev);
+    // Suspended between samples; transfers go through the rail wrapper
+    rail_dev = device_get_binding(CONFIG_I2C_WRAP_NAME);
+    dev_pm_add(rail_dev, NULL);
+    dev_pm_add(si7020_dev, rail_dev);
 
     err = nv_get_sensor_data(NV_SENSOR_HUMIDITY, &rh_sensor_data);
     if (err == -ENOENT) {
@@ -118,6 +167,17 @@ void t_rh_sens_init(t_rh_meas_cb_t callback)
     }
 
     k_work_init(&meas_work, meas_work_handler);
+    _is_initialized = true;
+
+    // Needs to make one initial measurement for the device to enter sleep,
+    // publish it rather than waiting for the first period. It runs on the
+    // workqueue, where the sensor is also probed, so boot is not held up.
+    k_work_submit(&meas_work);
+
     k_timer_init(&meas_timer, meas_timer_handler, NULL);
-    k_timer_start(&meas_timer, K_SECONDS(5), K_SECONDS(rh_sensor_data.update_interval));
+    k_timer_start(&meas_timer,
+                  retained_first_delay(READINGS_CH_TEMPERATURE,
+                                       K_SECONDS(rh_sensor_data.update_interval),
+                                       K_SECONDS(5)),
+                  K_SECONDS(rh_sensor_data.update_interval));
 }
@@ -19,6 +19,7 @@ typedef struct {
 typedef void (*t_rh_meas_cb_t)(t_rh_meas_t *measurement);
 
 void t_rh_sens_init(t_rh_meas_cb_t callback);
-void t_rh_sens_meas(void);
+int t_rh_sens_meas(void);
+int t_rh_sens_request(void);
 
 #endif /* T_RH_SENS_H */
@@ -0,0 +1,350 @@
+/** @file
+ *  @brief Event trace recorder
+ */
+
+/****************************************************************************
+* Include Directives
+***************************************************************************/
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <zephyr.h>
+#include <misc/byteorder.h>
+#include <device.h>
+#include <init.h>
+
+#ifdef CONFIG_HAS_SEGGER_RTT
+#include <rtt/SEGGER_RTT.h>
+#endif
+
+#ifdef CONFIG_KERNEL_EVENT_LOGGER
+#include <logging/kernel_event_logger.h>
+#endif
+
+#ifdef CONFIG_I2C_WRAP
+#include "i2c_wrap.h"
+#endif
+
+#include "trace.h"
+
+#ifdef CONFIG_WALNUT_TRACE
+
+/****************************************************************************
+* Preprocessor Directives
+***************************************************************************/
+
+#define TRACE_RING_SIZE         64      /* Events, power of two */
+
+#define TRACE_RTT_CHANNEL       2
+#define TRACE_RTT_BUF_SIZE      256
+
+#define TRACE_STACK_SIZE        384
+
+/* Threads told apart in the trace, the rest share the last index */
+#define TRACE_THREADS_MAX       8
+
+/* Context of events recorded in an interrupt */
+#define TRACE_CTX_ISR           0xff
+
+/* Event on the wire: u32 cycles, u8 type, u8 id, u8 context, pad, u32 arg */
+#define TRACE_EVENT_LEN         12
+
+/*
+ * The kernel event logger buffer is only read by this thread, which has
+ * to look at it even when nothing in the application was recorded.
+ */
+#ifdef CONFIG_KERNEL_EVENT_LOGGER
+#define TRACE_KERNEL_POLL       K_MSEC(100)
+#define TRACE_KERNEL_WORDS      4       /* Largest event merged */
+#else
+#define TRACE_KERNEL_POLL       K_FOREVER
+#endif
+
+
+/****************************************************************************
+* Private Type Declarations
+***************************************************************************/
+
+struct trace_event {
+    u32_t time;
+    u8_t type;
+    u8_t id;
+    u8_t ctx;
+    u32_t arg;
+};
+
+
+/****************************************************************************
+* Private Data Definitions
+***************************************************************************/
+
+static struct trace_event _ring[TRACE_RING_SIZE];
+static u16_t _head;
+static u16_t _tail;
+static u32_t _dropped;
+
+static k_tid_t _threads[TRACE_THREADS_MAX];
+
+static K_SEM_DEFINE(_pending, 0, 1);
+
+#ifdef CONFIG_HAS_SEGGER_RTT
+static u8_t _rtt_buf[TRACE_RTT_BUF_SIZE];
+#endif
+
+
+/****************************************************************************
+* Private Function Definitions
+***************************************************************************/
+
+/* Called with interrupts locked */
+static void put(u32_t time, trace_type_t type, u8_t id, u8_t ctx, u32_t arg)
+{
+    struct trace_event *event;
+
+    if ((u16_t)(_head - _tail) == TRACE_RING_SIZE) {
+        _dropped++;
+        return;
+    }
+
+    event = &_ring[_head++ % TRACE_RING_SIZE];
+    event->time = time;
+    event->type = type;
+    event->id = id;
+    event->ctx = ctx;
+    event->arg = arg;
+}
+
+/**
+* @private
+* @brief Gets the index of a thread, announcing new threads
+*
+* Called with interrupts locked.
+*/
+static u8_t ctx_of(k_tid_t thread, u32_t time)
+{
+    int i;
+
+    for (i = 0; i < TRACE_THREADS_MAX - 1; i++) {
+        if (_threads[i] == thread) {
+            return i;
+        }
+
+        if (_threads[i] == NULL) {
+            _threads[i] = thread;
+            put(time, TRACE_THREAD, i, i, (u32_t)thread);
+            return i;
+        }
+    }
+
+    return i;
+}
+
+/* Called with interrupts locked */
+static u8_t ctx_get(u32_t time)
+{
+    if (k_is_in_isr()) {
+        return TRACE_CTX_ISR;
+    }
+
+    return ctx_of(k_current_get(), time);
+}
+
+static void record(trace_type_t type, u8_t id, u32_t time, u32_t arg)
+{
+    unsigned int key = irq_lock();
+
+    put(time, type, id, ctx_get(time), arg);
+    irq_unlock(key);
+
+    k_sem_give(&_pending);
+}
+
+static void event_write(const struct trace_event *event)
+{
+    u8_t buf[TRACE_EVENT_LEN];
+
+    sys_put_le32(event->time, &buf[0]);
+    buf[4] = event->type;
+    buf[5] = event->id;
+    buf[6] = event->ctx;
+    buf[7] = 0;
+    sys_put_le32(event->arg, &buf[8]);
+
+#ifdef CONFIG_HAS_SEGGER_RTT
+    SEGGER_RTT_Write(TRACE_RTT_CHANNEL, buf, sizeof(buf));
+#endif
+}
+
+#ifdef CONFIG_KERNEL_EVENT_LOGGER
+/**
+* @private
+* @brief Moves the kernel's thread switch and interrupt events to the ring
+*
+* The events keep the time the kernel logged them at, k_cycle_get_32()
+* like the rest, so they land among the application events on the host.
+* Only as many are taken as the ring has room for, the others wait in the
+* logger buffer.
+*
+* @return The number of events moved
+*/
+static int kernel_events_merge(void)
+{
+    u32_t data[TRACE_KERNEL_WORDS];
+    unsigned int key;
+    u16_t event_id;
+    u8_t dropped;
+    u8_t size;
+    bool full;
+    int merged = 0;
+
+    while (1) {
+        key = irq_lock();
+        full = (u16_t)(_head - _tail) == TRACE_RING_SIZE;
+        irq_unlock(key);
+
+        if (full) {
+            break;
+        }
+
+        size = ARRAY_SIZE(data);
+        if (sys_k_event_logger_get(&event_id, &dropped, data, &size) <= 0) {
+            break;
+        }
+
+        key = irq_lock();
+
+        _dropped += dropped;
+
+        switch (event_id) {
+        case KERNEL_EVENT_LOGGER_CONTEXT_SWITCH_EVENT_ID:
+            put(data[0], TRACE_SWITCH, 0, ctx_of((k_tid_t)data[1], data[0]),
+                data[1]);
+            break;
+        case KERNEL_EVENT_LOGGER_INTERRUPT_EVENT_ID:
+            put(data[0], TRACE_ISR, data[1], TRACE_CTX_ISR, data[1]);
+            break;
+        default:
+            break;
+        }
+
+        irq_unlock(key);
+
+        merged++;
+    }
+
+    return merged;
+}
+#else
+static inline int kernel_events_merge(void)
+{
+    return 0;
+}
+#endif
+
+static void ring_flush(void)
+{
+    struct trace_event event;
+    unsigned int key;
+    u32_t dropped;
+    bool empty;
+
+    do {
+        key = irq_lock();
+        empty = (_head == _tail);
+        if (!empty) {
+            event = _ring[_tail++ % TRACE_RING_SIZE];
+        }
+        dropped = _dropped;
+        _dropped = 0;
+        irq_unlock(key);
+
+        if (dropped) {
+            struct trace_event drop = {
+                .time = k_cycle_get_32(),
+                .type = TRACE_DROPPED,
+                .ctx = TRACE_CTX_ISR,
+                .arg = dropped,
+            };
+
+            event_write(&drop);
+        }
+
+        if (!empty) {
+            event_write(&event);
+        }
+    } while (!empty);
+}
+
+/**
+* @private
+* @brief Streams the ring buffer whenever no other thread is ready
+*/
+static void trace_thread(void *p1, void *p2, void *p3)
+{
+    int merged;
+
+#ifdef CONFIG_HAS_SEGGER_RTT
+    /* Whole events are skipped when the host falls behind */
+    SEGGER_RTT_ConfigUpBuffer(TRACE_RTT_CHANNEL, "trace", _rtt_buf,
+                  sizeof(_rtt_buf), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+#endif
+
+#ifdef CONFIG_KERNEL_EVENT_LOGGER_CONTEXT_SWITCH
+    /* The switches to and from this thread would only trace the trace */
+    sys_k_event_logger_register_as_collector();
+#endif
+
+    while (1) {
+        k_sem_take(&_pending, TRACE_KERNEL_POLL);
+
+        do {
+            merged = kernel_events_merge();
+            ring_flush();
+        } while (merged);
+    }
+}
+
+static int trace_init(struct device *unused)
+{
+#ifdef CONFIG_I2C_WRAP
+    struct device *rail = device_get_binding(CONFIG_I2C_WRAP_NAME);
+
+    if (rail != NULL) {
+        i2c_wrap_rail_cb_set(rail, trace_rail);
+    }
+#endif
+
+    return 0;
+}
+
+SYS_INIT(trace_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+K_THREAD_DEFINE(trace_tid, TRACE_STACK_SIZE, trace_thread, NULL, NULL, NULL,
+        K_LOWEST_APPLICATION_THREAD_PRIO, 0, K_NO_WAIT);
+
+
+/****************************************************************************
+* Public Function Definitions
+***************************************************************************/
+
+void trace_event(trace_type_t type, u8_t id, u32_t arg)
+{
+    record(type, id, k_cycle_get_32(), arg);
+}
+
+/**
+* @brief Records a span that began at @p start, both from k_cycle_get_32()
+*/
+void trace_span(u8_t id, u32_t start, u32_t end)
+{
+    record(TRACE_SPAN, id, start, end - start);
+}
+
+void trace_rail(u32_t on)
+{
+    trace_event(TRACE_RAIL, 0, on);
+}
+
+#endif /* CONFIG_WALNUT_TRACE */
@@ -0,0 +1,56 @@
+/** @file
+ *  @brief Event trace recorder
+ *
+ *  Records timestamped events into a RAM ring buffer and streams them on
+ *  RTT channel 2 from the lowest priority thread. Every probe span is
+ *  recorded, together with timer expiries and sensor rail transitions, on
+ *  the thread or interrupt context they happened in. With the kernel event
+ *  logger, the thread switches and interrupts it records are merged in
+ *  with their own timestamps; the logger has no interrupt exit event, so
+ *  an interrupt is an instant.
+ *  scripts/trace_to_chrome.py turns a capture into a Chrome trace for
+ *  chrome://tracing or Perfetto.
+ *
+ *  Off by default, trace.conf is the overlay that enables the recorder
+ *  and the kernel event logger. The ring buffer and the thread stack cost
+ *  about 1.2 kB of RAM, the event logger buffer another 0.5 kB. The
+ *  sample capture (capture.h) streams on the same channel, so only one of
+ *  the two can be enabled.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+/* Events, the wire values are used by scripts/trace_to_chrome.py */
+typedef enum {
+    TRACE_THREAD = 1,       /* arg: thread pointer, first time it is seen */
+    TRACE_SPAN,             /* id: probe, arg: duration in cycles */
+    TRACE_TIMER,            /* id: probe of the work item it submits */
+    TRACE_RAIL,             /* arg: 1 on, 0 off */
+    TRACE_SWITCH,           /* Thread switched out, arg: thread pointer */
+    TRACE_ISR,              /* id, arg: IRQ number */
+    /* 7 was an interrupt exit event, the kernel does not log one */
+    TRACE_DROPPED = 8,      /* arg: events lost to a full ring buffer */
+} trace_type_t;
+
+#ifdef CONFIG_WALNUT_TRACE
+void trace_event(trace_type_t type, u8_t id, u32_t arg);
+void trace_span(u8_t id, u32_t start, u32_t end);
+void trace_rail(u32_t on);
+#else
+static inline void trace_event(trace_type_t type, u8_t id, u32_t arg) {}
+static inline void trace_span(u8_t id, u32_t start, u32_t end) {}
+static inline void trace_rail(u32_t on) {}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H */